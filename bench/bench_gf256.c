@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file bench_gf256.c
+ * @brief Reed-Solomon kernel microbenchmark
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "gf256.h"
+
+#define BENCH_ITERATIONS 200000
+
+typedef struct bench_shape {
+    const char *name;
+    int data_length;
+    int ec_length;
+} bench_shape_t;
+
+typedef void (*divpoly_t)(gf256_kernel_t k, uint8_t r[], int l,
+                          const uint8_t m[], int n, const uint8_t g[]);
+
+/**
+ * Divide the message polynomial by the generator polynomial with the long
+ * division by log and antilog tables, as encoded before the kernels.
+ *
+ * @param k unused.
+ * @param r the remainder of \a m divided by \a g.
+ * @param l message polynomial length.
+ * @param m message polynomial.
+ * @param n generation polynomial length.
+ * @param g generation polynomial.
+ */
+static void divpoly_reference(gf256_kernel_t k, uint8_t r[], int l,
+                              const uint8_t m[], int n, const uint8_t g[]) {
+    static uint8_t antilogs[256];
+    static uint8_t logs[256];
+    uint8_t t[l + n];
+
+    (void)k;
+
+    if (antilogs[0] == 0) {
+        int x = 1;
+
+        for (int i = 0; i < 256; i++) {
+            antilogs[i] = x;
+            logs[x] = i % 255;
+            x = (x << 1) ^ (x & 0x80 ? 0x11D : 0);
+        }
+    }
+
+    for (int i = 0; i < l + n; i++)
+        t[i] = i < l ? m[i] : 0;
+
+    for (int i = 0; i < l; i++)
+        if (t[i] != 0)
+            for (int j = 0; j < n; j++)
+                t[i + j + 1] ^= antilogs[(g[n - 1 - j] + logs[t[i]]) % 255];
+
+    for (int i = 0; i < n; i++)
+        r[i] = t[l + i];
+}
+
+/**
+ * Returns the elapsed time in nanoseconds per block.
+ *
+ * @param d division function.
+ * @param k kernel.
+ * @param s block shape.
+ * @return nanoseconds per block.
+ */
+static double bench(divpoly_t d, gf256_kernel_t k, bench_shape_t s) {
+    uint8_t m[s.data_length];
+    uint8_t g[s.ec_length];
+    uint8_t r[s.ec_length];
+    struct timespec start, stop;
+    unsigned sum = 0;
+
+    for (int i = 0; i < s.data_length; i++)
+        m[i] = rand() & 0xFF;
+
+    gf256_genpoly(s.ec_length, g);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        m[i % s.data_length] = i;
+        d(k, r, s.data_length, m, s.ec_length, g);
+        sum += r[s.ec_length - 1];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    // keeps the divisions from being optimized away
+    if (sum == 1)
+        putchar('\0');
+
+    return ((stop.tv_sec - start.tv_sec) * 1e9 +
+            (stop.tv_nsec - start.tv_nsec)) /
+           BENCH_ITERATIONS;
+}
+
+int main(int argc, char const *argv[]) {
+    const bench_shape_t shapes[] = {
+        {"40-H short", 15, 30}, {"40-H long", 16, 30}, {"40-L", 118, 30},
+        {"10-M", 43, 26},       {"1-L", 19, 7},
+    };
+    const char *names[] = {"table", "ssse3", "avx2"};
+
+    printf("%-12s %10s %10s %10s %10s\n", "block", "reference", names[0],
+           names[1], names[2]);
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        printf("%-12s %10.1f", shapes[i].name,
+               bench(divpoly_reference, GF256_KERNEL_TABLE, shapes[i]));
+
+        for (int k = GF256_KERNEL_TABLE; k <= GF256_KERNEL_AVX2; k++)
+            if (gf256_kernel_supported(k, shapes[i].ec_length))
+                printf(" %10.1f", bench(gf256_divpoly_kernel, k, shapes[i]));
+            else
+                printf(" %10s", "-");
+
+        putchar('\n');
+    }
+
+    printf("(ns per block)\n");
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file bench_svg.c
+ * @brief SVG path size and speed benchmark
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "qrcg.h"
+#include "svg.h"
+
+#define BENCH_ITERATIONS 2000
+#define BENCH_BUFFER_LENGTH (1 << 20)
+
+typedef size_t (*encoder_t)(char d[], size_t n, const bitmatrix_t *m,
+                            const svg_options_t *o);
+
+/**
+ * Encode the matrix as an SVG image with one rect element per dark module,
+ * as a naive writer would.
+ *
+ * @param d buffer.
+ * @param n buffer length.
+ * @param m matrix.
+ * @param o options.
+ * @return image length.
+ */
+static size_t encode_svg_rects(char d[], size_t n, const bitmatrix_t *m,
+                               const svg_options_t *o) {
+    int q = o->quiet_zone;
+    int l = m->n + q * 2;
+    size_t k = 0;
+
+#define APPEND(...)                                                            \
+    k += snprintf(k < n ? &d[k] : NULL, k < n ? n - k : 0, __VA_ARGS__)
+
+    APPEND("<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"%d %d %d %d\" "
+           "width=\"%d\" height=\"%d\" shape-rendering=\"crispEdges\">"
+           "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
+           "fill=\"#fff\"/>",
+           -q, -q, l, l, l * o->scale, l * o->scale, -q, -q, l, l);
+
+    for (int y = 0; y < m->n; y++)
+        for (int x = 0; x < m->n; x++)
+            if (bitmatrix_get(m, y, x))
+                APPEND("<rect x=\"%d\" y=\"%d\" width=\"1\" height=\"1\"/>", x,
+                       y);
+
+    APPEND("</svg>\n");
+
+#undef APPEND
+
+    return k;
+}
+
+/**
+ * Returns the elapsed time in microseconds per image.
+ *
+ * @param e encoder.
+ * @param m matrix.
+ * @param o options.
+ * @param d buffer.
+ * @param l image length.
+ * @return microseconds per image.
+ */
+static double bench(encoder_t e, const bitmatrix_t *m, const svg_options_t *o,
+                    char d[], size_t *l) {
+    struct timespec start, stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        *l = e(d, BENCH_BUFFER_LENGTH, m, o);
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    return ((stop.tv_sec - start.tv_sec) * 1e6 +
+            (stop.tv_nsec - start.tv_nsec) / 1e3) /
+           BENCH_ITERATIONS;
+}
+
+int main(int argc, char const *argv[]) {
+    // byte mode data lengths of versions 1, 10, 25 and 40 at level L
+    const int data_lengths[] = {17, 271, 1273, 2953};
+    const svg_options_t runs = {1, 4, SVG_PATH_RUNS};
+    const svg_options_t outlines = {1, 4, SVG_PATH_OUTLINES};
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    char *d = malloc(BENCH_BUFFER_LENGTH);
+    uint8_t s[QRCG_MAX_DATA_LENGTH];
+
+    if (c == NULL || d == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s\n", "symbol", "rects",
+           "runs", "outlines", "rects us", "runs us", "outline us");
+
+    for (size_t i = 0; i < sizeof(data_lengths) / sizeof(data_lengths[0]); i++) {
+        qrcg_symbol_t symbol;
+        size_t l[3];
+        double t[3];
+
+        for (int j = 0; j < data_lengths[i]; j++)
+            s[j] = rand() & 0xFF;
+
+        if (qrcg_encode(c, s, data_lengths[i], ERROR_CORRECTION_LEVEL_L,
+                        &symbol) < 0)
+            continue;
+
+        t[0] = bench(encode_svg_rects, symbol.modules, &runs, d, &l[0]);
+        t[1] = bench(encode_svg, symbol.modules, &runs, d, &l[1]);
+        t[2] = bench(encode_svg, symbol.modules, &outlines, d, &l[2]);
+
+        printf("%4d-L %10zu %10zu %10zu %10.1f %10.1f %10.1f\n",
+               symbol.version + 1, l[0], l[1], l[2], t[0], t[1], t[2]);
+    }
+
+    printf("(bytes and microseconds per image)\n");
+
+    qrcg_ctx_free(c);
+    free(d);
+
+    return 0;
+}
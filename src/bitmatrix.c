@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file bitmatrix.c
+ * @brief bitmatrix implementation
+ */
+#include "bitmatrix.h"
+
+/**
+ * Resize the matrix and set all of its bits.
+ *
+ * @param m matrix.
+ * @param n matrix length.
+ * @param b bit.
+ */
+void bitmatrix_fill(bitmatrix_t *m, int n, bool b) {
+    m->n = n;
+
+    for (int i = 0; i < BITMATRIX_MAX_LENGTH; i++)
+        for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+            m->r[i][j] = i < n && b ? bitmatrix_row_mask(n, j) : 0;
+}
+
+/**
+ * Transpose a 64 x 64 bit block in place.
+ *
+ * @param a rows of the block.
+ */
+static void transpose_block(uint64_t a[BITMATRIX_WORD_BITS]) {
+    uint64_t m = 0x00000000FFFFFFFF;
+
+    for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < BITMATRIX_WORD_BITS; k = (k + j + 1) & ~j) {
+            uint64_t t = (a[k] ^ (a[k + j] >> j)) & m;
+
+            a[k] ^= t;
+            a[k + j] ^= t << j;
+        }
+    }
+}
+
+/**
+ * Transpose the matrix, so that the columns of \a s are the rows of \a d.
+ *
+ * @param d transposed matrix.
+ * @param s matrix.
+ */
+void bitmatrix_transpose(bitmatrix_t *d, const bitmatrix_t *s) {
+    uint64_t a[BITMATRIX_WORD_BITS];
+
+    d->n = s->n;
+
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++) {
+        for (int j = 0; j < BITMATRIX_ROW_WORDS; j++) {
+            for (int k = 0; k < BITMATRIX_WORD_BITS; k++)
+                a[k] = s->r[i * BITMATRIX_WORD_BITS + k][j];
+
+            transpose_block(a);
+
+            for (int k = 0; k < BITMATRIX_WORD_BITS; k++)
+                d->r[j * BITMATRIX_WORD_BITS + k][i] = a[k];
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file bitmatrix.h
+ * @brief bitmatrix header
+ *
+ * A square matrix of bits with one bit per module. Each row is stored in 64-bit
+ * words, most significant bit first, so the leftmost module of a row is the
+ * most significant bit of its first word. Bits outside of the matrix are
+ * always 0.
+ */
+#ifndef BITMATRIX_H
+#define BITMATRIX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BITMATRIX_WORD_BITS 64
+#define BITMATRIX_MAX_LENGTH 192
+#define BITMATRIX_ROW_WORDS (BITMATRIX_MAX_LENGTH / BITMATRIX_WORD_BITS)
+
+typedef struct bitmatrix {
+    int n;
+    uint64_t r[BITMATRIX_MAX_LENGTH][BITMATRIX_ROW_WORDS];
+} bitmatrix_t;
+
+/**
+ * Returns the bit at (x, y).
+ *
+ * @param m matrix.
+ * @param y Y coordinate.
+ * @param x X coordinate.
+ * @return bit at (x, y).
+ */
+static inline bool bitmatrix_get(const bitmatrix_t *m, int y, int x) {
+    return m->r[y][x / BITMATRIX_WORD_BITS] >>
+               (BITMATRIX_WORD_BITS - 1 - x % BITMATRIX_WORD_BITS) &
+           1;
+}
+
+/**
+ * Set the bit at (x, y).
+ *
+ * @param m matrix.
+ * @param y Y coordinate.
+ * @param x X coordinate.
+ * @param b bit.
+ */
+static inline void bitmatrix_set(bitmatrix_t *m, int y, int x, bool b) {
+    uint64_t *w = &m->r[y][x / BITMATRIX_WORD_BITS];
+    uint64_t k = (uint64_t)1
+                 << (BITMATRIX_WORD_BITS - 1 - x % BITMATRIX_WORD_BITS);
+
+    *w = (*w & ~k) | (-(uint64_t)b & k);
+}
+
+/**
+ * Returns the bits of a row word that are inside of the matrix.
+ *
+ * @param n matrix length.
+ * @param w index of the word in a row.
+ * @return bits of the word that are inside of the matrix.
+ */
+static inline uint64_t bitmatrix_row_mask(int n, int w) {
+    int k = n - w * BITMATRIX_WORD_BITS;
+
+    if (k >= BITMATRIX_WORD_BITS)
+        return ~(uint64_t)0;
+
+    if (k <= 0)
+        return 0;
+
+    return ~(~(uint64_t)0 >> k);
+}
+
+extern void bitmatrix_fill(bitmatrix_t *m, int n, bool b);
+extern void bitmatrix_transpose(bitmatrix_t *d, const bitmatrix_t *s);
+
+#endif /* BITMATRIX_H */
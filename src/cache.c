@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file cache.c
+ * @brief cache implementation
+ *
+ * Finished images are cached by their input string and the options they were
+ * generated with, in memory and optionally in a file shared by processes. The
+ * whole key is stored with each entry, so a hash collision never returns the
+ * image of another input.
+ *
+ * The memory cache is a hash table whose entries are also linked from the
+ * most to the least recently used, which is evicted first once the size limit
+ * is exceeded.
+ *
+ * The file is mapped into memory and consists of a header followed by sets of
+ * fixed-size slots. A key can only be stored in the set selected by its hash,
+ * replacing the least recently used slot of the set. Processes lock the byte
+ * range of a set with fcntl() while accessing it, and the counters in the
+ * header are updated atomically. A slot is marked empty before it is
+ * overwritten, so that a writer stopped halfway never leaves it readable. The
+ * header records the version of the images. A process opening a file of
+ * another version empties every slot in place while it holds a lock on the
+ * whole file, and the processes still using the old version see the change
+ * under the lock of each set and stop reading and writing the file. A file in
+ * another format of the cache is not opened, since its users may still have it
+ * mapped.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.h"
+
+#define DISK_MAGIC 0x5152434743414348 // "QRCGCACH"
+#define DISK_FORMAT_VERSION 2
+#define DISK_HEADER_SIZE 4096
+#define DISK_SLOT_SIZE 4096
+#define DISK_SET_SLOTS 4
+
+#define MEMORY_BUCKETS 4096
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325
+#define FNV_PRIME 0x100000001B3
+
+typedef struct disk_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t set_slots;
+    uint32_t num_sets;
+    _Atomic uint32_t image_version;
+    _Atomic uint64_t clock;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+} disk_header_t;
+
+typedef struct disk_slot {
+    // time of the last use, or 0 if the slot is empty
+    _Atomic uint64_t stamp;
+    uint64_t hash;
+    uint64_t options;
+    uint32_t key_length;
+    uint32_t data_length;
+    uint8_t bytes[];
+} disk_slot_t;
+
+typedef struct memory_entry {
+    struct memory_entry *next;
+    struct memory_entry *newer;
+    struct memory_entry *older;
+    uint64_t hash;
+    uint64_t options;
+    size_t key_length;
+    size_t data_length;
+    uint8_t bytes[];
+} memory_entry_t;
+
+struct cache {
+    pthread_mutex_t mutex;
+
+    memory_entry_t *buckets[MEMORY_BUCKETS];
+    memory_entry_t *newest;
+    memory_entry_t *oldest;
+    size_t memory_size;
+    size_t memory_limit;
+    uint64_t memory_hits;
+    uint64_t memory_misses;
+
+    int fd;
+    disk_header_t *header;
+    size_t disk_size;
+    uint32_t image_version;
+};
+
+/**
+ * Returns the FNV-1a hash of the key.
+ *
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @return hash.
+ */
+static uint64_t hash_key(uint64_t o, const uint8_t s[], size_t l) {
+    uint64_t h = FNV_OFFSET_BASIS;
+
+    for (int i = 0; i < 8; i++)
+        h = (h ^ (uint8_t)(o >> i * 8)) * FNV_PRIME;
+
+    for (size_t i = 0; i < l; i++)
+        h = (h ^ s[i]) * FNV_PRIME;
+
+    return h;
+}
+
+/**
+ * Returns a copy of the data.
+ *
+ * @param d data.
+ * @param n data length.
+ * @return copy, or NULL if out of memory.
+ */
+static uint8_t *copy_data(const uint8_t d[], size_t n) {
+    uint8_t *p = malloc(n > 0 ? n : 1);
+
+    if (p != NULL)
+        memcpy(p, d, n);
+
+    return p;
+}
+
+/**
+ * Lock the byte range of a set of the file.
+ *
+ * @param c cache.
+ * @param i set index.
+ * @param t lock type, F_RDLCK, F_WRLCK or F_UNLCK.
+ */
+static void lock_set(cache_t *c, uint32_t i, short t) {
+    struct flock l = {0};
+
+    l.l_type = t;
+    l.l_whence = SEEK_SET;
+    l.l_start = DISK_HEADER_SIZE + (off_t)i * DISK_SET_SLOTS * DISK_SLOT_SIZE;
+    l.l_len = DISK_SET_SLOTS * DISK_SLOT_SIZE;
+
+    fcntl(c->fd, F_SETLKW, &l);
+}
+
+/**
+ * Returns the slot of the file.
+ *
+ * @param c cache.
+ * @param i set index.
+ * @param j slot index in the set.
+ * @return slot.
+ */
+static disk_slot_t *disk_slot(cache_t *c, uint32_t i, int j) {
+    return (disk_slot_t *)((uint8_t *)c->header + DISK_HEADER_SIZE +
+                           ((size_t)i * DISK_SET_SLOTS + j) * DISK_SLOT_SIZE);
+}
+
+/**
+ * Returns true if the file still holds images of the version of the cache,
+ * which a process of another version changes when it opens the file. The
+ * caller holds the lock of a set.
+ *
+ * @param c cache.
+ * @return true if the version of the images is that of the cache.
+ */
+static bool disk_current(cache_t *c) {
+    return atomic_load(&c->header->image_version) == c->image_version;
+}
+
+/**
+ * Empty every slot of the file and record the version of the images. The
+ * caller holds a write lock on the whole file, which excludes the lock of
+ * every set.
+ *
+ * @param c cache.
+ * @param v version of the images.
+ */
+static void reset_disk(cache_t *c, uint32_t v) {
+    atomic_store(&c->header->image_version, v);
+
+    for (uint32_t i = 0; i < c->header->num_sets; i++)
+        for (int j = 0; j < DISK_SET_SLOTS; j++)
+            atomic_store(&disk_slot(c, i, j)->stamp, 0);
+}
+
+/**
+ * Open the file of the cache, creating it with the size if it does not exist.
+ * An existing file keeps its size, and is emptied if it holds images of another
+ * version. A file in another format of the cache is not opened.
+ *
+ * @param c cache.
+ * @param p file path.
+ * @param d file size.
+ * @param v version of the images.
+ * @return true on success and false otherwise.
+ */
+static bool open_disk(cache_t *c, const char *p, size_t d, uint32_t v) {
+    struct flock l = {0};
+    struct stat s;
+    disk_header_t h = {0};
+
+    if ((c->fd = open(p, O_RDWR | O_CREAT, 0666)) < 0)
+        return false;
+
+    l.l_type = F_WRLCK;
+    l.l_whence = SEEK_SET;
+
+    if (fcntl(c->fd, F_SETLKW, &l) < 0 || fstat(c->fd, &s) < 0)
+        return false;
+
+    c->image_version = v;
+
+    if (s.st_size != 0 &&
+        (pread(c->fd, &h, sizeof(h), 0) != sizeof(h) ||
+         h.magic != DISK_MAGIC || h.version != DISK_FORMAT_VERSION))
+        return false;
+
+    if (s.st_size == 0) {
+        size_t n = d > DISK_HEADER_SIZE ? d - DISK_HEADER_SIZE : 0;
+
+        h.magic = DISK_MAGIC;
+        h.version = DISK_FORMAT_VERSION;
+        h.slot_size = DISK_SLOT_SIZE;
+        h.set_slots = DISK_SET_SLOTS;
+        h.num_sets = n / (DISK_SET_SLOTS * DISK_SLOT_SIZE);
+        h.image_version = v;
+
+        if (h.num_sets == 0)
+            h.num_sets = 1;
+
+        c->disk_size = DISK_HEADER_SIZE + (size_t)h.num_sets *
+                                              DISK_SET_SLOTS * DISK_SLOT_SIZE;
+
+        if (ftruncate(c->fd, c->disk_size) < 0 ||
+            pwrite(c->fd, &h, sizeof(h), 0) != sizeof(h))
+            return false;
+
+    } else {
+        if (h.slot_size != DISK_SLOT_SIZE || h.set_slots != DISK_SET_SLOTS ||
+            h.num_sets == 0)
+            return false;
+
+        c->disk_size = DISK_HEADER_SIZE + (size_t)h.num_sets *
+                                              DISK_SET_SLOTS * DISK_SLOT_SIZE;
+
+        if ((size_t)s.st_size != c->disk_size)
+            return false;
+    }
+
+    void *m = mmap(NULL, c->disk_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   c->fd, 0);
+
+    if (m != MAP_FAILED) {
+        c->header = m;
+
+        if (h.image_version != v)
+            reset_disk(c, v);
+    }
+
+    l.l_type = F_UNLCK;
+    fcntl(c->fd, F_SETLK, &l);
+
+    return m != MAP_FAILED;
+}
+
+/**
+ * Look up the key in the file.
+ *
+ * @param c cache.
+ * @param h hash.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @param n data length.
+ * @return copy of the data, or NULL if not found.
+ */
+static uint8_t *get_disk(cache_t *c, uint64_t h, uint64_t o, const uint8_t s[],
+                         size_t l, size_t *n) {
+    uint32_t i = h % c->header->num_sets;
+    uint8_t *d = NULL;
+
+    lock_set(c, i, F_RDLCK);
+
+    for (int j = 0; j < DISK_SET_SLOTS && d == NULL && disk_current(c); j++) {
+        disk_slot_t *t = disk_slot(c, i, j);
+
+        if (atomic_load(&t->stamp) == 0 || t->hash != h || t->options != o ||
+            t->key_length != l || memcmp(t->bytes, s, l) != 0)
+            continue;
+
+        // the stamp only orders replacement, so a read lock is enough
+        atomic_store(&t->stamp, atomic_fetch_add(&c->header->clock, 1) + 1);
+
+        if ((d = copy_data(&t->bytes[l], t->data_length)) != NULL)
+            *n = t->data_length;
+    }
+
+    lock_set(c, i, F_UNLCK);
+
+    atomic_fetch_add(d != NULL ? &c->header->hits : &c->header->misses, 1);
+
+    return d;
+}
+
+/**
+ * Store the key and the data in the file, replacing the least recently used
+ * slot of the set. Entries larger than a slot are not stored.
+ *
+ * @param c cache.
+ * @param h hash.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @param d data.
+ * @param n data length.
+ */
+static void put_disk(cache_t *c, uint64_t h, uint64_t o, const uint8_t s[],
+                     size_t l, const uint8_t d[], size_t n) {
+    if (sizeof(disk_slot_t) + l + n > DISK_SLOT_SIZE)
+        return;
+
+    uint32_t i = h % c->header->num_sets;
+    disk_slot_t *t = NULL;
+
+    lock_set(c, i, F_WRLCK);
+
+    for (int j = 0; j < DISK_SET_SLOTS && disk_current(c); j++) {
+        disk_slot_t *u = disk_slot(c, i, j);
+        uint64_t k = atomic_load(&u->stamp);
+
+        if (k != 0 && u->hash == h && u->options == o && u->key_length == l &&
+            memcmp(u->bytes, s, l) == 0) {
+            t = NULL;
+            break;
+        }
+
+        if (t == NULL || k < atomic_load(&t->stamp))
+            t = u;
+    }
+
+    if (t != NULL) {
+        // empty until it is complete
+        atomic_store(&t->stamp, 0);
+
+        t->hash = h;
+        t->options = o;
+        t->key_length = l;
+        t->data_length = n;
+        memcpy(t->bytes, s, l);
+        memcpy(&t->bytes[l], d, n);
+        atomic_store(&t->stamp, atomic_fetch_add(&c->header->clock, 1) + 1);
+    }
+
+    lock_set(c, i, F_UNLCK);
+}
+
+/**
+ * Returns the entry of the key in the memory cache.
+ *
+ * @param c cache.
+ * @param h hash.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @return entry, or NULL if not found.
+ */
+static memory_entry_t *find_memory(cache_t *c, uint64_t h, uint64_t o,
+                                   const uint8_t s[], size_t l) {
+    memory_entry_t *e = c->buckets[h % MEMORY_BUCKETS];
+
+    for (; e != NULL; e = e->next)
+        if (e->hash == h && e->options == o && e->key_length == l &&
+            memcmp(e->bytes, s, l) == 0)
+            return e;
+
+    return NULL;
+}
+
+/**
+ * Unlink the entry from the list of the memory cache ordered by use.
+ *
+ * @param c cache.
+ * @param e entry.
+ */
+static void unlink_memory(cache_t *c, memory_entry_t *e) {
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        c->newest = e->older;
+
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        c->oldest = e->newer;
+}
+
+/**
+ * Link the entry to the list of the memory cache as the most recently used.
+ *
+ * @param c cache.
+ * @param e entry.
+ */
+static void link_memory(cache_t *c, memory_entry_t *e) {
+    e->newer = NULL;
+    e->older = c->newest;
+
+    if (c->newest != NULL)
+        c->newest->newer = e;
+    else
+        c->oldest = e;
+
+    c->newest = e;
+}
+
+/**
+ * Remove the least recently used entry from the memory cache.
+ *
+ * @param c cache.
+ */
+static void evict_memory(cache_t *c) {
+    memory_entry_t *e = c->oldest;
+    memory_entry_t **p = &c->buckets[e->hash % MEMORY_BUCKETS];
+
+    while (*p != e)
+        p = &(*p)->next;
+
+    *p = e->next;
+    unlink_memory(c, e);
+    c->memory_size -= sizeof(memory_entry_t) + e->key_length + e->data_length;
+    free(e);
+}
+
+/**
+ * Store the key and the data in the memory cache, evicting the least recently
+ * used entries to keep it within the size limit.
+ *
+ * @param c cache.
+ * @param h hash.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @param d data.
+ * @param n data length.
+ */
+static void put_memory(cache_t *c, uint64_t h, uint64_t o, const uint8_t s[],
+                       size_t l, const uint8_t d[], size_t n) {
+    size_t z = sizeof(memory_entry_t) + l + n;
+    memory_entry_t *e;
+
+    if (z > c->memory_limit || find_memory(c, h, o, s, l) != NULL ||
+        (e = malloc(z)) == NULL)
+        return;
+
+    while (c->memory_size + z > c->memory_limit)
+        evict_memory(c);
+
+    e->hash = h;
+    e->options = o;
+    e->key_length = l;
+    e->data_length = n;
+    memcpy(e->bytes, s, l);
+    memcpy(&e->bytes[l], d, n);
+
+    e->next = c->buckets[h % MEMORY_BUCKETS];
+    c->buckets[h % MEMORY_BUCKETS] = e;
+    link_memory(c, e);
+    c->memory_size += z;
+}
+
+/**
+ * Open a cache. The memory cache is disabled if \a m is 0.
+ *
+ * @param p path of the cache file, or NULL for a memory cache only.
+ * @param d cache file size, used only when the file is created.
+ * @param m memory cache size.
+ * @param v version of the images, to be changed whenever the image generated
+ * for the same input string and options changes.
+ * @return cache, or NULL on failure.
+ */
+cache_t *cache_open(const char *p, size_t d, size_t m, uint32_t v) {
+    cache_t *c = calloc(1, sizeof(cache_t));
+
+    if (c == NULL)
+        return NULL;
+
+    pthread_mutex_init(&c->mutex, NULL);
+    c->memory_limit = m;
+    c->fd = -1;
+
+    if (p != NULL && !open_disk(c, p, d, v)) {
+        cache_close(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+/**
+ * Close the cache.
+ *
+ * @param c cache.
+ */
+void cache_close(cache_t *c) {
+    if (c == NULL)
+        return;
+
+    while (c->oldest != NULL)
+        evict_memory(c);
+
+    if (c->header != NULL)
+        munmap(c->header, c->disk_size);
+
+    if (c->fd >= 0)
+        close(c->fd);
+
+    pthread_mutex_destroy(&c->mutex);
+    free(c);
+}
+
+/**
+ * Look up the image of the input string generated with the options, first in
+ * memory and then in the file. An image found in the file is also stored in
+ * memory.
+ *
+ * @param c cache.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @param n image length.
+ * @return copy of the image to be freed by the caller, or NULL if not found.
+ */
+uint8_t *cache_get(cache_t *c, uint64_t o, const uint8_t s[], size_t l,
+                   size_t *n) {
+    uint64_t h = hash_key(o, s, l);
+    uint8_t *d = NULL;
+
+    pthread_mutex_lock(&c->mutex);
+
+    if (c->memory_limit > 0) {
+        memory_entry_t *e = find_memory(c, h, o, s, l);
+
+        if (e == NULL) {
+            c->memory_misses++;
+
+        } else {
+            c->memory_hits++;
+            unlink_memory(c, e);
+            link_memory(c, e);
+
+            if ((d = copy_data(&e->bytes[l], e->data_length)) != NULL)
+                *n = e->data_length;
+        }
+    }
+
+    if (d == NULL && c->header != NULL &&
+        (d = get_disk(c, h, o, s, l, n)) != NULL && c->memory_limit > 0)
+        put_memory(c, h, o, s, l, d, *n);
+
+    pthread_mutex_unlock(&c->mutex);
+
+    return d;
+}
+
+/**
+ * Store the image of the input string generated with the options.
+ *
+ * @param c cache.
+ * @param o options.
+ * @param s input string.
+ * @param l input string length.
+ * @param d image.
+ * @param n image length.
+ */
+void cache_put(cache_t *c, uint64_t o, const uint8_t s[], size_t l,
+               const uint8_t d[], size_t n) {
+    uint64_t h = hash_key(o, s, l);
+
+    pthread_mutex_lock(&c->mutex);
+
+    if (c->memory_limit > 0)
+        put_memory(c, h, o, s, l, d, n);
+
+    if (c->header != NULL)
+        put_disk(c, h, o, s, l, d, n);
+
+    pthread_mutex_unlock(&c->mutex);
+}
+
+/**
+ * Get the hit and miss counters. The counters of the file are shared by every
+ * process using it.
+ *
+ * @param c cache.
+ * @param s counters.
+ */
+void cache_stats(cache_t *c, cache_stats_t *s) {
+    pthread_mutex_lock(&c->mutex);
+
+    s->memory_hits = c->memory_hits;
+    s->memory_misses = c->memory_misses;
+    s->disk_hits = c->header != NULL ? atomic_load(&c->header->hits) : 0;
+    s->disk_misses = c->header != NULL ? atomic_load(&c->header->misses) : 0;
+
+    pthread_mutex_unlock(&c->mutex);
+}
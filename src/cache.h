@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file cache.h
+ * @brief cache header
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct cache cache_t;
+
+typedef struct cache_stats {
+    uint64_t memory_hits;
+    uint64_t memory_misses;
+    uint64_t disk_hits;
+    uint64_t disk_misses;
+} cache_stats_t;
+
+extern cache_t *cache_open(const char *p, size_t d, size_t m, uint32_t v);
+extern void cache_close(cache_t *c);
+extern uint8_t *cache_get(cache_t *c, uint64_t o, const uint8_t s[], size_t l,
+                          size_t *n);
+extern void cache_put(cache_t *c, uint64_t o, const uint8_t s[], size_t l,
+                      const uint8_t d[], size_t n);
+extern void cache_stats(cache_t *c, cache_stats_t *s);
+
+#endif /* CACHE_H */
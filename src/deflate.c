@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file deflate.c
+ * @brief deflate implementation
+ *
+ * A zlib stream compressor for images fed one row at a time. Matches are only
+ * searched at distance 1, for runs of the same byte, and at the distance of one
+ * row, for bytes repeated from the row above. Each block is written with the
+ * fixed or a dynamic Huffman code, whichever is shorter.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+
+#define ADLER_MODULUS 65521
+#define ADLER_MAX_RUN 5552
+
+#define ZLIB_CMF 0x78
+#define ZLIB_FLG 0x01
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+#define NUM_LENGTH_CODES 29
+#define NUM_LITLEN_CODES 288
+#define MAX_LITLEN_CODES 286
+#define MIN_LITLEN_CODES 257
+#define NUM_DISTANCE_CODES 30
+#define NUM_CODELEN_CODES 19
+#define MIN_CODELEN_CODES 4
+#define MAX_CODE_BITS 15
+#define MAX_CODELEN_BITS 7
+#define END_OF_BLOCK 256
+
+#define BLOCK_TYPE_FIXED 1
+#define BLOCK_TYPE_DYNAMIC 2
+
+static const uint16_t length_bases[NUM_LENGTH_CODES] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+
+static const uint8_t length_extra_bits[NUM_LENGTH_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+static const uint16_t distance_bases[NUM_DISTANCE_CODES] = {
+    1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+    33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+
+static const uint8_t distance_extra_bits[NUM_DISTANCE_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static const uint8_t codelen_order[NUM_CODELEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static const uint8_t codelen_extra_bits[NUM_CODELEN_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7};
+
+typedef struct huffman_code {
+    uint8_t lengths[NUM_LITLEN_CODES];
+    uint16_t codes[NUM_LITLEN_CODES];
+} huffman_code_t;
+
+/**
+ * Update the Adler-32 checksum.
+ *
+ * @param a checksum, 1 for no data.
+ * @param d data.
+ * @param n data length.
+ * @return updated checksum.
+ */
+uint32_t deflate_adler32(uint32_t a, const uint8_t d[], size_t n) {
+    uint32_t s1 = a & 0xFFFF;
+    uint32_t s2 = a >> 16;
+
+    while (n > 0) {
+        size_t k = n < ADLER_MAX_RUN ? n : ADLER_MAX_RUN;
+
+        n -= k;
+
+        while (k-- > 0) {
+            s1 += *d++;
+            s2 += s1;
+        }
+
+        s1 %= ADLER_MODULUS;
+        s2 %= ADLER_MODULUS;
+    }
+
+    return s2 << 16 | s1;
+}
+
+/**
+ * Pass the buffered output to the output function.
+ *
+ * @param z deflate stream.
+ */
+static void flush_buffer(deflate_t *z) {
+    if (z->buffer_length > 0)
+        z->output(z->output_arg, z->buffer, z->buffer_length);
+
+    z->buffer_length = 0;
+}
+
+/**
+ * Write bits, least significant bit first.
+ *
+ * @param z deflate stream.
+ * @param v bits.
+ * @param n number of bits, up to 32.
+ */
+static void put_bits(deflate_t *z, uint32_t v, int n) {
+    z->bits |= (uint64_t)v << z->num_bits;
+    z->num_bits += n;
+
+    while (z->num_bits >= 8) {
+        z->buffer[z->buffer_length++] = z->bits;
+        z->bits >>= 8;
+        z->num_bits -= 8;
+
+        if (z->buffer_length == DEFLATE_BUFFER_LENGTH)
+            flush_buffer(z);
+    }
+}
+
+/**
+ * Returns the code of a match length.
+ *
+ * @param l match length.
+ * @return length code, from 0 for symbol 257.
+ */
+static int length_code(int l) {
+    int c = NUM_LENGTH_CODES - 1;
+
+    while (length_bases[c] > l)
+        c--;
+
+    return c;
+}
+
+/**
+ * Returns the code of a match distance.
+ *
+ * @param d match distance.
+ * @return distance code.
+ */
+static int distance_code(int d) {
+    int c = NUM_DISTANCE_CODES - 1;
+
+    while (distance_bases[c] > d)
+        c--;
+
+    return c;
+}
+
+/**
+ * Compare two leaves of a Huffman tree by weight, then by symbol.
+ *
+ * @param a leaf.
+ * @param b leaf.
+ * @return negative, zero or positive as \a a is lighter, equal or heavier.
+ */
+static int compare_leaves(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Calculate the code lengths of a Huffman code limited to \a k bits. While the
+ * tree is too deep, the frequencies are halved, which flattens the tree.
+ *
+ * @param f frequency of each symbol.
+ * @param n number of symbols.
+ * @param k maximum code length.
+ * @param l code length of each symbol, 0 for unused symbols.
+ */
+static void build_lengths(const uint32_t f[], int n, int k, uint8_t l[]) {
+    uint64_t leaves[NUM_LITLEN_CODES];
+    uint32_t w[NUM_LITLEN_CODES * 2];
+    int parents[NUM_LITLEN_CODES * 2];
+    uint8_t depths[NUM_LITLEN_CODES * 2];
+
+    for (int shift = 0;; shift++) {
+        int m = 0;
+
+        for (int i = 0; i < n; i++) {
+            l[i] = 0;
+
+            if (f[i] > 0)
+                leaves[m++] = (uint64_t)(((f[i] - 1) >> shift) + 1) << 16 | i;
+        }
+
+        if (m == 0)
+            return;
+
+        if (m == 1) {
+            l[leaves[0] & 0xFFFF] = 1;
+            return;
+        }
+
+        qsort(leaves, m, sizeof(uint64_t), compare_leaves);
+
+        for (int i = 0; i < m; i++)
+            w[i] = leaves[i] >> 16;
+
+        // leaves and internal nodes are both taken in order of weight
+        int a = 0;
+        int b = m;
+
+        for (int t = m; t < m * 2 - 1; t++) {
+            int c[2];
+
+            for (int j = 0; j < 2; j++)
+                c[j] = a < m && (b >= t || w[a] <= w[b]) ? a++ : b++;
+
+            w[t] = w[c[0]] + w[c[1]];
+            parents[c[0]] = t;
+            parents[c[1]] = t;
+        }
+
+        int max = 0;
+
+        depths[m * 2 - 2] = 0;
+
+        for (int t = m * 2 - 3; t >= 0; t--) {
+            depths[t] = depths[parents[t]] + 1;
+
+            if (depths[t] > max)
+                max = depths[t];
+        }
+
+        if (max <= k) {
+            for (int i = 0; i < m; i++)
+                l[leaves[i] & 0xFFFF] = depths[i];
+
+            return;
+        }
+    }
+}
+
+/**
+ * Assign the canonical codes of the code lengths, bit-reversed to be written
+ * least significant bit first.
+ *
+ * @param h Huffman code, whose lengths are set.
+ * @param n number of symbols.
+ */
+static void build_codes(huffman_code_t *h, int n) {
+    int counts[MAX_CODE_BITS + 1] = {0};
+    int next[MAX_CODE_BITS + 1];
+    int c = 0;
+
+    for (int i = 0; i < n; i++)
+        counts[h->lengths[i]]++;
+
+    counts[0] = 0;
+
+    for (int b = 1; b <= MAX_CODE_BITS; b++) {
+        c = (c + counts[b - 1]) << 1;
+        next[b] = c;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int b = h->lengths[i];
+        int v = b == 0 ? 0 : next[b]++;
+        int r = 0;
+
+        for (int j = 0; j < b; j++)
+            r |= (v >> j & 1) << (b - 1 - j);
+
+        h->codes[i] = r;
+    }
+}
+
+/**
+ * Run-length encode the code lengths of a dynamic block header.
+ *
+ * @param l code lengths.
+ * @param n number of code lengths.
+ * @param s code length symbols.
+ * @param x extra bits of each code length symbol.
+ * @return number of code length symbols.
+ */
+static int encode_lengths(const uint8_t l[], int n, uint8_t s[], uint8_t x[]) {
+    int k = 0;
+
+    for (int i = 0; i < n;) {
+        int r = 1;
+
+        while (i + r < n && l[i + r] == l[i])
+            r++;
+
+        if (l[i] == 0 && r >= 3) {
+            int c = r > 138 ? 138 : r;
+
+            s[k] = c >= 11 ? 18 : 17;
+            x[k++] = c - (c >= 11 ? 11 : 3);
+            i += c;
+
+        } else {
+            s[k] = l[i];
+            x[k++] = 0;
+            i++;
+
+            // repeat the previous length 3 to 6 times
+            for (r--; r >= 3;) {
+                int c = r > 6 ? 6 : r;
+
+                s[k] = 16;
+                x[k++] = c - 3;
+                i += c;
+                r -= c;
+            }
+        }
+    }
+
+    return k;
+}
+
+/**
+ * Write the buffered symbols as a block.
+ *
+ * @param z deflate stream.
+ * @param last true for the last block of the stream.
+ */
+static void write_block(deflate_t *z, bool last) {
+    uint32_t lf[NUM_LITLEN_CODES] = {0};
+    uint32_t df[NUM_DISTANCE_CODES] = {0};
+    uint32_t cf[NUM_CODELEN_CODES] = {0};
+    huffman_code_t fl;
+    huffman_code_t fd;
+    huffman_code_t ll;
+    huffman_code_t dl;
+    huffman_code_t cl;
+    uint8_t lengths[MAX_LITLEN_CODES + NUM_DISTANCE_CODES];
+    uint8_t symbols[MAX_LITLEN_CODES + NUM_DISTANCE_CODES];
+    uint8_t extra[MAX_LITLEN_CODES + NUM_DISTANCE_CODES];
+    size_t extra_cost = 0;
+
+    for (int i = 0; i < z->num_symbols; i++) {
+        const deflate_symbol_t *s = &z->symbols[i];
+
+        if (s->length == 0) {
+            lf[s->value]++;
+
+        } else {
+            int c = length_code(s->length);
+            int d = distance_code(s->value);
+
+            lf[END_OF_BLOCK + 1 + c]++;
+            df[d]++;
+            extra_cost += length_extra_bits[c] + distance_extra_bits[d];
+        }
+    }
+
+    lf[END_OF_BLOCK] = 1;
+
+    // fixed code
+    for (int i = 0; i < NUM_LITLEN_CODES; i++)
+        fl.lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+
+    for (int i = 0; i < NUM_DISTANCE_CODES; i++)
+        fd.lengths[i] = 5;
+
+    // dynamic code
+    build_lengths(lf, MAX_LITLEN_CODES, MAX_CODE_BITS, ll.lengths);
+    build_lengths(df, NUM_DISTANCE_CODES, MAX_CODE_BITS, dl.lengths);
+
+    ll.lengths[NUM_LITLEN_CODES - 2] = 0;
+    ll.lengths[NUM_LITLEN_CODES - 1] = 0;
+
+    // a block without matches still needs one distance code
+    bool distances = false;
+
+    for (int i = 0; i < NUM_DISTANCE_CODES; i++)
+        distances |= dl.lengths[i] != 0;
+
+    if (!distances)
+        dl.lengths[0] = 1;
+
+    int hlit = MAX_LITLEN_CODES;
+    int hdist = NUM_DISTANCE_CODES;
+    int hclen = NUM_CODELEN_CODES;
+
+    while (hlit > MIN_LITLEN_CODES && ll.lengths[hlit - 1] == 0)
+        hlit--;
+
+    while (hdist > 1 && dl.lengths[hdist - 1] == 0)
+        hdist--;
+
+    memcpy(lengths, ll.lengths, hlit);
+    memcpy(&lengths[hlit], dl.lengths, hdist);
+
+    int num_symbols = encode_lengths(lengths, hlit + hdist, symbols, extra);
+
+    for (int i = 0; i < num_symbols; i++)
+        cf[symbols[i]]++;
+
+    build_lengths(cf, NUM_CODELEN_CODES, MAX_CODELEN_BITS, cl.lengths);
+
+    while (hclen > MIN_CODELEN_CODES &&
+           cl.lengths[codelen_order[hclen - 1]] == 0)
+        hclen--;
+
+    size_t fixed_cost = extra_cost;
+    size_t dynamic_cost = extra_cost + 5 + 5 + 4 + hclen * 3;
+
+    for (int i = 0; i < NUM_LITLEN_CODES; i++) {
+        fixed_cost += lf[i] * fl.lengths[i];
+        dynamic_cost += lf[i] * ll.lengths[i];
+    }
+
+    for (int i = 0; i < NUM_DISTANCE_CODES; i++) {
+        fixed_cost += df[i] * fd.lengths[i];
+        dynamic_cost += df[i] * dl.lengths[i];
+    }
+
+    for (int i = 0; i < NUM_CODELEN_CODES; i++)
+        dynamic_cost += cf[i] * (cl.lengths[i] + codelen_extra_bits[i]);
+
+    bool dynamic = dynamic_cost < fixed_cost;
+    huffman_code_t *lc = dynamic ? &ll : &fl;
+    huffman_code_t *dc = dynamic ? &dl : &fd;
+
+    put_bits(z, last, 1);
+    put_bits(z, dynamic ? BLOCK_TYPE_DYNAMIC : BLOCK_TYPE_FIXED, 2);
+
+    if (dynamic) {
+        build_codes(&cl, NUM_CODELEN_CODES);
+
+        put_bits(z, hlit - MIN_LITLEN_CODES, 5);
+        put_bits(z, hdist - 1, 5);
+        put_bits(z, hclen - MIN_CODELEN_CODES, 4);
+
+        for (int i = 0; i < hclen; i++)
+            put_bits(z, cl.lengths[codelen_order[i]], 3);
+
+        for (int i = 0; i < num_symbols; i++) {
+            put_bits(z, cl.codes[symbols[i]], cl.lengths[symbols[i]]);
+            put_bits(z, extra[i], codelen_extra_bits[symbols[i]]);
+        }
+    }
+
+    build_codes(lc, NUM_LITLEN_CODES);
+    build_codes(dc, NUM_DISTANCE_CODES);
+
+    for (int i = 0; i < z->num_symbols; i++) {
+        const deflate_symbol_t *s = &z->symbols[i];
+
+        if (s->length == 0) {
+            put_bits(z, lc->codes[s->value], lc->lengths[s->value]);
+            continue;
+        }
+
+        int c = length_code(s->length);
+        int d = distance_code(s->value);
+
+        put_bits(z, lc->codes[END_OF_BLOCK + 1 + c],
+                 lc->lengths[END_OF_BLOCK + 1 + c]);
+        put_bits(z, s->length - length_bases[c], length_extra_bits[c]);
+        put_bits(z, dc->codes[d], dc->lengths[d]);
+        put_bits(z, s->value - distance_bases[d], distance_extra_bits[d]);
+    }
+
+    put_bits(z, lc->codes[END_OF_BLOCK], lc->lengths[END_OF_BLOCK]);
+
+    z->num_symbols = 0;
+}
+
+/**
+ * Add a literal or a match to the current block.
+ *
+ * @param z deflate stream.
+ * @param l match length, or 0 for a literal.
+ * @param v match distance, or the literal.
+ */
+static void add_symbol(deflate_t *z, int l, int v) {
+    if (z->num_symbols == DEFLATE_BLOCK_SYMBOLS)
+        write_block(z, false);
+
+    z->symbols[z->num_symbols].length = l;
+    z->symbols[z->num_symbols].value = v;
+    z->num_symbols++;
+}
+
+/**
+ * Start a zlib stream.
+ *
+ * @param z deflate stream.
+ * @param o output function, called whenever the buffer is full.
+ * @param a output argument.
+ */
+void deflate_init(deflate_t *z, deflate_output_t o, void *a) {
+    z->output = o;
+    z->output_arg = a;
+    z->buffer_length = 0;
+    z->bits = 0;
+    z->num_bits = 0;
+    z->adler = 1;
+    z->row_length = 0;
+    z->num_rows = 0;
+    z->num_symbols = 0;
+
+    put_bits(z, ZLIB_CMF, 8);
+    put_bits(z, ZLIB_FLG, 8);
+}
+
+/**
+ * Compress a row. A byte is matched with the run of the same byte before it,
+ * or with the same bytes of the previous row if that has the same length.
+ *
+ * @param z deflate stream.
+ * @param r row.
+ * @param l row length, up to DEFLATE_MAX_ROW_LENGTH.
+ */
+void deflate_row(deflate_t *z, const uint8_t r[], int l) {
+    bool up = z->num_rows > 0 && z->row_length == l;
+
+    z->adler = deflate_adler32(z->adler, r, l);
+
+    for (int i = 0; i < l;) {
+        int m = l - i < MAX_MATCH ? l - i : MAX_MATCH;
+        int run = 0;
+        int same = 0;
+
+        if (i > 0)
+            while (run < m && r[i + run] == r[i - 1])
+                run++;
+
+        if (up)
+            while (same < m && r[i + same] == z->row[i + same])
+                same++;
+
+        if (run >= MIN_MATCH && run >= same) {
+            add_symbol(z, run, 1);
+            i += run;
+
+        } else if (same >= MIN_MATCH) {
+            add_symbol(z, same, l);
+            i += same;
+
+        } else {
+            add_symbol(z, 0, r[i]);
+            i++;
+        }
+    }
+
+    memcpy(z->row, r, l);
+    z->row_length = l;
+    z->num_rows++;
+}
+
+/**
+ * Finish the zlib stream and pass the rest of it to the output function.
+ *
+ * @param z deflate stream.
+ */
+void deflate_finish(deflate_t *z) {
+    write_block(z, true);
+
+    if (z->num_bits > 0)
+        put_bits(z, 0, 8 - z->num_bits);
+
+    for (int i = 3; i >= 0; i--)
+        put_bits(z, z->adler >> (i * 8) & 0xFF, 8);
+
+    flush_buffer(z);
+}
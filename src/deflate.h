@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file deflate.h
+ * @brief deflate header
+ */
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFLATE_MAX_ROW_LENGTH 1024
+#define DEFLATE_BLOCK_SYMBOLS 8192
+#define DEFLATE_BUFFER_LENGTH 8192
+
+/**
+ * Output of the compressed stream.
+ *
+ * @param a output argument.
+ * @param d compressed data.
+ * @param n compressed data length.
+ */
+typedef void (*deflate_output_t)(void *a, const uint8_t d[], size_t n);
+
+typedef struct deflate_symbol {
+    uint16_t length;
+    uint16_t value;
+} deflate_symbol_t;
+
+typedef struct deflate {
+    deflate_output_t output;
+    void *output_arg;
+    uint8_t buffer[DEFLATE_BUFFER_LENGTH];
+    int buffer_length;
+    uint64_t bits;
+    int num_bits;
+    uint32_t adler;
+    int row_length;
+    int num_rows;
+    uint8_t row[DEFLATE_MAX_ROW_LENGTH];
+    int num_symbols;
+    deflate_symbol_t symbols[DEFLATE_BLOCK_SYMBOLS];
+} deflate_t;
+
+extern uint32_t deflate_adler32(uint32_t a, const uint8_t d[], size_t n);
+extern void deflate_init(deflate_t *z, deflate_output_t o, void *a);
+extern void deflate_row(deflate_t *z, const uint8_t r[], int l);
+extern void deflate_finish(deflate_t *z);
+
+#endif /* DEFLATE_H */
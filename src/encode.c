@@ -27,14 +27,41 @@
 #include <stdbool.h>
 #include "encode.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define ENCODE_X86
+#include <immintrin.h>
+#endif
+
 #define MODE_INDICATOR_LEN (4)
+#define STRUCTURED_APPEND_MODE_INDICATOR 3
+
+#define CLASSIFY_CHUNK_LEN 256
+
+#define SEGMENT_STATE_START NUM_SEGMENT_STATES
+#define SEGMENT_COST_INFINITY (1 << 30)
+
+// data codewords, index of the next codeword, and the bits not written yet,
+// flushed a 64-bit word at a time
+typedef struct bit_stream {
+    uint8_t *d;
+    int i;
+    int k;
+    uint64_t b;
+} bit_stream_t;
+
+// encoding mode and number of characters in the last incomplete group of each
+// state of the segmentation
+static const encoding_mode_t segment_state_modes[] = {
+    ENCODING_MODE_NUMERIC,      ENCODING_MODE_NUMERIC, ENCODING_MODE_NUMERIC,
+    ENCODING_MODE_ALPHANUMERIC, ENCODING_MODE_ALPHANUMERIC,
+    ENCODING_MODE_BYTE,         ENCODING_MODE_KANJI};
 
-#define append_bits(l, b, n, v)                                                \
-    do {                                                                       \
-        b <<= n;                                                               \
-        b |= v;                                                                \
-        l += n;                                                                \
-    } while (0)
+// state after one more character, and the number of bits it adds
+static const int8_t segment_state_nexts[] = {1, 2, 0, 4, 3, 5, 6};
+static const int8_t segment_state_bits[] = {4, 3, 3, 6, 5, 8, 13};
+
+// state at the start of a segment of each encoding mode
+static const int8_t segment_start_states[] = {0, 3, 5, 6};
 
 static const int8_t chrcnt_indicator_lens[][4] = {
     {10, 9, 8, 8}, {12, 11, 16, 10}, {14, 13, 16, 12}};
@@ -123,197 +150,743 @@ static bool is_sjis_kanji(uint8_t f, uint8_t s) {
            (f << 8 | s) <= 0xEBBF;
 }
 
+/**
+ * Classify the bytes one by one.
+ *
+ * @param l input string length.
+ * @param s input string.
+ * @param i index of the first byte to classify.
+ * @param n number of bytes to classify.
+ * @param c class map of the bytes.
+ */
+static void classify_bytes(int l, const uint8_t s[], int i, int n,
+                           uint8_t c[]) {
+    for (int j = 0; j < n; j++, i++) {
+        c[j] = CHAR_CLASS(ENCODING_MODE_BYTE);
+
+        if ('0' <= s[i] && s[i] <= '9')
+            c[j] |= CHAR_CLASS(ENCODING_MODE_NUMERIC);
+
+        if (s[i] < 0x80 && alphanumerics[s[i]] >= 0)
+            c[j] |= CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC);
+
+        if (i + 1 < l && is_sjis_kanji(s[i], s[i + 1]))
+            c[j] |= CHAR_CLASS(ENCODING_MODE_KANJI);
+    }
+}
+
+#ifdef ENCODE_X86
+
+/**
+ * Returns the bytes that are in the range, all ones for true.
+ *
+ * @param x bytes.
+ * @param a lower bound.
+ * @param b upper bound.
+ * @return comparison result.
+ */
+static inline __m128i in_range_sse2(__m128i x, uint8_t a, uint8_t b) {
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(a));
+
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(b - a)), d);
+}
+
+/**
+ * Classify 16 bytes at a time with SSE2, leaving the rest to
+ * classify_bytes(). The next byte of each byte is loaded from one byte later
+ * for the kanji class.
+ *
+ * @param l input string length.
+ * @param s input string.
+ * @param i index of the first byte to classify.
+ * @param n number of bytes to classify.
+ * @param c class map of the bytes.
+ */
+static void classify_sse2(int l, const uint8_t s[], int i, int n,
+                          uint8_t c[]) {
+    const __m128i cn = _mm_set1_epi8(CHAR_CLASS(ENCODING_MODE_NUMERIC));
+    const __m128i ca = _mm_set1_epi8(CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC));
+    const __m128i cb = _mm_set1_epi8(CHAR_CLASS(ENCODING_MODE_BYTE));
+    const __m128i ck = _mm_set1_epi8(CHAR_CLASS(ENCODING_MODE_KANJI));
+    int j = 0;
+
+    for (; j + 16 <= n && i + j + 17 <= l; j += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i + j]);
+        __m128i y = _mm_loadu_si128((const __m128i *)&s[i + j + 1]);
+
+        __m128i d = in_range_sse2(x, '0', '9');
+        __m128i a = _mm_or_si128(d, in_range_sse2(x, 'A', 'Z'));
+
+        a = _mm_or_si128(a, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+        a = _mm_or_si128(a, in_range_sse2(x, '$', '%'));
+        a = _mm_or_si128(a, in_range_sse2(x, '*', '+'));
+        a = _mm_or_si128(a, in_range_sse2(x, '-', '/'));
+        a = _mm_or_si128(a, _mm_cmpeq_epi8(x, _mm_set1_epi8(':')));
+
+        __m128i k = _mm_or_si128(in_range_sse2(x, 0x81, 0x9F),
+                                 in_range_sse2(x, 0xE0, 0xEB));
+
+        k = _mm_and_si128(k, in_range_sse2(y, 0x40, 0xFC));
+        k = _mm_andnot_si128(_mm_cmpeq_epi8(y, _mm_set1_epi8(0x7F)), k);
+
+        // up to 0xEBBF
+        k = _mm_andnot_si128(
+            _mm_andnot_si128(in_range_sse2(y, 0x00, 0xBF),
+                             _mm_cmpeq_epi8(x, _mm_set1_epi8(0xEB))),
+            k);
+
+        __m128i r = _mm_or_si128(
+            _mm_or_si128(cb, _mm_and_si128(d, cn)),
+            _mm_or_si128(_mm_and_si128(a, ca), _mm_and_si128(k, ck)));
+
+        _mm_storeu_si128((__m128i *)&c[j], r);
+    }
+
+    classify_bytes(l, s, i + j, n - j, &c[j]);
+}
+
+/**
+ * Returns the bytes that are in the range, all ones for true.
+ *
+ * @param x bytes.
+ * @param a lower bound.
+ * @param b upper bound.
+ * @return comparison result.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+in_range_avx2(__m256i x, uint8_t a, uint8_t b) {
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(a));
+
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(b - a)), d);
+}
+
+/**
+ * Classify 32 bytes at a time with AVX2, leaving the rest to
+ * classify_sse2().
+ *
+ * @param l input string length.
+ * @param s input string.
+ * @param i index of the first byte to classify.
+ * @param n number of bytes to classify.
+ * @param c class map of the bytes.
+ */
+__attribute__((target("avx2"))) static void
+classify_avx2(int l, const uint8_t s[], int i, int n, uint8_t c[]) {
+    const __m256i cn = _mm256_set1_epi8(CHAR_CLASS(ENCODING_MODE_NUMERIC));
+    const __m256i ca =
+        _mm256_set1_epi8(CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC));
+    const __m256i cb = _mm256_set1_epi8(CHAR_CLASS(ENCODING_MODE_BYTE));
+    const __m256i ck = _mm256_set1_epi8(CHAR_CLASS(ENCODING_MODE_KANJI));
+    int j = 0;
+
+    for (; j + 32 <= n && i + j + 33 <= l; j += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)&s[i + j]);
+        __m256i y = _mm256_loadu_si256((const __m256i *)&s[i + j + 1]);
+
+        __m256i d = in_range_avx2(x, '0', '9');
+        __m256i a = _mm256_or_si256(d, in_range_avx2(x, 'A', 'Z'));
+
+        a = _mm256_or_si256(a, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+        a = _mm256_or_si256(a, in_range_avx2(x, '$', '%'));
+        a = _mm256_or_si256(a, in_range_avx2(x, '*', '+'));
+        a = _mm256_or_si256(a, in_range_avx2(x, '-', '/'));
+        a = _mm256_or_si256(a, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(':')));
+
+        __m256i k = _mm256_or_si256(in_range_avx2(x, 0x81, 0x9F),
+                                    in_range_avx2(x, 0xE0, 0xEB));
+
+        k = _mm256_and_si256(k, in_range_avx2(y, 0x40, 0xFC));
+        k = _mm256_andnot_si256(_mm256_cmpeq_epi8(y, _mm256_set1_epi8(0x7F)),
+                                k);
+
+        // up to 0xEBBF
+        k = _mm256_andnot_si256(
+            _mm256_andnot_si256(in_range_avx2(y, 0x00, 0xBF),
+                                _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0xEB))),
+            k);
+
+        __m256i r = _mm256_or_si256(
+            _mm256_or_si256(cb, _mm256_and_si256(d, cn)),
+            _mm256_or_si256(_mm256_and_si256(a, ca), _mm256_and_si256(k, ck)));
+
+        _mm256_storeu_si256((__m256i *)&c[j], r);
+    }
+
+    classify_sse2(l, s, i + j, n - j, &c[j]);
+}
+
+#endif /* ENCODE_X86 */
+
+/**
+ * Classify the bytes with the widest vectors supported on this CPU.
+ *
+ * @param l input string length.
+ * @param s input string.
+ * @param i index of the first byte to classify.
+ * @param n number of bytes to classify.
+ * @param c class map of the bytes.
+ */
+static void classify(int l, const uint8_t s[], int i, int n, uint8_t c[]) {
+#ifdef ENCODE_X86
+    if (__builtin_cpu_supports("avx2"))
+        classify_avx2(l, s, i, n, c);
+    else
+        classify_sse2(l, s, i, n, c);
+#else
+    classify_bytes(l, s, i, n, c);
+#endif
+}
+
+/**
+ * Append bits to the bit stream, writing out the buffer as 8 codewords each
+ * time 64 bits are completed.
+ *
+ * @param t bit stream.
+ * @param n number of bits, up to 56.
+ * @param v bits.
+ */
+static void append_bits(bit_stream_t *t, int n, uint64_t v) {
+    if (t->k + n < 64) {
+        t->b = t->b << n | v;
+        t->k += n;
+        return;
+    }
+
+    int r = t->k + n - 64;
+    uint64_t w = t->b << (n - r) | v >> r;
+
+    for (int j = 0; j < 8; j++)
+        t->d[t->i++] = w >> (56 - j * 8);
+
+    t->b = v & (((uint64_t)1 << r) - 1);
+    t->k = r;
+}
+
 /**
  * Add terminator, padding bits and pad codewords.
  *
  * @param n data codewords length.
- * @param d data codewords.
- * @param i index of data codewords.
- * @param k buffer length.
- * @param b buffer.
+ * @param t bit stream.
  */
-static void terminate_data_codewords(int n, uint8_t d[], int i, int k,
-                                     uint32_t b) {
-    int r = (n - i) * 8 - k;
+static void terminate_data_codewords(int n, bit_stream_t *t) {
+    int r = (n - t->i) * 8 - t->k;
 
     // terminator
-    int t = r < 4 ? r : 4;
-    b <<= t;
-    k += t;
-    r -= t;
+    append_bits(t, r < 4 ? r : 4, 0);
 
     // add padding bits
-    r %= 8;
-    b <<= r;
-    k += r;
+    append_bits(t, (8 - t->k % 8) % 8, 0);
 
-    while (k > 0) {
-        k -= 8;
-        d[i++] = b >> k;
+    while (t->k > 0) {
+        t->k -= 8;
+        t->d[t->i++] = t->b >> t->k;
     }
 
     // add pad codewords
     uint8_t p = 0xEC;
 
-    while (i < n) {
-        d[i++] = p;
+    while (t->i < n) {
+        t->d[t->i++] = p;
         p ^= 0xFD;
     }
 }
 
+#ifdef ENCODE_X86
+
 /**
- * Encode in numeric mode.
+ * Encode digits in numeric mode with SSSE3, 12 digits at a time. PSHUFB
+ * spreads each group of 3 digits to 4 bytes, PMADDUBSW and PMADDWD weight
+ * and sum them into 4 32-bit values of 10 bits.
  *
- * @param n data codewords length.
- * @param d data codewords.
+ * @param t bit stream.
  * @param l input string length.
  * @param s input string.
- * @param c character count indicator length.
+ * @return number of digits encoded.
  */
-static void encode_numeric_mode(int n, uint8_t d[], int l, const uint8_t s[],
-                                int c) {
-    // mode indicator
-    uint32_t b = 0x1;
-    int k = MODE_INDICATOR_LEN;
+__attribute__((target("ssse3"))) static int
+pack_numeric_ssse3(bit_stream_t *t, int l, const uint8_t s[]) {
+    const __m128i z = _mm_set1_epi8('0');
+    const __m128i p = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9,
+                                    10, 11, -1);
+    const __m128i w = _mm_setr_epi8(100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1,
+                                    0, 100, 10, 1, 0);
+    const __m128i o = _mm_set1_epi16(1);
+    uint32_t v[4];
+    int i = 0;
 
-    // character count indicator
-    append_bits(k, b, c, l);
+    for (; i + 16 <= l; i += 12) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
 
-    // encoded data
-    int j = 0;
+        x = _mm_shuffle_epi8(_mm_sub_epi8(x, z), p);
+        x = _mm_madd_epi16(_mm_maddubs_epi16(x, w), o);
+        _mm_storeu_si128((__m128i *)v, x);
+
+        append_bits(t, 40,
+                    (uint64_t)v[0] << 30 | (uint64_t)v[1] << 20 |
+                        (uint64_t)v[2] << 10 | v[3]);
+    }
 
-    for (int i = 2; i < l; i += 3) {
-        append_bits(
-            k, b, 10,
-            ((s[i - 2] - '0') * 100 + (s[i - 1] - '0') * 10 + (s[i] - '0')));
+    return i;
+}
+
+/**
+ * Encode characters in alphanumeric mode with SSSE3, 16 characters at a time.
+ * Digits and letters are converted by subtraction, and the symbols from 0x20
+ * to 0x2F by PSHUFB on their low nibble. PMADDUBSW then computes 8 pairs of
+ * 11 bits.
+ *
+ * @param t bit stream.
+ * @param l input string length.
+ * @param s input string.
+ * @return number of characters encoded.
+ */
+__attribute__((target("ssse3"))) static int
+pack_alphanumeric_ssse3(bit_stream_t *t, int l, const uint8_t s[]) {
+    const __m128i symbols = _mm_setr_epi8(36, 0, 0, 0, 37, 38, 0, 0, 0, 0, 39,
+                                          40, 0, 41, 42, 43);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i weights = _mm_set1_epi16(1 << 8 | 45);
+    uint16_t v[8];
+    int i = 0;
 
-        do {
-            k -= 8;
-            d[j++] = b >> k;
-        } while (k >= 8);
+    for (; i + 16 <= l; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i letter = _mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1));
+        __m128i digit = _mm_andnot_si128(
+            letter, _mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)));
+        __m128i symbol = _mm_cmpgt_epi8(_mm_set1_epi8('0'), x);
+
+        // ':' follows '9' as 10, but its value is 44
+        __m128i d = _mm_add_epi8(
+            _mm_sub_epi8(x, _mm_set1_epi8('0')),
+            _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(':')),
+                          _mm_set1_epi8(34)));
+
+        x = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(letter, _mm_sub_epi8(x, _mm_set1_epi8('A' - 10))),
+                _mm_and_si128(digit, d)),
+            _mm_and_si128(symbol,
+                          _mm_shuffle_epi8(symbols, _mm_and_si128(x, nibble))));
+
+        _mm_storeu_si128((__m128i *)v, _mm_maddubs_epi16(x, weights));
+
+        for (int j = 0; j < 8; j += 4)
+            append_bits(t, 44,
+                        (uint64_t)v[j] << 33 | (uint64_t)v[j + 1] << 22 |
+                            (uint64_t)v[j + 2] << 11 | v[j + 3]);
     }
 
-    if (l % 3 == 2)
-        append_bits(k, b, 7, ((s[l - 2] - '0') * 10 + (s[l - 1] - '0')));
+    return i;
+}
 
-    else if (l % 3 == 1)
-        append_bits(k, b, 4, (s[l - 1] - '0'));
+#endif /* ENCODE_X86 */
 
-    // terminator, padding bits and pad codewords
-    terminate_data_codewords(n, d, j, k, b);
+/**
+ * Encode in numeric mode.
+ *
+ * @param t bit stream.
+ * @param l input string length.
+ * @param s input string.
+ */
+static void encode_numeric_mode(bit_stream_t *t, int l, const uint8_t s[]) {
+    int i = 0;
+
+#ifdef ENCODE_X86
+    if (__builtin_cpu_supports("ssse3"))
+        i = pack_numeric_ssse3(t, l, s);
+#endif
+
+    for (; i + 3 <= l; i += 3)
+        append_bits(t, 10,
+                    (s[i] - '0') * 100 + (s[i + 1] - '0') * 10 +
+                        (s[i + 2] - '0'));
+
+    if (l - i == 2)
+        append_bits(t, 7, ((s[i] - '0') * 10 + (s[i + 1] - '0')));
+
+    else if (l - i == 1)
+        append_bits(t, 4, (s[i] - '0'));
 }
 
 /**
  * Encode in alphanumeric mode.
  *
- * @param n data codewords length.
- * @param d data codewords.
+ * @param t bit stream.
  * @param l input string length.
  * @param s input string.
- * @param c character count indicator length.
  */
-static void encode_alphanumeric_mode(int n, uint8_t d[], int l,
-                                     const uint8_t s[], int c) {
-    // mode indicator
-    uint32_t b = 0x2;
-    int k = MODE_INDICATOR_LEN;
+static void encode_alphanumeric_mode(bit_stream_t *t, int l,
+                                     const uint8_t s[]) {
+    int i = 0;
 
-    // character count indicator
-    append_bits(k, b, c, l);
+#ifdef ENCODE_X86
+    if (__builtin_cpu_supports("ssse3"))
+        i = pack_alphanumeric_ssse3(t, l, s);
+#endif
 
-    // encoded data
-    int j = 0;
+    for (; i + 2 <= l; i += 2)
+        append_bits(t, 11, alphanumerics[s[i]] * 45 + alphanumerics[s[i + 1]]);
 
-    for (int i = 1; i < l; i += 2) {
-        append_bits(k, b, 11,
-                    (alphanumerics[s[i - 1]] * 45 + alphanumerics[s[i]]));
+    if (l - i == 1)
+        append_bits(t, 6, alphanumerics[s[i]]);
+}
 
-        do {
-            k -= 8;
-            d[j++] = b >> k;
-        } while (k >= 8);
-    }
+/**
+ * Encode in byte mode.
+ *
+ * @param t bit stream.
+ * @param l input string length.
+ * @param s input string.
+ */
+static void encode_byte_mode(bit_stream_t *t, int l, const uint8_t s[]) {
+    int i = 0;
 
-    if (l % 2 == 1)
-        append_bits(k, b, 6, alphanumerics[s[l - 1]]);
+    for (; i + 4 <= l; i += 4)
+        append_bits(t, 32,
+                    (uint32_t)s[i] << 24 | s[i + 1] << 16 | s[i + 2] << 8 |
+                        s[i + 3]);
 
-    // terminator, padding bits and pad codewords
-    terminate_data_codewords(n, d, j, k, b);
+    for (; i < l; i++)
+        append_bits(t, 8, s[i]);
 }
 
 /**
- * Encode in byte mode.
+ * Returns the 13-bit value of a kanji character.
  *
- * @param n data codewords length.
- * @param d data codewords.
+ * @param f first byte.
+ * @param s second byte.
+ * @return value.
+ */
+static uint32_t kanji_value(uint8_t f, uint8_t s) {
+    return (f - ((f & 0xC0) | 0x01) - (s < 0x40)) * 0xC0 + (s - 0x40);
+}
+
+/**
+ * Encode in kanji mode.
+ *
+ * @param t bit stream.
  * @param l input string length.
  * @param s input string.
- * @param c character count indicator length.
  */
-static void encode_byte_mode(int n, uint8_t d[], int l, const uint8_t s[],
-                             int c) {
+static void encode_kanji_mode(bit_stream_t *t, int l, const uint8_t s[]) {
+    int i = 0;
+
+    for (; i + 8 <= l; i += 8)
+        append_bits(t, 52,
+                    (uint64_t)kanji_value(s[i], s[i + 1]) << 39 |
+                        (uint64_t)kanji_value(s[i + 2], s[i + 3]) << 26 |
+                        (uint64_t)kanji_value(s[i + 4], s[i + 5]) << 13 |
+                        kanji_value(s[i + 6], s[i + 7]));
+
+    for (; i + 2 <= l; i += 2)
+        append_bits(t, 13, kanji_value(s[i], s[i + 1]));
+}
+
+/**
+ * Encode one segment with its mode indicator and character count indicator.
+ *
+ * @param t bit stream.
+ * @param s input string.
+ * @param g segment.
+ * @param v version.
+ */
+static void encode_segment(bit_stream_t *t, const uint8_t s[], segment_t g,
+                           int v) {
+    const uint8_t *p = &s[g.offset];
+
     // mode indicator
-    uint32_t b = 0x4;
+    append_bits(t, MODE_INDICATOR_LEN, 1 << g.mode);
 
     // character count indicator
-    b <<= c;
-    b |= l;
+    append_bits(t, chrcnt_indicator_len(v, g.mode),
+                g.mode == ENCODING_MODE_KANJI ? g.length / 2 : g.length);
+
+    // encoded data
+    switch (g.mode) {
+    case ENCODING_MODE_NUMERIC:
+        encode_numeric_mode(t, g.length, p);
+        break;
 
-    if (c == 8) {
-        d[0] = b >> 4;
-        d[1] = b << 4;
+    case ENCODING_MODE_ALPHANUMERIC:
+        encode_alphanumeric_mode(t, g.length, p);
+        break;
+
+    case ENCODING_MODE_BYTE:
+        encode_byte_mode(t, g.length, p);
+        break;
 
-    } else {
-        d[0] = b >> 12;
-        d[1] = b >> 4;
-        d[2] = b << 4;
+    case ENCODING_MODE_KANJI:
+        encode_kanji_mode(t, g.length, p);
+        break;
     }
+}
 
-    // encoded data
-    for (int i = 0; i < l; i++) {
-        d[c / 8 + i] |= s[i] >> 4;
-        d[c / 8 + i + 1] = s[i] << 4;
+/**
+ * Returns the number of bits of a segment of the mode and length.
+ *
+ * @param v version.
+ * @param m encoding mode.
+ * @param l segment length in bytes.
+ * @return number of bits.
+ */
+static int segment_bit_length(int v, encoding_mode_t m, int l) {
+    int n = MODE_INDICATOR_LEN + chrcnt_indicator_len(v, m);
+
+    switch (m) {
+    case ENCODING_MODE_NUMERIC:
+        return n + l / 3 * 10 + (l % 3 == 0 ? 0 : l % 3 * 3 + 1);
+
+    case ENCODING_MODE_ALPHANUMERIC:
+        return n + l / 2 * 11 + l % 2 * 6;
+
+    case ENCODING_MODE_BYTE:
+        return n + l * 8;
+
+    case ENCODING_MODE_KANJI:
+        return n + l / 2 * 13;
+
+    default:
+        return -1;
     }
+}
 
-    // terminator, padding bits and pad codewords
-    terminate_data_codewords(n, d, c / 8 + l, 4, s[l - 1]);
+/**
+ * Set the states of the segmentation before the first character, where only
+ * the start state has a cost.
+ *
+ * @param c bit costs of the states after the current character and the next
+ * two, indexed by position modulo 3.
+ */
+static void init_states(int c[3][NUM_SEGMENT_STATES + 1]) {
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j <= NUM_SEGMENT_STATES; j++)
+            c[i][j] = SEGMENT_COST_INFINITY;
+
+    c[0][SEGMENT_STATE_START] = 0;
 }
 
 /**
- * Encode in kanji mode.
+ * Extend every state after a character by the next character in each mode
+ * that can encode it, keeping the cheapest way to reach each state, and clear
+ * the states after the character for reuse.
  *
- * @param n data codewords length.
- * @param d data codewords.
+ * @param c bit costs of the states, indexed by position modulo 3.
+ * @param f previous state of each state after each character.
+ * @param i position of the next character.
  * @param l input string length.
- * @param s input string.
- * @param c character count indicator length.
+ * @param x class map of the input string.
+ * @param v version.
  */
-static void encode_kanji_mode(int n, uint8_t d[], int l, const uint8_t s[],
-                              int c) {
-    // mode indicator
-    uint32_t b = 0x8;
-    int k = MODE_INDICATOR_LEN;
+static void advance_states(int c[3][NUM_SEGMENT_STATES + 1],
+                           uint8_t(*f)[NUM_SEGMENT_STATES], int i, int l,
+                           const uint8_t x[], int v) {
+    int *p = c[i % 3];
+
+    for (int j = 0; j <= NUM_SEGMENT_STATES; j++) {
+        if (p[j] == SEGMENT_COST_INFINITY)
+            continue;
+
+        for (encoding_mode_t m = 0; m < 4; m++) {
+            // the last byte of a part of a longer string may start a kanji
+            // character, which would end after the part
+            if (!(x[i] & CHAR_CLASS(m)) ||
+                (m == ENCODING_MODE_KANJI && i + 1 == l))
+                continue;
+
+            int k = segment_start_states[m];
+            int z = p[j];
+
+            // continue the segment, or start a new one
+            if (j != SEGMENT_STATE_START && segment_state_modes[j] == m)
+                k = j;
+            else
+                z += MODE_INDICATOR_LEN + chrcnt_indicator_len(v, m);
+
+            int n = segment_state_nexts[k];
+            int d = m == ENCODING_MODE_KANJI ? 2 : 1;
+            int *q = c[(i + d) % 3];
+
+            z += segment_state_bits[k];
+
+            if (z < q[n]) {
+                q[n] = z;
+                f[i + d][n] = j;
+            }
+        }
+
+        p[j] = SEGMENT_COST_INFINITY;
+    }
+}
 
-    // character count indicator
-    append_bits(k, b, c, l);
+/**
+ * Returns the lowest bit cost of the states after a character.
+ *
+ * @param p bit costs of the states.
+ * @return bit cost, or SEGMENT_COST_INFINITY if no state is reached.
+ */
+static int min_state_cost(const int p[]) {
+    int z = SEGMENT_COST_INFINITY;
+
+    for (int j = 0; j <= NUM_SEGMENT_STATES; j++)
+        if (p[j] < z)
+            z = p[j];
+
+    return z;
+}
+
+/**
+ * Split the input string into segments with the fewest total bits for the
+ * character count indicator lengths of the version. Each character is encoded
+ * in one of the modes that can encode it, and the segmentation is found by
+ * dynamic programming over the input string, where a state is the mode of the
+ * last segment and the number of characters in its last incomplete group.
+ *
+ * @param l input string length, at most ENCODE_MAX_DATA_LENGTH.
+ * @param x class map of the input string from classify_data(), which may be
+ * part of the class map of a longer string.
+ * @param v version.
+ * @param g segments, room for \a l segments or one if \a l is 0, with offsets
+ * from the start of \a x.
+ * @param b work space.
+ * @return number of segments.
+ */
+int segment_data(int l, const uint8_t x[], int v, segment_t g[],
+                 segment_buffers_t *b) {
+    int c[3][NUM_SEGMENT_STATES + 1];
+    uint8_t(*f)[NUM_SEGMENT_STATES] = b->states;
+
+    if (l == 0) {
+        g[0] = (segment_t){ENCODING_MODE_NUMERIC, 0, 0};
+        return 1;
+    }
+
+    init_states(c);
+
+    for (int i = 0; i < l; i++)
+        advance_states(c, f, i, l, x, v);
 
-    // encoded data
     int j = 0;
 
-    for (int i = 1; i < l; i += 2) {
-        append_bits(
-            k, b, 13,
-            ((s[i - 1] - ((s[i - 1] & 0xC0) | 0x01) - (s[i] < 0x40)) * 0xC0 +
-             (s[i] - 0x40)));
+    for (int k = 1; k < NUM_SEGMENT_STATES; k++)
+        if (c[l % 3][k] < c[l % 3][j])
+            j = k;
+
+    // trace the states back, ending a segment at each change of mode
+    int n = 0;
+    int e = l;
+
+    for (int i = l; i > 0;) {
+        int k = f[i][j];
+
+        i -= segment_state_modes[j] == ENCODING_MODE_KANJI ? 2 : 1;
+
+        if (k == SEGMENT_STATE_START ||
+            segment_state_modes[k] != segment_state_modes[j]) {
+            g[n++] = (segment_t){segment_state_modes[j], i, e - i};
+            e = i;
+        }
 
-        do {
-            k -= 8;
-            d[j++] = b >> k;
-        } while (k >= 8);
+        j = k;
     }
 
-    // terminator, padding bits and pad codewords
-    terminate_data_codewords(n, d, j, k, b);
+    // reverse, and split the segments longer than the character count
+    // indicator allows
+    for (int i = 0; i < n / 2; i++) {
+        segment_t t = g[i];
+        g[i] = g[n - 1 - i];
+        g[n - 1 - i] = t;
+    }
+
+    for (int i = 0; i < n; i++) {
+        encoding_mode_t m = g[i].mode;
+        int k = ((1 << chrcnt_indicator_len(v, m)) - 1) *
+                (m == ENCODING_MODE_KANJI ? 2 : 1);
+
+        if (g[i].length <= k)
+            continue;
+
+        for (int h = n; h > i + 1; h--)
+            g[h] = g[h - 1];
+
+        g[i + 1] = (segment_t){m, g[i].offset + k, g[i].length - k};
+        g[i].length = k;
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Returns the number of bits of the segments, excluding the terminator.
+ *
+ * @param k number of segments.
+ * @param g segments.
+ * @param v version.
+ * @return number of bits.
+ */
+int segments_bit_length(int k, const segment_t g[], int v) {
+    int n = 0;
+
+    for (int i = 0; i < k; i++)
+        n += segment_bit_length(v, g[i].mode, g[i].length);
+
+    return n;
+}
+
+/**
+ * Returns the length of the longest prefix of the input string whose segments
+ * fit in a number of bits, for the character count indicator lengths of the
+ * version. The costs of every prefix come from one pass of the dynamic
+ * programming of segment_data(). They do not grow with the length, since a
+ * prefix that ends in the middle of a kanji character costs more than one
+ * that ends after it, so each prefix is checked. A prefix only ends between
+ * two characters, taking kanji characters from the start of the string, and
+ * no segment of a symbol is long enough to be split by segment_data().
+ *
+ * @param l input string length, at most ENCODE_MAX_DATA_LENGTH.
+ * @param x class map of the input string.
+ * @param v version.
+ * @param n number of bits.
+ * @param b work space.
+ * @return prefix length.
+ */
+int max_segmented_length(int l, const uint8_t x[], int v, int n,
+                         segment_buffers_t *b) {
+    int c[3][NUM_SEGMENT_STATES + 1];
+    int r = 0;
+
+    init_states(c);
+
+    for (int i = 0, w = 0; i <= l; i++) {
+        if (i == w && i > 0 && min_state_cost(c[i % 3]) <= n)
+            r = i;
+
+        // every longer prefix is reached from the states after this
+        // character or the next one, and costs only grow along the way
+        if (i == l || (min_state_cost(c[i % 3]) > n &&
+                       min_state_cost(c[(i + 1) % 3]) > n))
+            break;
+
+        if (i == w)
+            w += x[i] & CHAR_CLASS(ENCODING_MODE_KANJI) ? 2 : 1;
+
+        advance_states(c, b->states, i, l, x, v);
+    }
+
+    return r;
+}
+
+/**
+ * Classify each byte of the input string by the encoding modes that can encode
+ * it, 16 or 32 bytes at a time where SIMD is available.
+ *
+ * @param l input string length.
+ * @param s input string.
+ * @param c class map of the input string, one byte per byte.
+ */
+void classify_data(int l, const uint8_t s[], uint8_t c[]) {
+    classify(l, s, 0, l, c);
 }
 
 /**
@@ -324,28 +897,34 @@ static void encode_kanji_mode(int n, uint8_t d[], int l, const uint8_t s[],
  * @return encoding mode.
  */
 encoding_mode_t min_encoding_mode(int l, const uint8_t s[]) {
-    int i = 0;
+    uint8_t c[CLASSIFY_CHUNK_LEN];
+    uint8_t a = CHAR_CLASS(ENCODING_MODE_NUMERIC) |
+                CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC);
+    uint8_t k = l % 2 == 0 ? CHAR_CLASS(ENCODING_MODE_KANJI) : 0;
 
-    while (i < l && '0' <= s[i] && s[i] <= '9')
-        i++;
+    for (int i = 0; i < l && (a | k) != 0; i += CLASSIFY_CHUNK_LEN) {
+        int n = l - i < CLASSIFY_CHUNK_LEN ? l - i : CLASSIFY_CHUNK_LEN;
 
-    if (i == l)
-        return ENCODING_MODE_NUMERIC;
+        classify(l, s, i, n, c);
 
-    while (i < l && s[i] < 0x80 && alphanumerics[s[i]] >= 0)
-        i++;
+        for (int j = 0; j < n; j++)
+            a &= c[j];
 
-    if (i == l)
-        return ENCODING_MODE_ALPHANUMERIC;
+        // kanji characters start at even bytes
+        for (int j = 0; j < n; j += 2)
+            k &= c[j];
+    }
 
-    if (i != 0 || l % 2 != 0)
-        return ENCODING_MODE_BYTE;
+    if (a & CHAR_CLASS(ENCODING_MODE_NUMERIC))
+        return ENCODING_MODE_NUMERIC;
+
+    if (a & CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC))
+        return ENCODING_MODE_ALPHANUMERIC;
 
-    for (int i = 0; i < l; i += 2)
-        if (!is_sjis_kanji(s[i], s[i + 1]))
-            return ENCODING_MODE_BYTE;
+    if (k != 0)
+        return ENCODING_MODE_KANJI;
 
-    return ENCODING_MODE_KANJI;
+    return ENCODING_MODE_BYTE;
 }
 
 /**
@@ -379,6 +958,101 @@ int num_data_codewords(int v, error_correction_level_t e) {
     return num_dat_codewords[v][e];
 }
 
+/**
+ * The smallest version for data split into segments. The input string is
+ * segmented for the character count indicator lengths of each range of
+ * versions, and the smallest version of the range that can hold the segments
+ * is returned.
+ *
+ * @param l input string length.
+ * @param x class map of the input string.
+ * @param e error correction level.
+ * @param k number of segments.
+ * @param g segments, room for \a l segments or one if \a l is 0.
+ * @param b work space.
+ * @return version, or -1 if the data is too long.
+ */
+int min_segmented_version(int l, const uint8_t x[], error_correction_level_t e,
+                          int *k, segment_t g[], segment_buffers_t *b) {
+    return min_appended_version(l, x, e, NULL, k, g, b);
+}
+
+/**
+ * The smallest version for data split into segments after the structured
+ * append header of a symbol.
+ *
+ * @param l input string length.
+ * @param x class map of the input string.
+ * @param e error correction level.
+ * @param a structured append, or NULL for a symbol on its own.
+ * @param k number of segments.
+ * @param g segments, room for \a l segments or one if \a l is 0.
+ * @param b work space.
+ * @return version, or -1 if the data is too long.
+ */
+int min_appended_version(int l, const uint8_t x[], error_correction_level_t e,
+                         const structured_append_t *a, int *k, segment_t g[],
+                         segment_buffers_t *b) {
+    const int ranges[] = {0, 9, 26, 40};
+
+    for (int r = 0; r < 3; r++) {
+        *k = segment_data(l, x, ranges[r], g, b);
+
+        int n = segments_bit_length(*k, g, ranges[r]) +
+                (a != NULL ? STRUCTURED_APPEND_HEADER_LEN : 0);
+
+        for (int v = ranges[r]; v < ranges[r + 1]; v++)
+            if (n <= num_dat_codewords[v][e] * 8)
+                return v;
+    }
+
+    return -1;
+}
+
+/**
+ * Encode the segments.
+ *
+ * @param n data codewords length.
+ * @param d data codewords.
+ * @param s input string.
+ * @param k number of segments.
+ * @param g segments.
+ * @param v version.
+ */
+void encode_segments(int n, uint8_t d[], const uint8_t s[], int k,
+                     const segment_t g[], int v) {
+    encode_appended_segments(n, d, NULL, s, k, g, v);
+}
+
+/**
+ * Encode the segments after the structured append header of a symbol, which
+ * holds the symbol position and the parity of the whole input string.
+ *
+ * @param n data codewords length.
+ * @param d data codewords.
+ * @param a structured append, or NULL for a symbol on its own.
+ * @param s input string.
+ * @param k number of segments.
+ * @param g segments.
+ * @param v version.
+ */
+void encode_appended_segments(int n, uint8_t d[], const structured_append_t *a,
+                              const uint8_t s[], int k, const segment_t g[],
+                              int v) {
+    bit_stream_t t = {d, 0, 0, 0};
+
+    if (a != NULL)
+        append_bits(&t, STRUCTURED_APPEND_HEADER_LEN,
+                    STRUCTURED_APPEND_MODE_INDICATOR << 16 | a->index << 12 |
+                        (a->total - 1) << 8 | a->parity);
+
+    for (int i = 0; i < k; i++)
+        encode_segment(&t, s, g[i], v);
+
+    // terminator, padding bits and pad codewords
+    terminate_data_codewords(n, &t);
+}
+
 /**
  * Encode using the selected mode.
  *
@@ -391,26 +1065,7 @@ int num_data_codewords(int v, error_correction_level_t e) {
  */
 void encode(int n, uint8_t d[], int l, const uint8_t s[], int v,
             encoding_mode_t m) {
-    for (int i = 0; i < n; i++)
-        d[i] = 0;
-
-    int c = chrcnt_indicator_len(v, m);
-
-    switch (m) {
-    case ENCODING_MODE_NUMERIC:
-        encode_numeric_mode(n, d, l, s, c);
-        break;
+    segment_t g = {m, 0, l};
 
-    case ENCODING_MODE_ALPHANUMERIC:
-        encode_alphanumeric_mode(n, d, l, s, c);
-        break;
-
-    case ENCODING_MODE_BYTE:
-        encode_byte_mode(n, d, l, s, c);
-        break;
-
-    case ENCODING_MODE_KANJI:
-        encode_kanji_mode(n, d, l, s, c);
-        break;
-    }
+    encode_segments(n, d, s, 1, &g, v);
 }
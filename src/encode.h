@@ -30,9 +30,59 @@
 #include <stdint.h>
 #include "typedefs.h"
 
+// class bit of each encoding mode in the class map of classify_data(), set if
+// the byte can be encoded in the mode, or for kanji, if the byte and the next
+// one are a kanji character
+#define CHAR_CLASS(m) (1 << (m))
+
+// mode indicator, symbol position and parity data
+#define STRUCTURED_APPEND_HEADER_LEN 20
+
+#define ENCODE_MAX_DATA_LENGTH 7089
+
+// symbols of a structured append, and the longest input string split into them
+#define ENCODE_MAX_SYMBOLS 16
+#define ENCODE_MAX_APPENDED_LENGTH (ENCODE_MAX_DATA_LENGTH * ENCODE_MAX_SYMBOLS)
+
+// encoding mode and number of characters in the last incomplete group
+#define NUM_SEGMENT_STATES 7
+
+typedef struct segment {
+    encoding_mode_t mode;
+    int offset;
+    int length;
+} segment_t;
+
+// work space of segment_data(), the class map of the whole input string, built
+// once and shared by every part and version tried, and the previous state of
+// each state after each character
+typedef struct segment_buffers {
+    uint8_t classes[ENCODE_MAX_APPENDED_LENGTH];
+    uint8_t states[ENCODE_MAX_DATA_LENGTH + 1][NUM_SEGMENT_STATES];
+} segment_buffers_t;
+
+extern void classify_data(int l, const uint8_t s[], uint8_t c[]);
 extern encoding_mode_t min_encoding_mode(int l, const uint8_t s[]);
 extern int min_version(int l, error_correction_level_t e, encoding_mode_t m);
+extern int segment_data(int l, const uint8_t x[], int v, segment_t g[],
+                        segment_buffers_t *b);
+extern int segments_bit_length(int k, const segment_t g[], int v);
+extern int max_segmented_length(int l, const uint8_t x[], int v, int n,
+                                segment_buffers_t *b);
+extern int min_segmented_version(int l, const uint8_t x[],
+                                 error_correction_level_t e, int *k,
+                                 segment_t g[], segment_buffers_t *b);
+extern int min_appended_version(int l, const uint8_t x[],
+                                error_correction_level_t e,
+                                const structured_append_t *a, int *k,
+                                segment_t g[], segment_buffers_t *b);
 extern int num_data_codewords(int v, error_correction_level_t e);
+extern void encode_segments(int n, uint8_t d[], const uint8_t s[], int k,
+                            const segment_t g[], int v);
+extern void encode_appended_segments(int n, uint8_t d[],
+                                     const structured_append_t *a,
+                                     const uint8_t s[], int k,
+                                     const segment_t g[], int v);
 extern void encode(int n, uint8_t d[], int l, const uint8_t s[], int v,
                    encoding_mode_t m);
 
@@ -24,47 +24,16 @@
  * @file gf256.c
  * @brief gf256 implementation
  */
+#include <stddef.h>
 #include "gf256.h"
+#include "gf256_tables.h"
 
-static const uint8_t antilogs[] = {
-    1,   2,   4,   8,   16,  32,  64,  128, 29,  58,  116, 232, 205, 135, 19,
-    38,  76,  152, 45,  90,  180, 117, 234, 201, 143, 3,   6,   12,  24,  48,
-    96,  192, 157, 39,  78,  156, 37,  74,  148, 53,  106, 212, 181, 119, 238,
-    193, 159, 35,  70,  140, 5,   10,  20,  40,  80,  160, 93,  186, 105, 210,
-    185, 111, 222, 161, 95,  190, 97,  194, 153, 47,  94,  188, 101, 202, 137,
-    15,  30,  60,  120, 240, 253, 231, 211, 187, 107, 214, 177, 127, 254, 225,
-    223, 163, 91,  182, 113, 226, 217, 175, 67,  134, 17,  34,  68,  136, 13,
-    26,  52,  104, 208, 189, 103, 206, 129, 31,  62,  124, 248, 237, 199, 147,
-    59,  118, 236, 197, 151, 51,  102, 204, 133, 23,  46,  92,  184, 109, 218,
-    169, 79,  158, 33,  66,  132, 21,  42,  84,  168, 77,  154, 41,  82,  164,
-    85,  170, 73,  146, 57,  114, 228, 213, 183, 115, 230, 209, 191, 99,  198,
-    145, 63,  126, 252, 229, 215, 179, 123, 246, 241, 255, 227, 219, 171, 75,
-    150, 49,  98,  196, 149, 55,  110, 220, 165, 87,  174, 65,  130, 25,  50,
-    100, 200, 141, 7,   14,  28,  56,  112, 224, 221, 167, 83,  166, 81,  162,
-    89,  178, 121, 242, 249, 239, 195, 155, 43,  86,  172, 69,  138, 9,   18,
-    36,  72,  144, 61,  122, 244, 245, 247, 243, 251, 235, 203, 139, 11,  22,
-    44,  88,  176, 125, 250, 233, 207, 131, 27,  54,  108, 216, 173, 71,  142,
-    1};
-
-static const uint8_t logs[] = {
-    0,   0,   1,   25,  2,   50,  26,  198, 3,   223, 51,  238, 27,  104, 199,
-    75,  4,   100, 224, 14,  52,  141, 239, 129, 28,  193, 105, 248, 200, 8,
-    76,  113, 5,   138, 101, 47,  225, 36,  15,  33,  53,  147, 142, 218, 240,
-    18,  130, 69,  29,  181, 194, 125, 106, 39,  249, 185, 201, 154, 9,   120,
-    77,  228, 114, 166, 6,   191, 139, 98,  102, 221, 48,  253, 226, 152, 37,
-    179, 16,  145, 34,  136, 54,  208, 148, 206, 143, 150, 219, 189, 241, 210,
-    19,  92,  131, 56,  70,  64,  30,  66,  182, 163, 195, 72,  126, 110, 107,
-    58,  40,  84,  250, 133, 186, 61,  202, 94,  155, 159, 10,  21,  121, 43,
-    78,  212, 229, 172, 115, 243, 167, 87,  7,   112, 192, 247, 140, 128, 99,
-    13,  103, 74,  222, 237, 49,  197, 254, 24,  227, 165, 153, 119, 38,  184,
-    180, 124, 17,  68,  146, 217, 35,  32,  137, 46,  55,  63,  209, 91,  149,
-    188, 207, 205, 144, 135, 151, 178, 220, 252, 190, 97,  242, 86,  211, 171,
-    20,  42,  93,  158, 132, 60,  57,  83,  71,  109, 65,  162, 31,  45,  67,
-    216, 183, 123, 164, 118, 196, 23,  73,  236, 127, 12,  111, 246, 108, 161,
-    59,  82,  41,  157, 85,  170, 251, 96,  134, 177, 187, 204, 62,  90,  203,
-    89,  95,  176, 156, 169, 160, 81,  11,  245, 22,  235, 122, 117, 44,  215,
-    79,  174, 213, 233, 230, 231, 173, 232, 116, 214, 244, 234, 168, 80,  88,
-    175};
+#if defined(__x86_64__) || defined(__i386__)
+#define GF256_X86
+#include <immintrin.h>
+#endif
+
+#define SIMD_MAX_GENPOLY_LENGTH 32
 
 /**
  * Create a generator polynomial.
@@ -80,15 +49,225 @@ void gf256_genpoly(int n, uint8_t g[]) {
         uint8_t f[] = {i, 0};
 
         for (int j = i; j > 0; j--)
-            g[j] = logs[antilogs[(g[j] + f[0]) % 255] ^
-                        antilogs[(g[j - 1] + f[1]) % 255]];
+            g[j] = logs[antilogs[g[j] + f[0]] ^ antilogs[g[j - 1] + f[1]]];
 
-        g[0] = (g[0] + f[0]) % 255;
+        g[0] = logs[antilogs[g[0] + f[0]]];
     }
 }
 
 /**
- * Divide the message polynomial by the generator polynomial.
+ * Returns the generator polynomial of a number of error correction codewords
+ * per block, generated at build time for every number used by a QR code.
+ *
+ * @param n generation polynomial length.
+ * @return generation polynomial, or NULL if no QR code uses \a n.
+ */
+const uint8_t *gf256_genpoly_for(int n) {
+    return n >= 0 && n <= GENPOLY_MAX_LENGTH ? genpolys[n] : NULL;
+}
+
+/**
+ * Convert the generator polynomial from exponents to the values by which the
+ * feedback is multiplied in each stage of the division.
+ *
+ * @param n generation polynomial length.
+ * @param g generation polynomial.
+ * @param c coefficients.
+ */
+static void feedback_coefficients(int n, const uint8_t g[], uint8_t c[]) {
+    for (int i = 0; i < n; i++)
+        c[i] = antilogs[g[n - 1 - i]];
+}
+
+/**
+ * Divide the message polynomial by the generator polynomial with a shift
+ * register, multiplying with the split-nibble tables one byte at a time.
+ *
+ * @param r the remainder of \a m divided by \a g.
+ * @param l message polynomial length.
+ * @param m message polynomial.
+ * @param n generation polynomial length.
+ * @param c coefficients.
+ */
+static void divpoly_table(uint8_t r[], int l, const uint8_t m[], int n,
+                          const uint8_t c[]) {
+    for (int i = 0; i < n; i++)
+        r[i] = 0;
+
+    for (int i = 0; i < l; i++) {
+        const uint8_t *t = mul_nibbles[m[i] ^ r[0]];
+
+        for (int j = 0; j < n - 1; j++)
+            r[j] = r[j + 1] ^ t[c[j] & 0x0F] ^ t[16 + (c[j] >> 4)];
+
+        r[n - 1] = t[c[n - 1] & 0x0F] ^ t[16 + (c[n - 1] >> 4)];
+    }
+}
+
+#ifdef GF256_X86
+
+/**
+ * Divide the message polynomial by the generator polynomial with a shift
+ * register of two SSE registers, multiplying all stages at once with PSHUFB.
+ *
+ * @param r the remainder of \a m divided by \a g.
+ * @param l message polynomial length.
+ * @param m message polynomial.
+ * @param n generation polynomial length, up to 32.
+ * @param c coefficients.
+ */
+__attribute__((target("ssse3"))) static void
+divpoly_ssse3(uint8_t r[], int l, const uint8_t m[], int n, const uint8_t c[]) {
+    uint8_t b[SIMD_MAX_GENPOLY_LENGTH] = {0};
+
+    for (int i = 0; i < n; i++)
+        b[i] = c[i];
+
+    const __m128i k = _mm_set1_epi8(0x0F);
+    const __m128i c0 = _mm_loadu_si128((const __m128i *)&b[0]);
+    const __m128i c1 = _mm_loadu_si128((const __m128i *)&b[16]);
+    const __m128i c0l = _mm_and_si128(c0, k);
+    const __m128i c0h = _mm_and_si128(_mm_srli_epi64(c0, 4), k);
+    const __m128i c1l = _mm_and_si128(c1, k);
+    const __m128i c1h = _mm_and_si128(_mm_srli_epi64(c1, 4), k);
+
+    __m128i r0 = _mm_setzero_si128();
+    __m128i r1 = _mm_setzero_si128();
+
+    for (int i = 0; i < l; i++) {
+        uint8_t fb = m[i] ^ (uint8_t)_mm_cvtsi128_si32(r0);
+        const uint8_t *t = mul_nibbles[fb];
+        __m128i tl = _mm_loadu_si128((const __m128i *)&t[0]);
+        __m128i th = _mm_loadu_si128((const __m128i *)&t[16]);
+
+        r0 = _mm_alignr_epi8(r1, r0, 1);
+        r1 = _mm_srli_si128(r1, 1);
+
+        r0 = _mm_xor_si128(r0, _mm_xor_si128(_mm_shuffle_epi8(tl, c0l),
+                                             _mm_shuffle_epi8(th, c0h)));
+        r1 = _mm_xor_si128(r1, _mm_xor_si128(_mm_shuffle_epi8(tl, c1l),
+                                             _mm_shuffle_epi8(th, c1h)));
+    }
+
+    _mm_storeu_si128((__m128i *)&b[0], r0);
+    _mm_storeu_si128((__m128i *)&b[16], r1);
+
+    for (int i = 0; i < n; i++)
+        r[i] = b[i];
+}
+
+/**
+ * Divide the message polynomial by the generator polynomial with a shift
+ * register of one AVX2 register, multiplying all stages at once with VPSHUFB.
+ *
+ * @param r the remainder of \a m divided by \a g.
+ * @param l message polynomial length.
+ * @param m message polynomial.
+ * @param n generation polynomial length, up to 32.
+ * @param c coefficients.
+ */
+__attribute__((target("avx2"))) static void
+divpoly_avx2(uint8_t r[], int l, const uint8_t m[], int n, const uint8_t c[]) {
+    uint8_t b[SIMD_MAX_GENPOLY_LENGTH] = {0};
+
+    for (int i = 0; i < n; i++)
+        b[i] = c[i];
+
+    const __m256i k = _mm256_set1_epi8(0x0F);
+    const __m256i cv = _mm256_loadu_si256((const __m256i *)b);
+    const __m256i cl = _mm256_and_si256(cv, k);
+    const __m256i ch = _mm256_and_si256(_mm256_srli_epi64(cv, 4), k);
+
+    __m256i rv = _mm256_setzero_si256();
+
+    for (int i = 0; i < l; i++) {
+        uint8_t fb = m[i] ^ (uint8_t)_mm256_cvtsi256_si32(rv);
+        const uint8_t *t = mul_nibbles[fb];
+        __m256i tl = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)&t[0]));
+        __m256i th = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)&t[16]));
+
+        // shift by one byte across the two 128-bit lanes
+        rv = _mm256_alignr_epi8(_mm256_permute2x128_si256(rv, rv, 0x81), rv,
+                                1);
+
+        rv = _mm256_xor_si256(
+            rv, _mm256_xor_si256(_mm256_shuffle_epi8(tl, cl),
+                                 _mm256_shuffle_epi8(th, ch)));
+    }
+
+    _mm256_storeu_si256((__m256i *)b, rv);
+
+    for (int i = 0; i < n; i++)
+        r[i] = b[i];
+}
+
+#endif /* GF256_X86 */
+
+/**
+ * Returns true if the kernel can divide by a generator polynomial of the length
+ * on this CPU.
+ *
+ * @param k kernel.
+ * @param n generation polynomial length.
+ * @return true if the kernel is supported and false otherwise.
+ */
+bool gf256_kernel_supported(gf256_kernel_t k, int n) {
+    switch (k) {
+    case GF256_KERNEL_TABLE:
+        return true;
+
+#ifdef GF256_X86
+    case GF256_KERNEL_SSSE3:
+        return n <= SIMD_MAX_GENPOLY_LENGTH && __builtin_cpu_supports("ssse3");
+
+    case GF256_KERNEL_AVX2:
+        return n <= SIMD_MAX_GENPOLY_LENGTH && __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * Divide the message polynomial by the generator polynomial with the specified
+ * kernel, which must be supported.
+ *
+ * @param k kernel.
+ * @param r the remainder of \a m divided by \a g.
+ * @param l message polynomial length.
+ * @param m message polynomial.
+ * @param n generation polynomial length.
+ * @param g generation polynomial.
+ */
+void gf256_divpoly_kernel(gf256_kernel_t k, uint8_t r[], int l,
+                          const uint8_t m[], int n, const uint8_t g[]) {
+    uint8_t c[n];
+
+    feedback_coefficients(n, g, c);
+
+    switch (k) {
+#ifdef GF256_X86
+    case GF256_KERNEL_SSSE3:
+        divpoly_ssse3(r, l, m, n, c);
+        break;
+
+    case GF256_KERNEL_AVX2:
+        divpoly_avx2(r, l, m, n, c);
+        break;
+#endif
+
+    default:
+        divpoly_table(r, l, m, n, c);
+        break;
+    }
+}
+
+/**
+ * Divide the message polynomial by the generator polynomial with the fastest
+ * kernel supported on this CPU.
  *
  * @param r the remainder of \a m divided by \a g.
  * @param l message polynomial length.
@@ -98,19 +277,91 @@ void gf256_genpoly(int n, uint8_t g[]) {
  */
 void gf256_divpoly(uint8_t r[], int l, const uint8_t m[], int n,
                    const uint8_t g[]) {
-    uint8_t t[l + n];
+    gf256_kernel_t k = GF256_KERNEL_TABLE;
 
-    for (int i = 0; i < l; i++)
-        t[i] = m[i];
+    if (gf256_kernel_supported(GF256_KERNEL_AVX2, n))
+        k = GF256_KERNEL_AVX2;
 
-    for (int i = l; i < l + n; i++)
-        t[i] = 0;
+    else if (gf256_kernel_supported(GF256_KERNEL_SSSE3, n))
+        k = GF256_KERNEL_SSSE3;
 
-    for (int i = 0; i < l; i++)
-        if (t[i] != 0)
-            for (int j = 0; j < n; j++)
-                t[i + j + 1] ^= antilogs[(g[n - 1 - j] + logs[t[i]]) % 255];
+    gf256_divpoly_kernel(k, r, l, m, n, g);
+}
+
+/**
+ * Compute the remainder contributed by a unit codeword at each message
+ * position. Row d of \a t holds x^(n+d) mod g, the remainder of a message whose
+ * only nonzero codeword is a 1 followed by d zero codewords.
+ *
+ * @param l number of rows, the longest message polynomial length.
+ * @param n generation polynomial length.
+ * @param g generation polynomial.
+ * @param t position remainders, \a l rows of \a n codewords.
+ */
+void gf256_position_remainders(int l, int n, const uint8_t g[], uint8_t t[]) {
+    uint8_t c[n];
+
+    feedback_coefficients(n, g, c);
 
     for (int i = 0; i < n; i++)
-        r[i] = t[l + i];
+        t[i] = c[i];
+
+    for (int d = 1; d < l; d++) {
+        const uint8_t *p = &t[(d - 1) * n];
+        const uint8_t *u = mul_nibbles[p[0]];
+        uint8_t *r = &t[d * n];
+
+        for (int j = 0; j < n - 1; j++)
+            r[j] = p[j + 1] ^ u[c[j] & 0x0F] ^ u[16 + (c[j] >> 4)];
+
+        r[n - 1] = u[c[n - 1] & 0x0F] ^ u[16 + (c[n - 1] >> 4)];
+    }
+}
+
+/**
+ * Update the remainder after a message codeword changed. The division is
+ * linear, so the remainder of the new message is the old one plus the change
+ * times the remainder contributed by its position.
+ *
+ * @param r the remainder to update.
+ * @param n generation polynomial length.
+ * @param t position remainder of the changed codeword, from
+ *          gf256_position_remainders().
+ * @param d the old codeword XOR the new one.
+ */
+void gf256_update_remainder(uint8_t r[], int n, const uint8_t t[], uint8_t d) {
+    const uint8_t *u = mul_nibbles[d];
+
+    for (int i = 0; i < n; i++)
+        r[i] ^= u[t[i] & 0x0F] ^ u[16 + (t[i] >> 4)];
+}
+
+/**
+ * Evaluate the codeword polynomial at the roots of the generator polynomial,
+ * alpha^0 to alpha^(n - 1), by Horner's method. The syndromes are all 0 if
+ * and only if the codeword polynomial is divisible by the generator
+ * polynomial, that is, if the codewords have no errors.
+ *
+ * @param s syndromes.
+ * @param l codeword polynomial length.
+ * @param c codeword polynomial, the data codewords followed by the error
+ *          correction codewords.
+ * @param n generation polynomial length.
+ * @return true if every syndrome is 0 and false otherwise.
+ */
+bool gf256_syndromes(uint8_t s[], int l, const uint8_t c[], int n) {
+    uint8_t z = 0;
+
+    for (int j = 0; j < n; j++) {
+        const uint8_t *t = mul_nibbles[antilogs[j]];
+        uint8_t x = 0;
+
+        for (int i = 0; i < l; i++)
+            x = t[x & 0x0F] ^ t[16 + (x >> 4)] ^ c[i];
+
+        s[j] = x;
+        z |= x;
+    }
+
+    return z == 0;
 }
@@ -27,10 +27,26 @@
 #ifndef GF256_H
 #define GF256_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+typedef enum {
+    GF256_KERNEL_TABLE,
+    GF256_KERNEL_SSSE3,
+    GF256_KERNEL_AVX2
+} gf256_kernel_t;
+
 extern void gf256_genpoly(int n, uint8_t g[]);
+extern const uint8_t *gf256_genpoly_for(int n);
+extern bool gf256_kernel_supported(gf256_kernel_t k, int n);
+extern void gf256_divpoly_kernel(gf256_kernel_t k, uint8_t r[], int l,
+                                 const uint8_t m[], int n, const uint8_t g[]);
 extern void gf256_divpoly(uint8_t r[], int l, const uint8_t m[], int n,
                           const uint8_t g[]);
+extern void gf256_position_remainders(int l, int n, const uint8_t g[],
+                                      uint8_t t[]);
+extern void gf256_update_remainder(uint8_t r[], int n, const uint8_t t[],
+                                   uint8_t d);
+extern bool gf256_syndromes(uint8_t s[], int l, const uint8_t c[], int n);
 
 #endif /* GF256_H */
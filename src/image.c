@@ -25,8 +25,14 @@
  * @brief image implementation
  */
 #include <stdint.h>
+#include <string.h>
 #include "image.h"
 
+#define IMAGE_ROW_WORDS                                                        \
+    ((IMAGE_MAX_WIDTH + BITMATRIX_WORD_BITS - 1) / BITMATRIX_WORD_BITS)
+
+static const uint8_t raw_magic[] = {'Q', 'R', 'B', 'M'};
+
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 typedef uint32_t DWORD;
@@ -80,12 +86,103 @@ static void write_long_le(uint8_t *d, LONG s) {
     d[3] = (s >> 24) & 0xFF;
 }
 
-void write_bmp(int n, module_type_t m[][n], FILE *f) {
-    int s = ((n + 31) & ~31) >> 3;
-    uint32_t l = 62 + n * s;
-    uint8_t d[l];
+/**
+ * Write data to the output stream. This is the sink of the write_*()
+ * functions.
+ *
+ * @param a output stream.
+ * @param d data.
+ * @param n data length.
+ */
+void image_file_sink(void *a, const uint8_t d[], size_t n) {
+    fwrite(d, sizeof(uint8_t), n, a);
+}
+
+/**
+ * Copy data to the part of an image buffer that it fits in. The length is
+ * counted either way, like snprintf().
+ *
+ * @param a image buffer.
+ * @param d data.
+ * @param n data length.
+ */
+void image_buffer_sink(void *a, const uint8_t d[], size_t n) {
+    image_buffer_t *b = a;
+
+    if (b->length < b->capacity)
+        memcpy(&b->data[b->length], d,
+               n < b->capacity - b->length ? n : b->capacity - b->length);
 
-    BITMAPFILEHEADER bf = {0x4D42, l, 0, 0, 62};
+    b->length += n;
+}
+
+/**
+ * Initialize a stream that passes the image to a sink in chunks of at most
+ * IMAGE_STREAM_BUFFER_LENGTH bytes, except for larger writes.
+ *
+ * @param w stream.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void image_stream_init(image_stream_t *w, image_sink_t k, void *a) {
+    w->sink = k;
+    w->sink_arg = a;
+    w->buffer_length = 0;
+}
+
+/**
+ * Write data to a stream. The buffered data is passed to the sink when the
+ * data does not fit in the buffer.
+ *
+ * @param w stream.
+ * @param d data.
+ * @param n data length.
+ */
+void image_stream_write(image_stream_t *w, const uint8_t d[], size_t n) {
+    if (w->buffer_length + n > IMAGE_STREAM_BUFFER_LENGTH) {
+        image_stream_flush(w);
+
+        if (n > IMAGE_STREAM_BUFFER_LENGTH) {
+            w->sink(w->sink_arg, d, n);
+            return;
+        }
+    }
+
+    memcpy(&w->buffer[w->buffer_length], d, n);
+    w->buffer_length += n;
+}
+
+/**
+ * Pass the buffered data of a stream to the sink.
+ *
+ * @param w stream.
+ */
+void image_stream_flush(image_stream_t *w) {
+    if (w->buffer_length > 0)
+        w->sink(w->sink_arg, w->buffer, w->buffer_length);
+
+    w->buffer_length = 0;
+}
+
+/**
+ * Stream the matrix as a 1-bit bitmap image with \a s by \a s pixels per
+ * module. The rows are rendered bottom-up one at a time.
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_bmp(const bitmatrix_t *m, int s, int q, image_sink_t k, void *a) {
+    image_stream_t w;
+    image_scaler_t t;
+    int n = (m->n + q * 2) * s;
+    int l = ((n + 31) & ~31) >> 3;
+    uint8_t d[62];
+    uint8_t r[IMAGE_MAX_ROW_BYTES + 4] = {0};
+
+    BITMAPFILEHEADER bf = {0x4D42, 62 + n * l, 0, 0, 62};
 
     write_word_le(&d[0], bf.bfType);
     write_dword_le(&d[2], bf.bfSize);
@@ -121,27 +218,259 @@ void write_bmp(int n, module_type_t m[][n], FILE *f) {
     d[60] = rgbBlack.rgbRed;
     d[61] = rgbBlack.rgbReserved;
 
-    // pixel data
-    int k = 62;
+    image_stream_init(&w, k, a);
+    image_stream_write(&w, d, sizeof(d));
 
-    for (int i = n - 1; i >= 0; i--) {
-        uint8_t b = 0;
+    // pixel data, padded with 0 to 32 bits
+    image_scaler_init(&t, s, q);
 
-        for (int j = 0; j < n; j++) {
-            b <<= 1;
-            b |= m[i][j];
+    for (int i = m->n + q - 1; i >= -q; i--) {
+        image_scale_row(&t, r, m, i);
 
-            if (j % 8 == 7) {
-                d[k++] = b;
-                b = 0;
-            }
-        }
+        for (int j = 0; j < s; j++)
+            image_stream_write(&w, r, l);
+    }
+
+    image_stream_flush(&w);
+}
+
+/**
+ * Pack a row of the matrix into bytes, most significant bit first, between \a q
+ * light modules on each side. The bytes are shifted from the row words as a
+ * whole and the bits after the row are 0.
+ *
+ * @param d bytes, (n + q * 2 + 7) / 8 of which are written.
+ * @param m matrix.
+ * @param y Y coordinate.
+ * @param q number of light modules on each side of the row.
+ */
+static void pack_row(uint8_t d[], const bitmatrix_t *m, int y, int q) {
+    uint64_t w[IMAGE_ROW_WORDS + 1] = {0};
+    int k = q / BITMATRIX_WORD_BITS;
+    int s = q % BITMATRIX_WORD_BITS;
+
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++) {
+        uint64_t v = m->r[y][i] & bitmatrix_row_mask(m->n, i);
 
-        d[k++] = b << (8 - n % 8);
+        w[i + k] |= v >> s;
 
-        for (int j = n / 8 + 1; j < s; j++)
-            d[k++] = 0;
+        // a shift by the word width is undefined
+        if (s != 0)
+            w[i + k + 1] |= v << (BITMATRIX_WORD_BITS - s);
     }
 
-    fwrite(d, sizeof(uint8_t), l, f);
+    for (int j = 0; j < (m->n + q * 2 + 7) / 8; j++)
+        d[j] = w[j / 8] >> (56 - j % 8 * 8);
+}
+
+/**
+ * Initialize the tables that expand 8 packed modules into their pixels, \a s
+ * bytes with each bit repeated \a s times.
+ *
+ * @param t scaler.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ */
+void image_scaler_init(image_scaler_t *t, int s, int q) {
+    t->scale = s;
+    t->quiet_zone = q;
+
+    for (int b = 0; b < 256; b++) {
+        memset(t->runs[b], 0, s);
+
+        for (int i = 0; i < 8 * s; i++)
+            t->runs[b][i / 8] |= (b >> (7 - i / s) & 1) << (7 - i % 8);
+    }
+}
+
+/**
+ * Render a row of modules with the quiet zone as 1-bit pixels, most
+ * significant bit first, where dark pixels are 1. Each byte of the packed row
+ * is expanded through the tables, and the bits after the row are 0.
+ *
+ * @param t scaler.
+ * @param d pixels, at least IMAGE_MAX_ROW_BYTES bytes.
+ * @param m matrix.
+ * @param y Y coordinate of the module row, or outside of the matrix for the
+ * quiet zone.
+ * @return number of bytes with pixels.
+ */
+int image_scale_row(const image_scaler_t *t, uint8_t d[], const bitmatrix_t *m,
+                    int y) {
+    int s = t->scale;
+    int w = m->n + t->quiet_zone * 2;
+    uint8_t p[(IMAGE_MAX_WIDTH + 7) / 8];
+
+    if (y < 0 || y >= m->n) {
+        memset(d, 0, (w + 7) / 8 * s);
+        return (w * s + 7) / 8;
+    }
+
+    pack_row(p, m, y, t->quiet_zone);
+
+    if (s == 1) {
+        memcpy(d, p, (w + 7) / 8);
+        return (w + 7) / 8;
+    }
+
+    for (int j = 0; j < (w + 7) / 8; j++)
+        memcpy(&d[j * s], t->runs[p[j]], s);
+
+    return (w * s + 7) / 8;
+}
+
+/**
+ * Stream the matrix as a binary PBM (P4) image with \a s by \a s pixels per
+ * module. Dark modules are 1, as in the matrix, so the rows are written as
+ * rendered.
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_pbm(const bitmatrix_t *m, int s, int q, image_sink_t k, void *a) {
+    image_stream_t w;
+    image_scaler_t t;
+    int n = (m->n + q * 2) * s;
+    uint8_t d[IMAGE_MAX_ROW_BYTES];
+    char h[32];
+
+    image_stream_init(&w, k, a);
+    image_stream_write(&w, (uint8_t *)h,
+                       snprintf(h, sizeof(h), "P4\n%d %d\n", n, n));
+
+    image_scaler_init(&t, s, q);
+
+    for (int i = -q; i < m->n + q; i++) {
+        int l = image_scale_row(&t, d, m, i);
+
+        for (int j = 0; j < s; j++)
+            image_stream_write(&w, d, l);
+    }
+
+    image_stream_flush(&w);
+}
+
+/**
+ * Stream the matrix as a binary PGM (P5) image with \a s by \a s pixels per
+ * module. Dark pixels are 0 and light pixels are 255.
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_pgm(const bitmatrix_t *m, int s, int q, image_sink_t k, void *a) {
+    image_stream_t w;
+    int n = (m->n + q * 2) * s;
+    uint8_t d[IMAGE_MAX_WIDTH * IMAGE_MAX_SCALE];
+    char h[32];
+
+    image_stream_init(&w, k, a);
+    image_stream_write(&w, (uint8_t *)h,
+                       snprintf(h, sizeof(h), "P5\n%d %d\n255\n", n, n));
+
+    memset(d, 0xFF, n);
+
+    for (int i = 0; i < q * s; i++)
+        image_stream_write(&w, d, n);
+
+    for (int i = 0; i < m->n; i++) {
+        // a dark module is 1 - 1 = 0 and a light one is 0 - 1 = 255
+        for (int j = 0; j < m->n; j++)
+            memset(&d[(q + j) * s], (uint8_t)(bitmatrix_get(m, i, j) - 1), s);
+
+        for (int j = 0; j < s; j++)
+            image_stream_write(&w, d, n);
+    }
+
+    memset(d, 0xFF, n);
+
+    for (int i = 0; i < q * s; i++)
+        image_stream_write(&w, d, n);
+
+    image_stream_flush(&w);
+}
+
+/**
+ * Stream the symbol as a raw bit matrix. The 8-byte header is "QRBM", the
+ * version (1 to 40), the error correction level (0 to 3 for L, M, Q and H),
+ * the mask pattern and the matrix length n. It is followed by n rows of
+ * (n + 7) / 8 bytes, most significant bit first, where dark modules are 1.
+ * There is no quiet zone.
+ *
+ * @param s symbol.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_raw(const qrcg_symbol_t *s, image_sink_t k, void *a) {
+    const bitmatrix_t *m = s->modules;
+    image_stream_t w;
+    uint8_t h[8];
+    uint8_t d[(BITMATRIX_MAX_LENGTH + 7) / 8];
+
+    memcpy(h, raw_magic, sizeof(raw_magic));
+    h[4] = s->version + 1;
+    h[5] = s->ec_level;
+    h[6] = s->mask;
+    h[7] = m->n;
+
+    image_stream_init(&w, k, a);
+    image_stream_write(&w, h, sizeof(h));
+
+    for (int i = 0; i < m->n; i++) {
+        pack_row(d, m, i, 0);
+        image_stream_write(&w, d, (m->n + 7) / 8);
+    }
+
+    image_stream_flush(&w);
+}
+
+/**
+ * Write the matrix as a 1-bit bitmap image. See stream_bmp().
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param f output stream.
+ */
+void write_bmp(const bitmatrix_t *m, int s, int q, FILE *f) {
+    stream_bmp(m, s, q, image_file_sink, f);
+}
+
+/**
+ * Write the matrix as a binary PBM (P4) image. See stream_pbm().
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param f output stream.
+ */
+void write_pbm(const bitmatrix_t *m, int s, int q, FILE *f) {
+    stream_pbm(m, s, q, image_file_sink, f);
+}
+
+/**
+ * Write the matrix as a binary PGM (P5) image. See stream_pgm().
+ *
+ * @param m matrix.
+ * @param s scale, at most IMAGE_MAX_SCALE.
+ * @param q quiet zone width in modules, at most IMAGE_MAX_QUIET_ZONE.
+ * @param f output stream.
+ */
+void write_pgm(const bitmatrix_t *m, int s, int q, FILE *f) {
+    stream_pgm(m, s, q, image_file_sink, f);
+}
+
+/**
+ * Write the symbol as a raw bit matrix. See stream_raw().
+ *
+ * @param s symbol.
+ * @param f output stream.
+ */
+void write_raw(const qrcg_symbol_t *s, FILE *f) {
+    stream_raw(s, image_file_sink, f);
 }
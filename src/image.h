@@ -27,9 +27,57 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
-#include "typedefs.h"
+#include "bitmatrix.h"
+#include "qrcg.h"
 
-extern void write_bmp(int n, module_type_t m[][n], FILE *f);
+#define IMAGE_MAX_SCALE 32
+#define IMAGE_MAX_QUIET_ZONE 16
+#define IMAGE_MAX_WIDTH (BITMATRIX_MAX_LENGTH + IMAGE_MAX_QUIET_ZONE * 2)
+#define IMAGE_MAX_ROW_BYTES ((IMAGE_MAX_WIDTH + 7) / 8 * IMAGE_MAX_SCALE)
+#define IMAGE_STREAM_BUFFER_LENGTH 16384
+
+typedef void (*image_sink_t)(void *a, const uint8_t d[], size_t n);
+
+typedef struct image_stream {
+    image_sink_t sink;
+    void *sink_arg;
+    size_t buffer_length;
+    uint8_t buffer[IMAGE_STREAM_BUFFER_LENGTH];
+} image_stream_t;
+
+typedef struct image_buffer {
+    uint8_t *data;
+    size_t capacity;
+    size_t length;
+} image_buffer_t;
+
+typedef struct image_scaler {
+    int scale;
+    int quiet_zone;
+    uint8_t runs[256][IMAGE_MAX_SCALE];
+} image_scaler_t;
+
+extern void image_file_sink(void *a, const uint8_t d[], size_t n);
+extern void image_buffer_sink(void *a, const uint8_t d[], size_t n);
+extern void image_stream_init(image_stream_t *w, image_sink_t k, void *a);
+extern void image_stream_write(image_stream_t *w, const uint8_t d[], size_t n);
+extern void image_stream_flush(image_stream_t *w);
+extern void image_scaler_init(image_scaler_t *t, int s, int q);
+extern int image_scale_row(const image_scaler_t *t, uint8_t d[],
+                           const bitmatrix_t *m, int y);
+extern void stream_bmp(const bitmatrix_t *m, int s, int q, image_sink_t k,
+                       void *a);
+extern void stream_pbm(const bitmatrix_t *m, int s, int q, image_sink_t k,
+                       void *a);
+extern void stream_pgm(const bitmatrix_t *m, int s, int q, image_sink_t k,
+                       void *a);
+extern void stream_raw(const qrcg_symbol_t *s, image_sink_t k, void *a);
+extern void write_bmp(const bitmatrix_t *m, int s, int q, FILE *f);
+extern void write_pbm(const bitmatrix_t *m, int s, int q, FILE *f);
+extern void write_pgm(const bitmatrix_t *m, int s, int q, FILE *f);
+extern void write_raw(const qrcg_symbol_t *s, FILE *f);
 
 #endif /* IMAGE_H */
@@ -24,28 +24,799 @@
  * @file main.c
  * @brief main implementation
  */
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "encode.h"
-#include "gf256.h"
+#include <time.h>
+#include "cache.h"
 #include "image.h"
 #include "mask.h"
-#include "message.h"
-#include "module.h"
+#include "png.h"
+#include "svg.h"
+#include "pool.h"
+#include "qrcg.h"
+#include "verify.h"
 
-#define MAX_DATA_LENGTH 7089
+#define RECORD_LENGTH_PREFIX_LEN 4
+#define BATCH_CHUNK_RECORDS 256
+#define MAX_THREADS 1024
+#define MAX_CACHE_SIZE_MB (1 << 20)
+#define DEFAULT_DISK_CACHE_SIZE_MB 64
 
 static const char *ec_levels = "LMQH";
+static const char *batch_formats = "lp";
+static const char *const image_formats[] = {"bmp", "png", "svg", "pbm",
+                                            "pgm", "raw", NULL};
+static const char *const svg_paths[] = {"runs", "outlines", NULL};
+static const char *const append_layouts[] = {"set", "sheet", NULL};
+
+typedef enum {
+    IMAGE_FORMAT_BMP,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_SVG,
+    IMAGE_FORMAT_PBM,
+    IMAGE_FORMAT_PGM,
+    IMAGE_FORMAT_RAW
+} image_format_t;
+
+typedef enum {
+    APPEND_LAYOUT_NONE = -1,
+    APPEND_LAYOUT_SET,
+    APPEND_LAYOUT_SHEET
+} append_layout_t;
+
+typedef struct image_options {
+    error_correction_level_t ec_level;
+    image_format_t format;
+    int scale;
+    int quiet_zone;
+    png_filter_t filter;
+    svg_path_t path;
+    bool verify;
+} image_options_t;
+
+typedef enum {
+    RECORD_STATUS_OK,
+    RECORD_STATUS_EMPTY,
+    RECORD_STATUS_TOO_LONG,
+    RECORD_STATUS_NO_MEMORY,
+    RECORD_STATUS_VERIFY_FAILED,
+    RECORD_STATUS_OPEN_FAILED
+} record_status_t;
+
+static const char *record_errors[] = {NULL,
+                                      "empty record",
+                                      "data is too long",
+                                      "out of memory",
+                                      "verification failed",
+                                      "file open error"};
+
+typedef struct record {
+    size_t offset;
+    int length;
+    record_status_t status;
+    char *image;
+    size_t image_length;
+} record_t;
+
+typedef struct sequence {
+    char number[QRCG_MAX_DATA_LENGTH + 1];
+    int length;
+    long remaining;
+} sequence_t;
+
+typedef struct batch {
+    qrcg_ctx_t **contexts;
+    cache_t *cache;
+    record_t *records;
+    uint8_t *data;
+    int num_records;
+    int first_record;
+    const image_options_t *options;
+    structured_append_t append;
+    bitmatrix_t *symbols;
+    const char *output_template;
+} batch_t;
+
+/**
+ * Returns true if a symbol decodes back to its input string.
+ *
+ * @param q symbol.
+ * @param l input string length.
+ * @param s input string.
+ * @param a structured append, or NULL.
+ * @return true if the symbol is valid and false otherwise.
+ */
+static bool verify(const qrcg_symbol_t *q, int l, const uint8_t s[],
+                   const structured_append_t *a) {
+    structured_append_t n = {0, 0, 0};
+    verify_result_t r;
+
+    if (a == NULL)
+        a = &n;
+
+    return verify_symbol(q->modules, &r) == VERIFY_OK &&
+           r.version == q->version && r.ec_level == q->ec_level &&
+           r.mask == q->mask && r.append.index == a->index &&
+           r.append.total == a->total && r.append.parity == a->parity &&
+           r.length == l && memcmp(r.data, s, l) == 0;
+}
+
+/**
+ * Generate a QR code, and verify it if the options ask for it.
+ *
+ * @param c context.
+ * @param l input string length.
+ * @param s input string.
+ * @param a structured append, or NULL.
+ * @param o image options.
+ * @param q symbol.
+ * @return status.
+ */
+static record_status_t encode_symbol(qrcg_ctx_t *c, int l, const uint8_t s[],
+                                     const structured_append_t *a,
+                                     const image_options_t *o,
+                                     qrcg_symbol_t *q) {
+    if (qrcg_encode_part(c, s, l, o->ec_level, a, q) < 0)
+        return RECORD_STATUS_TOO_LONG;
+
+    if (o->verify && !verify(q, l, s, a))
+        return RECORD_STATUS_VERIFY_FAILED;
+
+    return RECORD_STATUS_OK;
+}
+
+/**
+ * Write a symbol as an image.
+ *
+ * @param q symbol.
+ * @param o image options.
+ * @param f output stream.
+ */
+static void write_symbol(const qrcg_symbol_t *q, const image_options_t *o,
+                         FILE *f) {
+    if (o->format == IMAGE_FORMAT_PNG) {
+        png_options_t p = {o->scale, o->quiet_zone, o->filter};
+
+        write_png(q->modules, &p, f);
+        return;
+    }
+
+    if (o->format == IMAGE_FORMAT_SVG) {
+        svg_options_t p = {o->scale, o->quiet_zone, o->path};
+
+        write_svg(q->modules, &p, f);
+        return;
+    }
+
+    if (o->format == IMAGE_FORMAT_PBM) {
+        write_pbm(q->modules, o->scale, o->quiet_zone, f);
+        return;
+    }
+
+    if (o->format == IMAGE_FORMAT_PGM) {
+        write_pgm(q->modules, o->scale, o->quiet_zone, f);
+        return;
+    }
+
+    if (o->format == IMAGE_FORMAT_RAW) {
+        write_raw(q, f);
+        return;
+    }
+
+    write_bmp(q->modules, o->scale, o->quiet_zone, f);
+}
+
+/**
+ * Generate a QR code and write it as an image.
+ *
+ * @param c context.
+ * @param l input string length.
+ * @param s input string.
+ * @param a structured append, or NULL.
+ * @param o image options.
+ * @param f output stream.
+ * @return status.
+ */
+static record_status_t generate(qrcg_ctx_t *c, int l, const uint8_t s[],
+                                const structured_append_t *a,
+                                const image_options_t *o, FILE *f) {
+    qrcg_symbol_t symbol;
+    record_status_t r = encode_symbol(c, l, s, a, o, &symbol);
+
+    if (r == RECORD_STATUS_OK)
+        write_symbol(&symbol, o, f);
+
+    return r;
+}
+
+/**
+ * Generate a QR code and write it to a file named by the template. The file is
+ * only created if the QR code can be generated.
+ *
+ * @param c context.
+ * @param l input string length.
+ * @param s input string.
+ * @param a structured append, or NULL.
+ * @param o image options.
+ * @param t output file name template.
+ * @param n record number.
+ * @return status.
+ */
+static record_status_t generate_file(qrcg_ctx_t *c, int l, const uint8_t s[],
+                                     const structured_append_t *a,
+                                     const image_options_t *o, const char *t,
+                                     int n) {
+    qrcg_symbol_t symbol;
+    record_status_t r = encode_symbol(c, l, s, a, o, &symbol);
+    char name[FILENAME_MAX];
+
+    if (r != RECORD_STATUS_OK)
+        return r;
+
+    snprintf(name, sizeof(name), t, n);
+
+    FILE *f = fopen(name, "wb");
+
+    if (f == NULL)
+        return RECORD_STATUS_OPEN_FAILED;
+
+    write_symbol(&symbol, o, f);
+    fclose(f);
+
+    return RECORD_STATUS_OK;
+}
+
+/**
+ * Generate a QR code into memory, or take it from the cache if the same input
+ * string has been generated with the same options.
+ *
+ * @param c context.
+ * @param k cache, or NULL. Not used for the symbols of a structured append.
+ * @param l input string length.
+ * @param s input string.
+ * @param a structured append, or NULL.
+ * @param o image options.
+ * @param d image, to be freed by the caller.
+ * @param n image length.
+ * @return status.
+ */
+static record_status_t generate_image(qrcg_ctx_t *c, cache_t *k, int l,
+                                      const uint8_t s[],
+                                      const structured_append_t *a,
+                                      const image_options_t *o, char **d,
+                                      size_t *n) {
+    // everything other than the input string that the image depends on
+    uint64_t key = o->ec_level | (uint64_t)o->format << 8 |
+                   (uint64_t)o->scale << 16 | (uint64_t)o->quiet_zone << 24 |
+                   (uint64_t)o->filter << 32 | (uint64_t)o->path << 40 |
+                   (uint64_t)o->verify << 48;
+
+    if (a != NULL)
+        k = NULL;
+
+    if (k != NULL && (*d = (char *)cache_get(k, key, s, l, n)) != NULL)
+        return RECORD_STATUS_OK;
+
+    FILE *f = open_memstream(d, n);
+
+    if (f == NULL)
+        return RECORD_STATUS_NO_MEMORY;
+
+    record_status_t r = generate(c, l, s, a, o, f);
+
+    if (fclose(f) != 0)
+        return RECORD_STATUS_NO_MEMORY;
+
+    if (k != NULL && r == RECORD_STATUS_OK)
+        cache_put(k, key, s, l, (uint8_t *)*d, *n);
+
+    return r;
+}
+
+/**
+ * Returns the index of a name in a list.
+ *
+ * @param l names, terminated by NULL.
+ * @param s name.
+ * @return index, or -1 if \a s is not in the list.
+ */
+static int find_name(const char *const l[], const char *s) {
+    for (int i = 0; l[i] != NULL; i++)
+        if (strcmp(l[i], s) == 0)
+            return i;
+
+    return -1;
+}
+
+/**
+ * Returns true if the output file name template contains exactly one integer
+ * conversion and no other conversions.
+ *
+ * @param t output file name template.
+ * @return true if the template is valid and false otherwise.
+ */
+static bool is_valid_template(const char *t) {
+    int n = 0;
+
+    for (; *t != '\0'; t++) {
+        if (*t != '%')
+            continue;
+
+        if (*++t == '%')
+            continue;
+
+        t += strspn(t, "-0+ #");
+        t += strspn(t, "0123456789");
+
+        if (*t != 'd')
+            return false;
+
+        n++;
+    }
+
+    return n == 1;
+}
+
+/**
+ * Read one record from the input stream.
+ *
+ * Records longer than \a n bytes are truncated to \a n bytes and the rest of
+ * the record is skipped.
+ *
+ * @param f input stream.
+ * @param b batch format, 'l' for newline-delimited records and 'p' for records
+ * prefixed with a 32-bit big-endian length.
+ * @param n record buffer length.
+ * @param s record buffer.
+ * @return record length, -1 at the end of the input and -2 if the input ends
+ * in the middle of a record.
+ */
+static int read_record(FILE *f, char b, int n, uint8_t s[]) {
+    int l = 0;
+    int c;
+
+    if (b == 'l') {
+        while ((c = getc(f)) != EOF && c != '\n')
+            if (l < n)
+                s[l++] = c;
+
+        if (c == EOF && l == 0)
+            return -1;
+
+        if (l > 0 && l < n && s[l - 1] == '\r')
+            l--;
+
+        return l;
+    }
+
+    uint8_t p[RECORD_LENGTH_PREFIX_LEN];
+    size_t k = fread(p, sizeof(uint8_t), RECORD_LENGTH_PREFIX_LEN, f);
+
+    if (k == 0)
+        return -1;
+
+    if (k < RECORD_LENGTH_PREFIX_LEN)
+        return -2;
+
+    uint32_t r = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+
+    for (uint32_t i = 0; i < r; i++) {
+        if ((c = getc(f)) == EOF)
+            return -2;
+
+        if (l < n)
+            s[l++] = c;
+    }
+
+    return l;
+}
+
+/**
+ * Take the next number of the sequence as a record, then count up in decimal.
+ * Leading zeros are kept, and a carry out of the leftmost digit widens the
+ * number.
+ *
+ * @param q sequence.
+ * @param n record buffer length.
+ * @param s record buffer.
+ * @return record length and -1 at the end of the sequence.
+ */
+static int next_number(sequence_t *q, int n, uint8_t s[]) {
+    if (q->remaining == 0)
+        return -1;
+
+    int l = q->length < n ? q->length : n;
+    int i = q->length - 1;
+
+    memcpy(s, q->number, l);
+    q->remaining--;
+
+    for (; i >= 0 && q->number[i] == '9'; i--)
+        q->number[i] = '0';
+
+    if (i >= 0) {
+        q->number[i]++;
+
+    } else if (q->length < (int)sizeof(q->number)) {
+        memmove(&q->number[1], q->number, q->length);
+        q->number[0] = '1';
+        q->length++;
+    }
+
+    return l;
+}
+
+/**
+ * Write one frame of the output stream. A frame is a 32-bit big-endian length
+ * followed by that many bytes of image data.
+ *
+ * @param f output stream.
+ * @param l frame length.
+ * @param d frame data.
+ */
+static void write_frame(FILE *f, size_t l, const uint8_t d[]) {
+    uint8_t p[RECORD_LENGTH_PREFIX_LEN] = {l >> 24, l >> 16, l >> 8, l};
+
+    fwrite(p, sizeof(uint8_t), RECORD_LENGTH_PREFIX_LEN, f);
+    fwrite(d, sizeof(uint8_t), l, f);
+}
+
+/**
+ * Generate the QR code of one record of the batch. The records of a structured
+ * append are its symbols in order, which are kept as matrices instead of
+ * images if the batch has room for them.
+ *
+ * @param a batch.
+ * @param i record index.
+ * @param w worker index.
+ */
+static void generate_record(void *a, int i, int w) {
+    batch_t *b = a;
+    record_t *r = &b->records[i];
+    structured_append_t p = {i, b->append.total, b->append.parity};
+    const structured_append_t *q = p.total > 0 ? &p : NULL;
+
+    if (r->length == 0) {
+        r->status = RECORD_STATUS_EMPTY;
+        return;
+    }
+
+    if (b->symbols != NULL) {
+        qrcg_symbol_t symbol;
+
+        r->status = encode_symbol(b->contexts[w], r->length,
+                                  &b->data[r->offset], q, b->options, &symbol);
+
+        if (r->status == RECORD_STATUS_OK)
+            b->symbols[i] = *symbol.modules;
+
+        return;
+    }
+
+    if (b->output_template != NULL) {
+        r->status = generate_file(b->contexts[w], r->length,
+                                  &b->data[r->offset], q, b->options,
+                                  b->output_template, b->first_record + i);
+        return;
+    }
+
+    r->status = generate_image(b->contexts[w], b->cache, r->length,
+                               &b->data[r->offset], q, b->options, &r->image,
+                               &r->image_length);
+}
+
+/**
+ * Write the QR codes of the records in input order.
+ *
+ * @param b batch.
+ * @param out output stream.
+ * @param t output file name template.
+ */
+static void write_records(batch_t *b, FILE *out, const char *t) {
+    for (int i = 0; i < b->num_records; i++) {
+        record_t *r = &b->records[i];
+        int n = b->first_record + i;
+
+        if (r->status != RECORD_STATUS_OK)
+            fprintf(stderr, "record %d: %s\n", n, record_errors[r->status]);
+
+        if (t == NULL) {
+            write_frame(out, r->image_length, (uint8_t *)r->image);
+
+        } else if (r->status == RECORD_STATUS_OK &&
+                   b->output_template == NULL) {
+            char name[FILENAME_MAX];
+            snprintf(name, sizeof(name), t, n);
+
+            FILE *f = fopen(name, "wb");
+
+            if (f == NULL) {
+                fprintf(stderr, "record %d: file open error\n", n);
+
+            } else {
+                fwrite(r->image, sizeof(char), r->image_length, f);
+                fclose(f);
+            }
+        }
+
+        free(r->image);
+        r->image = NULL;
+        r->image_length = 0;
+    }
+}
+
+/**
+ * Generate a QR code for each record of the input stream, or for each number
+ * of the sequence if \a q is not NULL.
+ *
+ * Records are read in chunks, the QR codes of a chunk are generated by the
+ * workers of the pool, and then written in input order. Each QR code is
+ * written to a file named by \a t, or to the output stream as a frame if \a t
+ * is NULL. Files are written by the workers as the rows are rendered unless
+ * the images are cached, while frames are kept in memory to be written in
+ * order. A record that cannot be encoded is reported and results in an empty
+ * frame, and the rest of the records are still processed.
+ *
+ * @param in input stream.
+ * @param out output stream.
+ * @param b batch format.
+ * @param t output file name template.
+ * @param o image options.
+ * @param p pool.
+ * @param k cache, or NULL.
+ * @param q sequence, or NULL to read the records from \a in.
+ * @return number of records.
+ */
+static int run_batch(FILE *in, FILE *out, char b, const char *t,
+                     const image_options_t *o, pool_t *p, cache_t *k,
+                     sequence_t *q) {
+    int num_workers = pool_size(p);
+    int chunk_records = BATCH_CHUNK_RECORDS * num_workers;
+    batch_t batch = {calloc(num_workers, sizeof(qrcg_ctx_t *)),
+                     k,
+                     calloc(chunk_records, sizeof(record_t)),
+                     NULL,
+                     0,
+                     1,
+                     o,
+                     {0, 0, 0},
+                     NULL,
+                     k == NULL ? t : NULL};
+    size_t data_capacity = 0;
+    uint8_t record[QRCG_MAX_DATA_LENGTH + 1];
+    bool eof = batch.contexts == NULL || batch.records == NULL;
+
+    for (int i = 0; !eof && i < num_workers; i++)
+        eof = (batch.contexts[i] = qrcg_ctx_new()) == NULL;
+
+    if (eof)
+        fprintf(stderr, "out of memory\n");
+
+    while (!eof) {
+        size_t data_length = 0;
+
+        for (batch.num_records = 0; batch.num_records < chunk_records;
+             batch.num_records++) {
+            int l = q != NULL
+                        ? next_number(q, QRCG_MAX_DATA_LENGTH + 1, record)
+                        : read_record(in, b, QRCG_MAX_DATA_LENGTH + 1, record);
+
+            if (l == -2)
+                fprintf(stderr, "record %d: unexpected end of input\n",
+                        batch.first_record + batch.num_records);
+
+            if (l < 0) {
+                eof = true;
+                break;
+            }
+
+            if (data_length + l > data_capacity) {
+                size_t c = (data_length + l) * 2;
+                uint8_t *d = realloc(batch.data, c);
+
+                if (d == NULL) {
+                    fprintf(stderr, "out of memory\n");
+                    eof = true;
+                    break;
+                }
+
+                batch.data = d;
+                data_capacity = c;
+            }
+
+            memcpy(&batch.data[data_length], record, l);
+
+            batch.records[batch.num_records].offset = data_length;
+            batch.records[batch.num_records].length = l;
+            data_length += l;
+        }
+
+        pool_run(p, batch.num_records, generate_record, &batch);
+        write_records(&batch, out, t);
+
+        batch.first_record += batch.num_records;
+    }
+
+    for (int i = 0; batch.contexts != NULL && i < num_workers; i++)
+        qrcg_ctx_free(batch.contexts[i]);
+
+    free(batch.contexts);
+    free(batch.records);
+    free(batch.data);
+
+    return batch.first_record - 1;
+}
+
+/**
+ * Generate an input string too long for one symbol as a structured append of
+ * up to QRCG_MAX_SYMBOLS symbols, which are generated by the workers of the
+ * pool. With APPEND_LAYOUT_SET, the symbols are written like the records of a
+ * batch, to files named by \a t or to the output stream as frames. With
+ * APPEND_LAYOUT_SHEET, they are tiled in one SVG image written to the output
+ * stream. An input string that fits in one symbol is written the same way as
+ * a set or sheet of one symbol without a structured append header.
+ *
+ * @param s input string.
+ * @param l input string length.
+ * @param y layout.
+ * @param out output stream.
+ * @param t output file name template, or NULL.
+ * @param o image options.
+ * @param p pool.
+ */
+static void run_append(const uint8_t s[], int l, append_layout_t y, FILE *out,
+                       const char *t, const image_options_t *o, pool_t *p) {
+    int num_workers = pool_size(p);
+    qrcg_part_t parts[QRCG_MAX_SYMBOLS];
+    record_t records[QRCG_MAX_SYMBOLS] = {{0}};
+    batch_t batch = {calloc(num_workers, sizeof(qrcg_ctx_t *)),
+                     NULL,
+                     records,
+                     (uint8_t *)s,
+                     0,
+                     1,
+                     o,
+                     {0, 0, 0},
+                     NULL,
+                     t};
+    bool ok = batch.contexts != NULL;
+
+    for (int i = 0; ok && i < num_workers; i++)
+        ok = (batch.contexts[i] = qrcg_ctx_new()) != NULL;
+
+    if (ok && y == APPEND_LAYOUT_SHEET)
+        ok = (batch.symbols = malloc(sizeof(bitmatrix_t) * QRCG_MAX_SYMBOLS)) !=
+             NULL;
+
+    if (!ok) {
+        fprintf(stderr, "out of memory\n");
+
+    } else if ((batch.num_records = qrcg_split(batch.contexts[0], s, l,
+                                               o->ec_level, parts)) < 0) {
+        fprintf(stderr, "%s\n", record_errors[RECORD_STATUS_TOO_LONG]);
+
+    } else {
+        for (int i = 0; i < batch.num_records; i++) {
+            records[i].offset = parts[i].offset;
+            records[i].length = parts[i].length;
+        }
+
+        if (batch.num_records > 1)
+            batch.append = (structured_append_t){0, batch.num_records,
+                                                 qrcg_parity(s, l)};
+
+        pool_run(p, batch.num_records, generate_record, &batch);
+
+        if (y == APPEND_LAYOUT_SET)
+            write_records(&batch, out, t);
+    }
+
+    if (ok && y == APPEND_LAYOUT_SHEET && batch.num_records > 0) {
+        const bitmatrix_t *m[QRCG_MAX_SYMBOLS];
+        svg_options_t v = {o->scale, o->quiet_zone, o->path};
+        int c = 1;
+
+        while (c * c < batch.num_records)
+            c++;
+
+        for (int i = 0; i < batch.num_records; i++) {
+            if (records[i].status != RECORD_STATUS_OK) {
+                fprintf(stderr, "symbol %d: %s\n", i + 1,
+                        record_errors[records[i].status]);
+                ok = false;
+            }
+
+            m[i] = &batch.symbols[i];
+        }
+
+        if (ok)
+            write_svg_sheet(m, batch.num_records, c, &v, out);
+    }
+
+    for (int i = 0; batch.contexts != NULL && i < num_workers; i++)
+        qrcg_ctx_free(batch.contexts[i]);
+
+    free(batch.contexts);
+    free(batch.symbols);
+}
 
 int main(int argc, char const *argv[]) {
-    error_correction_level_t ec_level = ERROR_CORRECTION_LEVEL_L;
+    image_options_t options = {ERROR_CORRECTION_LEVEL_L, IMAGE_FORMAT_BMP, 1,
+                               4, PNG_FILTER_NONE, SVG_PATH_RUNS, false};
+    char batch_format = 0;
+    const char *output_template = NULL;
+    int num_threads = 1;
+    const char *cache_path = NULL;
+    long disk_cache_size = DEFAULT_DISK_CACHE_SIZE_MB;
+    long memory_cache_size = 0;
+    bool verbose = false;
+    append_layout_t append_layout = APPEND_LAYOUT_NONE;
+    sequence_t sequence;
+
+    sequence.remaining = 0;
 
     char option = 0;
     char *level;
+    char *end;
+    long size;
+    int format;
+    int path;
 
     for (int i = 1; i < argc; i++) {
         char const *argp = argv[i];
 
+        if (option == 0 && strcmp(argp, "--sequence") == 0) {
+            if (i + 2 >= argc) {
+                fprintf(stderr, "illegal option: %s\n", argp);
+                return 0;
+            }
+
+            argp = argv[++i];
+            sequence.length = strlen(argp);
+
+            if (sequence.length < 1 || sequence.length > QRCG_MAX_DATA_LENGTH ||
+                argp[strspn(argp, "0123456789")] != '\0') {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            memcpy(sequence.number, argp, sequence.length);
+
+            argp = argv[++i];
+            sequence.remaining = strtol(argp, &end, 10);
+
+            if (*end != '\0' || sequence.remaining < 1) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            continue;
+        }
+
+        if (option == 0 && strcmp(argp, "--verify") == 0) {
+            options.verify = true;
+            continue;
+        }
+
+        if (option == 0 && strcmp(argp, "--append") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "illegal option: %s\n", argp);
+                return 0;
+            }
+
+            argp = argv[++i];
+            append_layout = find_name(append_layouts, argp);
+
+            if (append_layout == APPEND_LAYOUT_NONE) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            continue;
+        }
+
         if (argp[0] == '-') {
             if (option != 0) {
                 fprintf(stderr, "illegal option argument: %s\n", argp);
@@ -54,9 +825,28 @@ int main(int argc, char const *argv[]) {
 
             switch (argp[1]) {
             case 'e':
+            case 'b':
+            case 'o':
+            case 'j':
+            case 'c':
+            case 'C':
+            case 'm':
+            case 'f':
+            case 's':
+            case 'q':
+            case 'p':
                 option = argp[1];
                 break;
 
+            case 'v':
+                if (argp[2] != '\0') {
+                    fprintf(stderr, "illegal option: %s\n", argp);
+                    return 0;
+                }
+
+                verbose = true;
+                continue;
+
             default:
                 fprintf(stderr, "illegal option: %s\n", argp);
                 return 0;
@@ -77,7 +867,91 @@ int main(int argc, char const *argv[]) {
                 return 0;
             }
 
-            ec_level = level - ec_levels;
+            options.ec_level = level - ec_levels;
+            break;
+
+        case 'f':
+            format = find_name(image_formats, argp);
+
+            if (format < 0) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            options.format = format;
+            break;
+
+        case 's':
+        case 'q':
+            size = strtol(argp, &end, 10);
+
+            if (*end != '\0' || size < (option == 's' ? 1 : 0) ||
+                size > (option == 's' ? IMAGE_MAX_SCALE : IMAGE_MAX_QUIET_ZONE)) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            if (option == 's')
+                options.scale = size;
+            else
+                options.quiet_zone = size;
+
+            break;
+
+        case 'p':
+            path = find_name(svg_paths, argp);
+
+            if (path < 0) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            options.path = path;
+            break;
+
+        case 'b':
+            if (strchr(batch_formats, (unsigned char)argp[0]) == NULL ||
+                argp[0] == '\0' || argp[1] != '\0') {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            batch_format = argp[0];
+            break;
+
+        case 'o':
+            output_template = argp;
+            break;
+
+        case 'j':
+            num_threads = strtol(argp, &end, 10);
+
+            if (*end != '\0' || num_threads < 1 ||
+                num_threads > MAX_THREADS) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            break;
+
+        case 'c':
+            cache_path = argp;
+            break;
+
+        case 'C':
+        case 'm':
+            size = strtol(argp, &end, 10);
+
+            if (*end != '\0' || size < 1 || size > MAX_CACHE_SIZE_MB) {
+                fprintf(stderr, "illegal option argument: %s\n", argp);
+                return 0;
+            }
+
+            if (option == 'C')
+                disk_cache_size = size;
+            else
+                memory_cache_size = size;
+
             break;
 
         default:
@@ -93,87 +967,176 @@ int main(int argc, char const *argv[]) {
         return 0;
     }
 
-    uint8_t data[MAX_DATA_LENGTH + 1];
-    int data_length = fread(data, sizeof(uint8_t), MAX_DATA_LENGTH + 1, stdin);
-
-    if (data_length <= 0) {
-        fprintf(stderr, "file read error\n");
+    // structured append is for a single input string, and the sheet is an SVG
+    // image
+    if (append_layout != APPEND_LAYOUT_NONE &&
+        (batch_format != 0 || sequence.remaining > 0 ||
+         (append_layout == APPEND_LAYOUT_SHEET &&
+          options.format != IMAGE_FORMAT_SVG))) {
+        fprintf(stderr, "illegal option: --append\n");
         return 0;
     }
 
-    encoding_mode_t encoding_mode = min_encoding_mode(data_length, data);
-    int version = min_version(data_length, ec_level, encoding_mode);
+    cache_t *cache = NULL;
 
-    if (version < 0) {
-        fprintf(stderr, "data is too long\n");
+    if ((cache_path != NULL || memory_cache_size > 0) &&
+        (cache = cache_open(cache_path, disk_cache_size << 20,
+                            memory_cache_size << 20, QRCG_OUTPUT_VERSION)) ==
+            NULL) {
+        fprintf(stderr, "cache open error\n");
         return 0;
     }
 
-    int data_codewords_length = num_data_codewords(version, ec_level);
+    if (batch_format != 0 || sequence.remaining > 0) {
+        if (output_template != NULL && !is_valid_template(output_template)) {
+            fprintf(stderr, "illegal option argument: %s\n", output_template);
+            cache_close(cache);
+            return 0;
+        }
+
+        pool_t *pool = pool_create(num_threads);
+
+        if (pool == NULL) {
+            fprintf(stderr, "out of memory\n");
+            cache_close(cache);
+            return 0;
+        }
+
+        struct timespec start;
+        struct timespec stop;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        int n = run_batch(stdin, stdout, batch_format, output_template,
+                          &options, pool, cache,
+                          sequence.remaining > 0 ? &sequence : NULL);
 
-    uint8_t data_codewords[data_codewords_length];
+        clock_gettime(CLOCK_MONOTONIC, &stop);
 
-    encode(data_codewords_length, data_codewords, data_length, data, version,
-           encoding_mode);
+        double t = (stop.tv_sec - start.tv_sec) +
+                   (stop.tv_nsec - start.tv_nsec) / 1e9;
 
-    rs_block_info_t rs_block_info = rs_block_information(version, ec_level);
+        if (verbose)
+            fprintf(stderr,
+                    "%d records in %.3f s (%.0f records/s, %d threads)\n", n,
+                    t, t > 0 ? n / t : 0.0, pool_size(pool));
 
-    int genpoly_length = rs_block_info.num_ec_codewords;
-    uint8_t genpoly[genpoly_length];
+        if (verbose && cache != NULL) {
+            cache_stats_t s;
+
+            cache_stats(cache, &s);
+            fprintf(stderr,
+                    "cache: %llu memory hits, %llu memory misses, %llu disk "
+                    "hits, %llu disk misses\n",
+                    (unsigned long long)s.memory_hits,
+                    (unsigned long long)s.memory_misses,
+                    (unsigned long long)s.disk_hits,
+                    (unsigned long long)s.disk_misses);
+        }
 
-    gf256_genpoly(genpoly_length, genpoly);
+        pool_destroy(pool);
+        cache_close(cache);
+        return 0;
+    }
 
-    int ec_codewords_length =
-        rs_block_info.num_ec_codewords *
-        (rs_block_info.num_blocks1 + rs_block_info.num_blocks2);
+    uint8_t data[QRCG_MAX_DATA_LENGTH * QRCG_MAX_SYMBOLS + 1];
+    int data_length = fread(data, sizeof(uint8_t),
+                            append_layout != APPEND_LAYOUT_NONE
+                                ? sizeof(data)
+                                : QRCG_MAX_DATA_LENGTH + 1,
+                            stdin);
 
-    uint8_t ec_codewords[ec_codewords_length];
+    if (data_length <= 0) {
+        fprintf(stderr, "file read error\n");
+        cache_close(cache);
+        return 0;
+    }
 
-    int d_index = 0;
-    int e_index = 0;
+    if (append_layout == APPEND_LAYOUT_SET && output_template != NULL &&
+        !is_valid_template(output_template)) {
+        fprintf(stderr, "illegal option argument: %s\n", output_template);
+        cache_close(cache);
+        return 0;
+    }
 
-    for (int i = 0; i < rs_block_info.num_blocks1; i++) {
-        gf256_divpoly(&ec_codewords[e_index], rs_block_info.num_data_codewords1,
-                      &data_codewords[d_index], genpoly_length, genpoly);
+    FILE *output = stdout;
 
-        d_index += rs_block_info.num_data_codewords1;
-        e_index += rs_block_info.num_ec_codewords;
+    // a set is written to files named by the template
+    if (output_template != NULL && append_layout != APPEND_LAYOUT_SET &&
+        (output = fopen(output_template, "wb")) == NULL) {
+        fprintf(stderr, "file open error\n");
+        cache_close(cache);
+        return 0;
     }
 
-    for (int i = 0; i < rs_block_info.num_blocks2; i++) {
-        gf256_divpoly(&ec_codewords[e_index], rs_block_info.num_data_codewords2,
-                      &data_codewords[d_index], genpoly_length, genpoly);
+    if (append_layout != APPEND_LAYOUT_NONE) {
+        pool_t *pool = pool_create(num_threads);
+
+        if (pool == NULL)
+            fprintf(stderr, "out of memory\n");
+        else
+            run_append(data, data_length, append_layout, output,
+                       append_layout == APPEND_LAYOUT_SET ? output_template
+                                                          : NULL,
+                       &options, pool);
 
-        d_index += rs_block_info.num_data_codewords2;
-        e_index += rs_block_info.num_ec_codewords;
+        pool_destroy(pool);
+        cache_close(cache);
+
+        if (output != stdout)
+            fclose(output);
+
+        return 0;
     }
 
-    int final_message_length = data_codewords_length + ec_codewords_length + 1;
-    uint8_t final_message[final_message_length];
+    pool_t *pool = NULL;
+
+    // the mask patterns and the error correction blocks are evaluated
+    // concurrently when threads are given
+    if (num_threads > 1)
+        pool = pool_create(num_threads < MASK_PATTERNS ? num_threads
+                                                       : MASK_PATTERNS);
+
+    qrcg_ctx_t *ctx = qrcg_ctx_new();
 
-    build_final_message(final_message, data_codewords, ec_codewords,
-                        rs_block_info);
+    if (ctx == NULL || (num_threads > 1 && pool == NULL))
+        fprintf(stderr, "out of memory\n");
 
-    int qr_length = matrix_length(version);
-    module_type_t matrix[qr_length][qr_length];
-    bool mask_flags[qr_length][qr_length];
+    else if (cache == NULL) {
+        qrcg_ctx_set_pool(ctx, pool);
 
-    place_modules(qr_length, matrix, mask_flags, final_message, version);
-    mask_modules_auto(qr_length, matrix, matrix, mask_flags, ec_level);
+        // streamed to the output as the rows are rendered
+        record_status_t r =
+            generate(ctx, data_length, data, NULL, &options, output);
 
-    // Add the quiet zone
-    int qr_image_length = qr_length + 8;
-    module_type_t qr_image[qr_image_length][qr_image_length];
+        if (r != RECORD_STATUS_OK)
+            fprintf(stderr, "%s\n", record_errors[r]);
 
-    for (int i = 0; i < qr_image_length; i++)
-        for (int j = 0; j < qr_image_length; j++)
-            qr_image[i][j] = MODULE_TYPE_LIGHT;
+    } else {
+        char *image = NULL;
+        size_t image_length = 0;
+
+        qrcg_ctx_set_pool(ctx, pool);
+
+        // built in memory to be cached
+        record_status_t r =
+            generate_image(ctx, cache, data_length, data, NULL, &options,
+                           &image, &image_length);
+
+        if (r != RECORD_STATUS_OK)
+            fprintf(stderr, "%s\n", record_errors[r]);
+        else
+            fwrite(image, sizeof(char), image_length, output);
+
+        free(image);
+    }
 
-    for (int i = 0; i < qr_length; i++)
-        for (int j = 0; j < qr_length; j++)
-            qr_image[i + 4][j + 4] = matrix[i][j];
+    qrcg_ctx_free(ctx);
+    pool_destroy(pool);
+    cache_close(cache);
 
-    write_bmp(qr_image_length, qr_image, stdout);
+    if (output != stdout)
+        fclose(output);
 
     return 0;
 }
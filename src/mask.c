@@ -33,6 +33,26 @@
 #define PENALTY_WEIGHT_N3 40
 #define PENALTY_WEIGHT_N4 10
 
+#define MASK_PATTERN_PERIOD 12
+
+// 1:1:3:1:1 finder-like pattern with 4 light modules after or before it
+#define FINDER_LIKE_PATTERN1 0x5D0
+#define FINDER_LIKE_PATTERN2 0x05D
+
+typedef struct mask_job {
+    bitmatrix_t *candidates;
+    mask_score_t *scores;
+    const bitmatrix_t *modules;
+    const bitmatrix_t *flags;
+    const bitmatrix_t *changes;
+    error_correction_level_t ec_level;
+    int num_rows;
+    int rows[BITMATRIX_MAX_LENGTH];
+    int num_columns;
+    int columns[BITMATRIX_MAX_LENGTH];
+    int penalties[MASK_PATTERNS];
+} mask_job_t;
+
 static const uint16_t format_strings[][8] = {
     {0x77C4, 0x72F3, 0x7DAA, 0x789D, 0x662F, 0x6318, 0x6C41, 0x6976},
     {0x5412, 0x5125, 0x5E7C, 0x5B4B, 0x45F9, 0x40CE, 0x4F97, 0x4AA0},
@@ -126,83 +146,259 @@ static bool mask_pattern7(int y, int x) {
 }
 
 /**
- * Place format information in the matrix.
+ * Returns the mask pattern generation conditions.
+ *
+ * @param p mask pattern.
+ * @param y Y coordinate.
+ * @param x X coordinate.
+ * @return mask pattern generation conditions.
+ */
+static bool mask_pattern(int p, int y, int x) {
+    switch (p) {
+    case 0:
+        return mask_pattern0(y, x);
+
+    case 1:
+        return mask_pattern1(y);
+
+    case 2:
+        return mask_pattern2(x);
+
+    case 3:
+        return mask_pattern3(y, x);
+
+    case 4:
+        return mask_pattern4(y, x);
+
+    case 5:
+        return mask_pattern5(y, x);
+
+    case 6:
+        return mask_pattern6(y, x);
+
+    case 7:
+        return mask_pattern7(y, x);
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * Build the rows of a mask pattern. Every mask pattern repeats every
+ * MASK_PATTERN_PERIOD rows, so row Y of the pattern is row Y %
+ * MASK_PATTERN_PERIOD of \a r.
  *
  * @param n matrix length.
+ * @param r rows of the mask pattern.
+ * @param p mask pattern.
+ */
+static void build_mask_pattern(int n, uint64_t r[][BITMATRIX_ROW_WORDS],
+                               int p) {
+    for (int i = 0; i < MASK_PATTERN_PERIOD; i++) {
+        for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+            r[i][j] = 0;
+
+        for (int j = 0; j < n; j++)
+            r[i][j / BITMATRIX_WORD_BITS] |=
+                (uint64_t)mask_pattern(p, i, j)
+                << (BITMATRIX_WORD_BITS - 1 - j % BITMATRIX_WORD_BITS);
+    }
+}
+
+/**
+ * Place format information in the matrix.
+ *
  * @param m matrix.
  * @param e error correction level.
  * @param p mask pattern.
  */
-static void add_format_info(int n, module_type_t m[][n],
-                            error_correction_level_t e, int p) {
+static void add_format_info(bitmatrix_t *m, error_correction_level_t e,
+                            int p) {
+    int n = m->n;
     uint16_t f = format_strings[e][p];
 
     for (int i = 0; i < 8; i++)
-        m[i + (i >= 6)][8] = (f >> i) & 1;
+        bitmatrix_set(m, i + (i >= 6), 8, (f >> i) & 1);
 
     for (int i = 8; i < 15; i++)
-        m[n + i - 15][8] = (f >> i) & 1;
+        bitmatrix_set(m, n + i - 15, 8, (f >> i) & 1);
 
     for (int i = 0; i < 7; i++)
-        m[8][i + (i >= 6)] = (f >> (14 - i)) & 1;
+        bitmatrix_set(m, 8, i + (i >= 6), (f >> (14 - i)) & 1);
 
     for (int i = 7; i < 15; i++)
-        m[8][n + i - 15] = (f >> (14 - i)) & 1;
+        bitmatrix_set(m, 8, n + i - 15, (f >> (14 - i)) & 1);
 }
 
 /**
- * Returns the penalty score under evaluation condition 1.
+ * Shift a row towards its leftmost module, so that bit X of \a d is bit X + K
+ * of \a s.
+ *
+ * @param d shifted row.
+ * @param s row.
+ * @param k shift amount, from 0 to 63.
+ */
+static void shift_row_left(uint64_t d[], const uint64_t s[], int k) {
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        d[i] = k == 0 ? s[i]
+                      : s[i] << k | (i + 1 < BITMATRIX_ROW_WORDS
+                                         ? s[i + 1] >> (BITMATRIX_WORD_BITS - k)
+                                         : 0);
+}
+
+/**
+ * Shift a row by one module towards its rightmost module, so that bit X of \a
+ * d is bit X - 1 of \a s.
+ *
+ * @param d shifted row.
+ * @param s row.
+ */
+static void shift_row_right(uint64_t d[], const uint64_t s[]) {
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        d[i] = s[i] >> 1 | (i > 0 ? s[i - 1] << (BITMATRIX_WORD_BITS - 1) : 0);
+}
+
+/**
+ * Returns the number of set bits of a row.
+ *
+ * @param r row.
+ * @return number of set bits.
+ */
+static int count_row(const uint64_t r[]) {
+    int c = 0;
+
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        c += __builtin_popcountll(r[i]);
+
+    return c;
+}
+
+/**
+ * Returns the penalty score of one row under evaluation condition 1.
+ *
+ * A run of L modules of the same color is L - 1 set bits in a row of
+ * "same as the next module" bits, and the run contains L - 4 windows of four
+ * such bits. Its penalty N1 + (L - 5) is the number of windows plus N1 - 1
+ * for the first window of the run.
  *
  * @param n matrix length.
- * @param m matrix.
+ * @param r row.
  * @return penalty score.
  */
-static int eval_penalty1(int n, const module_type_t m[][n]) {
-    int s = 0;
+static int eval_row_penalty1(int n, const uint64_t r[]) {
+    uint64_t e[BITMATRIX_ROW_WORDS];
+    uint64_t w[BITMATRIX_ROW_WORDS];
+    uint64_t t[BITMATRIX_ROW_WORDS];
 
-    for (int k = 0; k < 2; k++) {
-        for (int i = 0; i < n; i++) {
-            module_type_t u = MODULE_TYPE_NONE;
-            int l = 0;
+    shift_row_left(t, r, 1);
 
-            for (int j = 0; j < n; j++) {
-                module_type_t t = m[i * (1 - k) + j * k][i * k + j * (1 - k)];
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        w[i] = e[i] = ~(r[i] ^ t[i]) & bitmatrix_row_mask(n - 1, i);
 
-                if (t == u) {
-                    l++;
+    for (int k = 1; k < 4; k++) {
+        shift_row_left(t, e, k);
 
-                } else {
-                    if (l >= 5)
-                        s += PENALTY_WEIGHT_N1 + (l - 5);
+        for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+            w[i] &= t[i];
+    }
 
-                    l = 1;
-                    u = t;
-                }
-            }
+    shift_row_right(t, w);
+
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        t[i] = w[i] & ~t[i];
+
+    return count_row(w) + count_row(t) * (PENALTY_WEIGHT_N1 - 1);
+}
+
+/**
+ * Returns the penalty score of one row under evaluation condition 3. Bit X of
+ * the match rows is set if the 11 modules from X match the pattern.
+ *
+ * @param n matrix length.
+ * @param r row.
+ * @return penalty score.
+ */
+static int eval_row_penalty3(int n, const uint64_t r[]) {
+    uint64_t p[BITMATRIX_ROW_WORDS];
+    uint64_t q[BITMATRIX_ROW_WORDS];
+    uint64_t t[BITMATRIX_ROW_WORDS];
+
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        p[i] = q[i] = bitmatrix_row_mask(n - 10, i);
+
+    for (int k = 0; k < 11; k++) {
+        shift_row_left(t, r, k);
 
-            if (l >= 5)
-                s += PENALTY_WEIGHT_N1 + (l - 5);
+        for (int i = 0; i < BITMATRIX_ROW_WORDS; i++) {
+            p[i] &= (FINDER_LIKE_PATTERN1 >> (10 - k) & 1) ? t[i] : ~t[i];
+            q[i] &= (FINDER_LIKE_PATTERN2 >> (10 - k) & 1) ? t[i] : ~t[i];
         }
     }
 
+    return (count_row(p) + count_row(q)) * PENALTY_WEIGHT_N3;
+}
+
+/**
+ * Returns the penalty score under evaluation condition 1.
+ *
+ * @param m matrix.
+ * @param t transposed matrix.
+ * @return penalty score.
+ */
+static int eval_penalty1(const bitmatrix_t *m, const bitmatrix_t *t) {
+    int n = m->n;
+    int s = 0;
+
+    for (int i = 0; i < n; i++)
+        s += eval_row_penalty1(n, m->r[i]) + eval_row_penalty1(n, t->r[i]);
+
     return s;
 }
 
 /**
- * Returns the penalty score under evaluation condition 2.
+ * Returns the penalty score of two adjacent rows under evaluation condition 2.
+ * Bit X of the block row is set if the 2 x 2 modules from X of the two rows are
+ * the same color.
  *
  * @param n matrix length.
+ * @param a upper row.
+ * @param b lower row.
+ * @return penalty score.
+ */
+static int eval_block_penalty2(int n, const uint64_t a[], const uint64_t b[]) {
+    uint64_t e[BITMATRIX_ROW_WORDS];
+    uint64_t k[BITMATRIX_ROW_WORDS];
+    uint64_t t[BITMATRIX_ROW_WORDS];
+
+    for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+        e[j] = ~(a[j] ^ b[j]);
+
+    shift_row_left(t, a, 1);
+
+    for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+        k[j] = e[j] & ~(a[j] ^ t[j]) & bitmatrix_row_mask(n - 1, j);
+
+    shift_row_left(t, e, 1);
+
+    for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+        k[j] &= t[j];
+
+    return count_row(k) * PENALTY_WEIGHT_N2;
+}
+
+/**
+ * Returns the penalty score under evaluation condition 2.
+ *
  * @param m matrix.
  * @return penalty score.
  */
-static int eval_penalty2(int n, const module_type_t m[][n]) {
+static int eval_penalty2(const bitmatrix_t *m) {
+    int n = m->n;
     int s = 0;
 
     for (int i = 0; i < n - 1; i++)
-        for (int j = 0; j < n - 1; j++)
-            if (m[i][j] == m[i][j + 1] && m[i][j] == m[i + 1][j] &&
-                m[i][j] == m[i + 1][j + 1])
-                s += PENALTY_WEIGHT_N2;
+        s += eval_block_penalty2(n, m->r[i], m->r[i + 1]);
 
     return s;
 }
@@ -210,144 +406,351 @@ static int eval_penalty2(int n, const module_type_t m[][n]) {
 /**
  * Returns the penalty score under evaluation condition 3.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param t transposed matrix.
  * @return penalty score.
  */
-static int eval_penalty3(int n, const module_type_t m[][n]) {
+static int eval_penalty3(const bitmatrix_t *m, const bitmatrix_t *t) {
+    int n = m->n;
     int s = 0;
 
-    for (int k = 0; k < 2; k++) {
-        for (int i = 0; i < n; i++) {
-            uint16_t p = 0;
-
-            for (int j = 0; j < n; j++) {
-                p <<= 1;
-                p |= m[i * (1 - k) + j * k][i * k + j * (1 - k)];
-                p &= 0x7FF;
-
-                if (j >= 10 && (p == 0x5D0 || p == 0x5D))
-                    s += PENALTY_WEIGHT_N3;
-            }
-        }
-    }
+    for (int i = 0; i < n; i++)
+        s += eval_row_penalty3(n, m->r[i]) + eval_row_penalty3(n, t->r[i]);
 
     return s;
 }
 
 /**
- * Returns the penalty score under evaluation condition 4.
+ * Returns the penalty score under evaluation condition 4 from the number of
+ * dark modules.
  *
  * @param n matrix length.
+ * @param d number of dark modules.
+ * @return penalty score.
+ */
+static int dark_penalty4(int n, int d) {
+    return abs(d * 2 - (n * n)) * 10 / (n * n) * PENALTY_WEIGHT_N4;
+}
+
+/**
+ * Returns the penalty score under evaluation condition 4.
+ *
  * @param m matrix.
  * @return penalty score.
  */
-static int eval_penalty4(int n, const module_type_t m[][n]) {
+static int eval_penalty4(const bitmatrix_t *m) {
+    int n = m->n;
     int d = 0;
 
     for (int i = 0; i < n; i++)
-        for (int j = 0; j < n; j++)
-            if (m[i][j] == MODULE_TYPE_DARK)
-                d++;
+        d += count_row(m->r[i]);
 
-    return abs(d * 2 - (n * n)) * 10 / (n * n) * PENALTY_WEIGHT_N4;
+    return dark_penalty4(n, d);
 }
 
 /**
  * Mask with the specified mask pattern.
  *
- * @param n matrix length.
  * @param d output matrix to be masked.
  * @param s input matrix.
- * @param f true if modules to be applied masking and false otherwise.
+ * @param f data module flags, set for modules to be applied masking.
  * @param e error correction level.
  * @param p mask pattern.
  */
-void mask_modules(int n, module_type_t d[][n], const module_type_t s[][n],
-                  const bool f[][n], error_correction_level_t e, int p) {
-    for (int i = 0; i < n; i++)
-        for (int j = 0; j < n; j++)
-            if (f[i][j])
-                switch (p) {
-                case 0:
-                    d[i][j] = s[i][j] ^ mask_pattern0(i, j);
-                    break;
+void mask_modules(bitmatrix_t *d, const bitmatrix_t *s, const bitmatrix_t *f,
+                  error_correction_level_t e, int p) {
+    int n = s->n;
+    uint64_t r[MASK_PATTERN_PERIOD][BITMATRIX_ROW_WORDS];
 
-                case 1:
-                    d[i][j] = s[i][j] ^ mask_pattern1(i);
-                    break;
+    build_mask_pattern(n, r, p);
 
-                case 2:
-                    d[i][j] = s[i][j] ^ mask_pattern2(j);
-                    break;
+    d->n = n;
 
-                case 3:
-                    d[i][j] = s[i][j] ^ mask_pattern3(i, j);
-                    break;
+    for (int i = 0; i < BITMATRIX_MAX_LENGTH; i++)
+        for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+            d->r[i][j] = s->r[i][j] ^ (r[i % MASK_PATTERN_PERIOD][j] &
+                                       f->r[i][j]);
 
-                case 4:
-                    d[i][j] = s[i][j] ^ mask_pattern4(i, j);
-                    break;
+    add_format_info(d, e, p);
+}
+
+/**
+ * Returns the penalty score based on the evaluation conditions defined in the
+ * QR code specification.
+ *
+ * @param m matrix.
+ * @return penalty score.
+ */
+int eval_penalty(const bitmatrix_t *m) {
+    bitmatrix_t t;
 
-                case 5:
-                    d[i][j] = s[i][j] ^ mask_pattern5(i, j);
-                    break;
+    bitmatrix_transpose(&t, m);
 
-                case 6:
-                    d[i][j] = s[i][j] ^ mask_pattern6(i, j);
-                    break;
+    return eval_penalty1(m, &t) + eval_penalty2(m) + eval_penalty3(m, &t) +
+           eval_penalty4(m);
+}
 
-                case 7:
-                    d[i][j] = s[i][j] ^ mask_pattern7(i, j);
-                    break;
-                }
+/**
+ * Get a column of the matrix as a row.
+ *
+ * @param m matrix.
+ * @param x X coordinate.
+ * @param c column.
+ */
+static void get_column(const bitmatrix_t *m, int x, uint64_t c[]) {
+    int w = x / BITMATRIX_WORD_BITS;
+    int k = BITMATRIX_WORD_BITS - 1 - x % BITMATRIX_WORD_BITS;
 
-            else
-                d[i][j] = s[i][j];
+    for (int i = 0; i < BITMATRIX_ROW_WORDS; i++)
+        c[i] = 0;
 
-    add_format_info(n, d, e, p);
+    for (int i = 0; i < m->n; i++)
+        c[i / BITMATRIX_WORD_BITS] |=
+            (m->r[i][w] >> k & 1)
+            << (BITMATRIX_WORD_BITS - 1 - i % BITMATRIX_WORD_BITS);
 }
 
 /**
- * Returns the penalty score based on the evaluation conditions defined in the
- * QR code specification.
+ * Returns the penalty score of one row or column under evaluation conditions 1
+ * and 3.
  *
  * @param n matrix length.
- * @param m matrix.
+ * @param r row.
  * @return penalty score.
  */
-int eval_penalty(int n, const module_type_t m[][n]) {
-    return eval_penalty1(n, m) + eval_penalty2(n, m) + eval_penalty3(n, m) +
-           eval_penalty4(n, m);
+static int eval_line_penalty(int n, const uint64_t r[]) {
+    return eval_row_penalty1(n, r) + eval_row_penalty3(n, r);
 }
 
 /**
- * Mask using the mask pattern with the lowest penalty.
+ * Evaluate the matrix and keep the penalty score of each row, column and pair
+ * of adjacent rows, so that it can be updated by update_score().
  *
- * @param n matrix length.
- * @param d output matrix to be masked.
+ * @param c score.
+ * @param m matrix.
+ * @return penalty score, the same as eval_penalty().
+ */
+static int eval_score(mask_score_t *c, const bitmatrix_t *m) {
+    int n = m->n;
+    bitmatrix_t t;
+
+    bitmatrix_transpose(&t, m);
+
+    c->lines = 0;
+    c->dark = 0;
+
+    for (int i = 0; i < n; i++) {
+        c->rows[i] = eval_line_penalty(n, m->r[i]);
+        c->columns[i] = eval_line_penalty(n, t.r[i]);
+        c->blocks[i] = i < n - 1 ? eval_block_penalty2(n, m->r[i],
+                                                       m->r[i + 1])
+                                 : 0;
+        c->lines += c->rows[i] + c->columns[i] + c->blocks[i];
+        c->dark += count_row(m->r[i]);
+    }
+
+    return c->lines + dark_penalty4(n, c->dark);
+}
+
+/**
+ * Apply the changed modules to a candidate and update its score, evaluating
+ * only the rows, columns and pairs of adjacent rows that contain them.
+ *
+ * @param c score.
+ * @param m candidate, updated.
+ * @param j mask job with the changes.
+ * @return penalty score, the same as eval_penalty().
+ */
+static int update_score(mask_score_t *c, bitmatrix_t *m, const mask_job_t *j) {
+    int n = m->n;
+    uint64_t r[BITMATRIX_ROW_WORDS];
+
+    for (int k = 0; k < j->num_rows; k++) {
+        int i = j->rows[k];
+
+        c->dark -= count_row(m->r[i]);
+
+        for (int w = 0; w < BITMATRIX_ROW_WORDS; w++)
+            m->r[i][w] ^= j->changes->r[i][w];
+
+        c->dark += count_row(m->r[i]);
+    }
+
+    for (int k = 0; k < j->num_rows; k++) {
+        int i = j->rows[k];
+
+        c->lines -= c->rows[i];
+        c->rows[i] = eval_line_penalty(n, m->r[i]);
+        c->lines += c->rows[i];
+
+        // the pair above is also the pair below the previous changed row
+        for (int b = i > 0 ? i - 1 : 0; b <= i && b < n - 1; b++) {
+            c->lines -= c->blocks[b];
+            c->blocks[b] = eval_block_penalty2(n, m->r[b], m->r[b + 1]);
+            c->lines += c->blocks[b];
+        }
+    }
+
+    for (int k = 0; k < j->num_columns; k++) {
+        int x = j->columns[k];
+
+        get_column(m, x, r);
+
+        c->lines -= c->columns[x];
+        c->columns[x] = eval_line_penalty(n, r);
+        c->lines += c->columns[x];
+    }
+
+    return c->lines + dark_penalty4(n, c->dark);
+}
+
+/**
+ * Mask and evaluate one candidate, or update it from the changed modules if
+ * the mask job has changes.
+ *
+ * @param a mask job.
+ * @param i mask pattern.
+ * @param w unused.
+ */
+static void eval_candidate(void *a, int i, int w) {
+    mask_job_t *j = a;
+
+    (void)w;
+
+    if (j->changes != NULL) {
+        j->penalties[i] = update_score(&j->scores[i], &j->candidates[i], j);
+        return;
+    }
+
+    mask_modules(&j->candidates[i], j->modules, j->flags, j->ec_level, i);
+
+    j->penalties[i] = j->scores != NULL
+                          ? eval_score(&j->scores[i], &j->candidates[i])
+                          : eval_penalty(&j->candidates[i]);
+}
+
+/**
+ * Evaluate the candidates concurrently on the pool and select the one with the
+ * lowest penalty, or the lowest mask pattern of those with the lowest penalty.
+ *
+ * @param j mask job.
+ * @param p pool, or NULL to evaluate the candidates on the calling thread.
+ * @return selected mask pattern.
+ */
+static int select_candidate(mask_job_t *j, pool_t *p) {
+    pool_run(p, MASK_PATTERNS, eval_candidate, j);
+
+    int q = 0;
+
+    for (int i = 1; i < MASK_PATTERNS; i++)
+        if (j->penalties[i] < j->penalties[q])
+            q = i;
+
+    return q;
+}
+
+/**
+ * Mask using each mask pattern and select the one with the lowest penalty, or
+ * the lowest mask pattern of those with the lowest penalty. The candidates are
+ * evaluated concurrently on the pool, which must not be running the calling
+ * task.
+ *
+ * @param d candidates, one output matrix per mask pattern.
  * @param s input matrix.
- * @param f true if modules to be applied masking and false otherwise.
+ * @param f data module flags, set for modules to be applied masking.
  * @param e error correction level.
+ * @param p pool, or NULL to evaluate the candidates on the calling thread.
+ * @return selected mask pattern, whose candidate is the masked matrix.
  */
-void mask_modules_auto(int n, module_type_t d[][n], const module_type_t s[][n],
-                       const bool f[][n], error_correction_level_t e) {
-    module_type_t t[n][n];
-    int z[8];
+int mask_modules_auto(bitmatrix_t d[MASK_PATTERNS], const bitmatrix_t *s,
+                      const bitmatrix_t *f, error_correction_level_t e,
+                      pool_t *p) {
+    mask_job_t j;
+
+    j.candidates = d;
+    j.scores = NULL;
+    j.modules = s;
+    j.flags = f;
+    j.changes = NULL;
+    j.ec_level = e;
+
+    return select_candidate(&j, p);
+}
 
-    for (int i = 0; i < 8; i++) {
-        mask_modules(n, t, s, f, e, i);
-        z[i] = eval_penalty(n, t);
-    }
+/**
+ * Forget the previous input matrix of the mask state, so that the next call of
+ * mask_modules_update() evaluates every candidate from scratch.
+ *
+ * @param t mask state.
+ */
+void mask_state_reset(mask_state_t *t) {
+    t->modules.n = 0;
+}
+
+/**
+ * Select the mask pattern like mask_modules_auto(), reusing the previous call
+ * with the same mask state. If the input matrix has the same length and error
+ * correction level as the previous one, only the rows, columns and pairs of
+ * adjacent rows containing changed modules are evaluated again, unless there
+ * are so many that evaluating the whole candidates is cheaper.
+ *
+ * @param t mask state, holding the candidates and their penalty scores.
+ * @param s input matrix.
+ * @param f data module flags, which must be the same for the same length.
+ * @param e error correction level.
+ * @param p pool, or NULL to evaluate the candidates on the calling thread.
+ * @return selected mask pattern, whose candidate is the masked matrix.
+ */
+int mask_modules_update(mask_state_t *t, const bitmatrix_t *s,
+                        const bitmatrix_t *f, error_correction_level_t e,
+                        pool_t *p) {
+    int n = s->n;
+    mask_job_t j;
+
+    j.candidates = t->candidates;
+    j.scores = t->scores;
+    j.modules = s;
+    j.flags = f;
+    j.changes = NULL;
+    j.ec_level = e;
+
+    if (t->modules.n == n && t->ec_level == e) {
+        uint64_t c[BITMATRIX_ROW_WORDS] = {0};
 
-    int l = z[0];
-    int p = 0;
+        j.num_rows = 0;
+        j.num_columns = 0;
 
-    for (int i = 1; i < 8; i++)
-        if (z[i] < l) {
-            l = z[i];
-            p = i;
+        for (int i = 0; i < n; i++) {
+            uint64_t r = 0;
+
+            for (int w = 0; w < BITMATRIX_ROW_WORDS; w++) {
+                t->changes.r[i][w] = s->r[i][w] ^ t->modules.r[i][w];
+                r |= t->changes.r[i][w];
+                c[w] |= t->changes.r[i][w];
+            }
+
+            if (r != 0)
+                j.rows[j.num_rows++] = i;
+        }
+
+        for (int x = 0; x < n; x++) {
+            int k = BITMATRIX_WORD_BITS - 1 - x % BITMATRIX_WORD_BITS;
+
+            if (c[x / BITMATRIX_WORD_BITS] >> k & 1)
+                j.columns[j.num_columns++] = x;
         }
 
-    mask_modules(n, d, s, f, e, p);
+        if (j.num_rows + j.num_columns <= n)
+            j.changes = &t->changes;
+    }
+
+    t->modules = *s;
+    t->ec_level = e;
+
+    int q = select_candidate(&j, p);
+
+    for (int i = 0; i < MASK_PATTERNS; i++)
+        t->penalties[i] = j.penalties[i];
+
+    return q;
 }
@@ -27,15 +27,39 @@
 #ifndef MASK_H
 #define MASK_H
 
-#include <stdbool.h>
+#include "bitmatrix.h"
+#include "pool.h"
 #include "typedefs.h"
 
-extern void mask_modules(int n, module_type_t d[][n],
-                         const module_type_t s[][n], const bool f[][n],
-                         error_correction_level_t e, int p);
-extern int eval_penalty(int n, const module_type_t m[][n]);
-extern void mask_modules_auto(int n, module_type_t d[][n],
-                              const module_type_t s[][n], const bool f[][n],
-                              error_correction_level_t e);
+#define MASK_PATTERNS 8
+
+typedef struct mask_score {
+    int rows[BITMATRIX_MAX_LENGTH];
+    int columns[BITMATRIX_MAX_LENGTH];
+    int blocks[BITMATRIX_MAX_LENGTH];
+    int lines;
+    int dark;
+} mask_score_t;
+
+typedef struct mask_state {
+    bitmatrix_t modules;
+    bitmatrix_t changes;
+    error_correction_level_t ec_level;
+    bitmatrix_t candidates[MASK_PATTERNS];
+    mask_score_t scores[MASK_PATTERNS];
+    int penalties[MASK_PATTERNS];
+} mask_state_t;
+
+extern void mask_modules(bitmatrix_t *d, const bitmatrix_t *s,
+                         const bitmatrix_t *f, error_correction_level_t e,
+                         int p);
+extern int eval_penalty(const bitmatrix_t *m);
+extern int mask_modules_auto(bitmatrix_t d[MASK_PATTERNS], const bitmatrix_t *s,
+                             const bitmatrix_t *f, error_correction_level_t e,
+                             pool_t *p);
+extern void mask_state_reset(mask_state_t *t);
+extern int mask_modules_update(mask_state_t *t, const bitmatrix_t *s,
+                               const bitmatrix_t *f, error_correction_level_t e,
+                               pool_t *p);
 
 #endif /* MASK_H */
@@ -24,8 +24,21 @@
  * @file message.c
  * @brief message implementation
  */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include "message.h"
 
+#define NUM_VERSIONS 40
+#define NUM_EC_LEVELS 4
+#define MAX_CODEWORDS 3706
+
+typedef struct interleave_table {
+    int num_data_codewords;
+    int num_ec_codewords;
+    uint16_t sources[MAX_CODEWORDS];
+} interleave_table_t;
+
 static const int16_t num_codewords[] = {
     26,   44,   70,   100,  134,  172,  196,  242,  292,  346,
     404,  466,  532,  581,  655,  733,  815,  901,  991,  1085,
@@ -74,108 +87,116 @@ static const int8_t rs_block_table[][4][3] = {
     {{20, 117, 4}, {40, 47, 7}, {43, 24, 22}, {10, 15, 67}},
     {{19, 118, 6}, {18, 47, 31}, {34, 24, 34}, {20, 15, 61}}};
 
+// position of each codeword of the final message in the codewords of the
+// blocks, for each version and error correction level, built on first use
+static interleave_table_t interleave_tables[NUM_VERSIONS][NUM_EC_LEVELS];
+static atomic_bool interleave_tables_built[NUM_VERSIONS][NUM_EC_LEVELS];
+static pthread_mutex_t interleave_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Returns reed-solomon block information.
+ *
+ * @param v version.
+ * @param e error correction level.
+ * @return reed-solomon block information.
+ */
+rs_block_info_t rs_block_information(int v, error_correction_level_t e) {
+    const int8_t *b = rs_block_table[v][e];
+
+    return (rs_block_info_t){
+        (num_codewords[v] - (b[0] * b[1] + b[2] * (b[1] + 1))) / (b[0] + b[2]),
+        b[0], b[1], b[2], b[2] == 0 ? 0 : b[1] + 1};
+}
+
 /**
- * Interleave the codewords.
+ * Find the position of each interleaved codeword in the codewords of the
+ * blocks, which are stored one block after another.
  *
- * @param l codewords length.
- * @param c codewords.
+ * @param s positions, in interleaved order.
  * @param m number of blocks in group 1.
  * @param n number of blocks in group 2.
  * @param k number of codewords in each block of group 1.
- * @param p pointer to column 1 of each block.
+ * @return number of codewords.
  */
-static void interleave_codewords(int l, uint8_t c[], int m, int n, int k,
-                                 const uint8_t *const p[]) {
-    uint8_t t[l];
+static int interleave_sources(uint16_t s[], int m, int n, int k) {
     int x = 0;
 
     for (int i = 0; i < k; i++)
         for (int j = 0; j < m + n; j++)
-            t[x++] = p[j][i];
+            s[x++] = j < m ? k * j + i : k * m + (k + 1) * (j - m) + i;
 
     for (int i = 0; i < n; i++)
-        t[x++] = p[m + i][k];
+        s[x++] = k * m + (k + 1) * i + k;
 
-    for (int i = 0; i < l; i++)
-        c[i] = t[i];
+    return x;
 }
 
 /**
- * Interleave the data codewords.
+ * Build the interleave table of a version and error correction level.
  *
- * @param l data codewords length.
- * @param d data codewords.
- * @param b reed-solomon block information.
+ * @param t interleave table.
+ * @param v version.
+ * @param l error correction level.
  */
-static void interleave_data_codewords(int l, uint8_t d[], rs_block_info_t b) {
-    const uint8_t *p[b.num_blocks1 + b.num_blocks2];
-
-    for (int i = 0; i < b.num_blocks1; i++)
-        p[i] = &d[b.num_data_codewords1 * i];
-
-    for (int i = 0; i < b.num_blocks2; i++)
-        p[b.num_blocks1 + i] = &d[b.num_data_codewords1 * b.num_blocks1 +
-                                  b.num_data_codewords2 * i];
-
-    interleave_codewords(l, d, b.num_blocks1, b.num_blocks2,
-                         b.num_data_codewords1, p);
+static void build_interleave_table(interleave_table_t *t, int v,
+                                   error_correction_level_t l) {
+    rs_block_info_t b = rs_block_information(v, l);
+
+    t->num_data_codewords = interleave_sources(
+        t->sources, b.num_blocks1, b.num_blocks2, b.num_data_codewords1);
+    t->num_ec_codewords =
+        interleave_sources(&t->sources[t->num_data_codewords],
+                           b.num_blocks1 + b.num_blocks2, 0, b.num_ec_codewords);
 }
 
 /**
- * Interleave the error correction codewords.
+ * Returns the interleave table of a version and error correction level,
+ * building it on first use.
  *
- * @param l error correction codewords length.
- * @param e error correction codewords.
- * @param b reed-solomon block information.
+ * @param v version.
+ * @param l error correction level.
+ * @return interleave table.
  */
-static void interleave_ec_codewords(int l, uint8_t e[], rs_block_info_t b) {
-    const uint8_t *p[b.num_blocks1 + b.num_blocks2];
+static const interleave_table_t *get_interleave_table(
+    int v, error_correction_level_t l) {
+    atomic_bool *built = &interleave_tables_built[v][l];
 
-    for (int i = 0; i < b.num_blocks1 + b.num_blocks2; i++)
-        p[i] = &e[b.num_ec_codewords * i];
+    if (!atomic_load_explicit(built, memory_order_acquire)) {
+        pthread_mutex_lock(&interleave_tables_mutex);
 
-    interleave_codewords(l, e, b.num_blocks1 + b.num_blocks2, 0,
-                         b.num_ec_codewords, p);
-}
+        if (!atomic_load_explicit(built, memory_order_relaxed)) {
+            build_interleave_table(&interleave_tables[v][l], v, l);
+            atomic_store_explicit(built, true, memory_order_release);
+        }
 
-/**
- * Returns reed-solomon block information.
- *
- * @param v version.
- * @param e error correction level.
- * @return reed-solomon block information.
- */
-rs_block_info_t rs_block_information(int v, error_correction_level_t e) {
-    const int8_t *b = rs_block_table[v][e];
+        pthread_mutex_unlock(&interleave_tables_mutex);
+    }
 
-    return (rs_block_info_t){
-        (num_codewords[v] - (b[0] * b[1] + b[2] * (b[1] + 1))) / (b[0] + b[2]),
-        b[0], b[1], b[2], b[2] == 0 ? 0 : b[1] + 1};
+    return &interleave_tables[v][l];
 }
 
 /**
- * Build the final message.
+ * Build the final message by gathering each interleaved codeword from its
+ * block in a single pass. The codewords of the blocks are left unchanged.
  *
  * @param f final message.
- * @param d data codewords.
- * @param e error correction codewords.
- * @param b reed-solomon block information.
+ * @param d data codewords, one block after another.
+ * @param e error correction codewords, one block after another.
+ * @param v version.
+ * @param l error correction level.
  */
-void build_final_message(uint8_t f[], uint8_t d[], uint8_t e[],
-                         rs_block_info_t b) {
-    int l = b.num_data_codewords1 * b.num_blocks1 +
-            b.num_data_codewords2 * b.num_blocks2;
-    int n = b.num_ec_codewords * (b.num_blocks1 + b.num_blocks2);
-
-    interleave_data_codewords(l, d, b);
-    interleave_ec_codewords(n, e, b);
-
-    for (int i = 0; i < l; i++)
-        f[i] = d[i];
+void build_final_message(uint8_t f[], const uint8_t d[], const uint8_t e[],
+                         int v, error_correction_level_t l) {
+    const interleave_table_t *t = get_interleave_table(v, l);
+    const uint16_t *s = t->sources;
+    int n = t->num_data_codewords;
 
     for (int i = 0; i < n; i++)
-        f[l + i] = e[i];
+        f[i] = d[s[i]];
+
+    for (int i = 0; i < t->num_ec_codewords; i++)
+        f[n + i] = e[s[n + i]];
 
     // remainder bits
-    f[l + n] = 0;
+    f[n + t->num_ec_codewords] = 0;
 }
@@ -39,7 +39,8 @@ typedef struct rs_block_info {
 } rs_block_info_t;
 
 extern rs_block_info_t rs_block_information(int v, error_correction_level_t e);
-extern void build_final_message(uint8_t f[], uint8_t d[], uint8_t e[],
-                                rs_block_info_t b);
+extern void build_final_message(uint8_t f[], const uint8_t d[],
+                                const uint8_t e[], int v,
+                                error_correction_level_t l);
 
 #endif /* MESSAGE_H */
@@ -25,6 +25,20 @@
  * @brief module implementation
  */
 #include "module.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define NUM_VERSIONS 40
+#define MAX_DATA_MODULES 29648
+
+typedef struct module_template {
+    bitmatrix_t modules;
+    bitmatrix_t flags;
+    int num_positions;
+    // data module positions in placement order, as bit offsets y * 192 + x
+    // into the row words of the matrix
+    uint16_t positions[MAX_DATA_MODULES];
+} module_template_t;
 
 static const uint8_t alignment_pattern_gaps[] = {
     -1, -1, -1, -1, -1, -1, 16, 18, 20, 22, 24, 26, 28, 20,
@@ -38,148 +52,144 @@ static const uint32_t version_strings[] = {
     0x1CC1A, 0x1D33F, 0x1ED75, 0x1F250, 0x209D5, 0x216F0, 0x228BA,
     0x2379F, 0x24B0B, 0x2542E, 0x26A64, 0x27541, 0x28C69};
 
-/**
- * Returns the Nth bit of bit string.
- *
- * @param b bit string.
- * @param n index of bit string.
- * @return Nth bit of bit string.
- */
-static int nth_bit(const uint8_t b[], int n) {
-    return b[n / 8] >> (7 - n % 8) & 1;
-}
+// function patterns of each version, built on first use
+static module_template_t templates[NUM_VERSIONS];
+static atomic_bool templates_built[NUM_VERSIONS];
+static pthread_mutex_t templates_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Place a horizontal line in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
  * @param y Y coordinate.
  * @param x leftmost X coordinate.
  * @param l horizontal line length.
- * @param t module type.
+ * @param b true for dark modules and false for light modules.
  */
-static void add_horizontal_line(int n, module_type_t m[][n], int y, int x,
-                                int l, module_type_t t) {
+static void add_horizontal_line(bitmatrix_t *m, int y, int x, int l, bool b) {
     for (int i = 0; i < l; i++)
-        m[y][x + i] = t;
+        bitmatrix_set(m, y, x + i, b);
 }
 
 /**
  * Place a vertical line in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
  * @param y topmost Y coordinate.
  * @param x X coordinate.
  * @param l vertical line length.
- * @param t module type.
+ * @param b true for dark modules and false for light modules.
  */
-static void add_vertical_line(int n, module_type_t m[][n], int y, int x, int l,
-                              module_type_t t) {
+static void add_vertical_line(bitmatrix_t *m, int y, int x, int l, bool b) {
     for (int i = 0; i < l; i++)
-        m[y + i][x] = t;
+        bitmatrix_set(m, y + i, x, b);
 }
 
 /**
  * Place a filled rectangle in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
  * @param y upper left Y coordinate.
  * @param x upper left X coordinate.
  * @param h rectangle height.
  * @param w rectangle width.
- * @param t module type.
+ * @param b true for dark modules and false for light modules.
  */
-static void add_filled_rectangle(int n, module_type_t m[][n], int y, int x,
-                                 int h, int w, module_type_t t) {
+static void add_filled_rectangle(bitmatrix_t *m, int y, int x, int h, int w,
+                                 bool b) {
     for (int i = 0; i < h; i++)
-        for (int j = 0; j < w; j++)
-            m[y + i][x + j] = t;
+        add_horizontal_line(m, y + i, x, w, b);
 }
 
 /**
  * Place a unfilled rectangle in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
  * @param y upper left Y coordinate.
  * @param x upper left X coordinate.
  * @param h rectangle height.
  * @param w rectangle width.
- * @param t module type.
+ * @param b true for dark modules and false for light modules.
  */
-static void add_unfilled_rectangle(int n, module_type_t m[][n], int y, int x,
-                                   int h, int w, module_type_t t) {
-    add_horizontal_line(n, m, y, x, w, t);
-    add_vertical_line(n, m, y + 1, x, h - 2, t);
-    add_vertical_line(n, m, y + 1, x + w - 1, h - 2, t);
-    add_horizontal_line(n, m, y + h - 1, x, w, t);
+static void add_unfilled_rectangle(bitmatrix_t *m, int y, int x, int h, int w,
+                                   bool b) {
+    add_horizontal_line(m, y, x, w, b);
+    add_vertical_line(m, y + 1, x, h - 2, b);
+    add_vertical_line(m, y + 1, x + w - 1, h - 2, b);
+    add_horizontal_line(m, y + h - 1, x, w, b);
 }
 
 /**
  * Place one finder pattern in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  * @param y upper left Y coordinate.
  * @param x upper left X coordinate.
  */
-static void add_finder_pattern(int n, module_type_t m[][n], int y, int x) {
-    add_filled_rectangle(n, m, y, x, 7, 7, MODULE_TYPE_DARK);
-    add_unfilled_rectangle(n, m, y + 1, x + 1, 5, 5, MODULE_TYPE_LIGHT);
+static void add_finder_pattern(bitmatrix_t *m, bitmatrix_t *f, int y, int x) {
+    add_filled_rectangle(m, y, x, 7, 7, true);
+    add_unfilled_rectangle(m, y + 1, x + 1, 5, 5, false);
+    add_filled_rectangle(f, y, x, 7, 7, false);
 }
 
 /**
  * Place finder patterns in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  */
-static void add_finder_patterns(int n, module_type_t m[][n]) {
-    add_finder_pattern(n, m, 0, 0);
-    add_finder_pattern(n, m, 0, n - 7);
-    add_finder_pattern(n, m, n - 7, 0);
+static void add_finder_patterns(bitmatrix_t *m, bitmatrix_t *f) {
+    int n = m->n;
+
+    add_finder_pattern(m, f, 0, 0);
+    add_finder_pattern(m, f, 0, n - 7);
+    add_finder_pattern(m, f, n - 7, 0);
 }
 
 /**
- * Place separators in the matrix.
+ * Place separators in the matrix. Separators are light, so only the data
+ * module flags are cleared.
  *
- * @param n matrix length.
- * @param m matrix.
+ * @param f data module flags.
  */
-static void add_separators(int n, module_type_t m[][n]) {
-    add_vertical_line(n, m, 0, 7, 7, MODULE_TYPE_LIGHT);
-    add_vertical_line(n, m, 0, n - 8, 7, MODULE_TYPE_LIGHT);
-    add_horizontal_line(n, m, 7, 0, 8, MODULE_TYPE_LIGHT);
-    add_horizontal_line(n, m, 7, n - 8, 8, MODULE_TYPE_LIGHT);
-    add_vertical_line(n, m, n - 7, 7, 7, MODULE_TYPE_LIGHT);
-    add_horizontal_line(n, m, n - 8, 0, 8, MODULE_TYPE_LIGHT);
+static void add_separators(bitmatrix_t *f) {
+    int n = f->n;
+
+    add_vertical_line(f, 0, 7, 7, false);
+    add_vertical_line(f, 0, n - 8, 7, false);
+    add_horizontal_line(f, 7, 0, 8, false);
+    add_horizontal_line(f, 7, n - 8, 8, false);
+    add_vertical_line(f, n - 7, 7, 7, false);
+    add_horizontal_line(f, n - 8, 0, 8, false);
 }
 
 /**
  * Place one alignment pattern in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  * @param y upper left Y coordinate.
  * @param x upper left X coordinate.
  */
-static void add_alignment_pattern(int n, module_type_t m[][n], int y, int x) {
-    add_filled_rectangle(n, m, y, x, 5, 5, MODULE_TYPE_DARK);
-    add_unfilled_rectangle(n, m, y + 1, x + 1, 3, 3, MODULE_TYPE_LIGHT);
+static void add_alignment_pattern(bitmatrix_t *m, bitmatrix_t *f, int y,
+                                  int x) {
+    add_filled_rectangle(m, y, x, 5, 5, true);
+    add_unfilled_rectangle(m, y + 1, x + 1, 3, 3, false);
+    add_filled_rectangle(f, y, x, 5, 5, false);
 }
 
 /**
  * Place alignment patterns in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  * @param v version.
  */
-static void add_alignment_patterns(int n, module_type_t m[][n], int v) {
-    add_alignment_pattern(n, m, n - 9, n - 9);
+static void add_alignment_patterns(bitmatrix_t *m, bitmatrix_t *f, int v) {
+    int n = m->n;
+
+    add_alignment_pattern(m, f, n - 9, n - 9);
 
     if (v < 6)
         return;
@@ -189,7 +199,7 @@ static void add_alignment_patterns(int n, module_type_t m[][n], int v) {
     for (int i = n - 9;; i = i - g > 6 ? i - g : 4) {
         for (int j = n - 9;; j = j - g > 6 ? j - g : 4) {
             if ((i != 4 && i != n - 9) || (j != 4 && j != n - 9))
-                add_alignment_pattern(n, m, i, j);
+                add_alignment_pattern(m, f, i, j);
 
             if (j == 4)
                 break;
@@ -203,65 +213,86 @@ static void add_alignment_patterns(int n, module_type_t m[][n], int v) {
 /**
  * Place timing patterns in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  */
-static void add_timing_patterns(int n, module_type_t m[][n]) {
+static void add_timing_patterns(bitmatrix_t *m, bitmatrix_t *f) {
+    int n = m->n;
+
     for (int i = 0; i < n - 16; i++)
-        m[6][8 + i] = i % 2 == 0 ? MODULE_TYPE_DARK : MODULE_TYPE_LIGHT;
+        bitmatrix_set(m, 6, 8 + i, i % 2 == 0);
 
     for (int i = 0; i < n - 16; i++)
-        m[8 + i][6] = i % 2 == 0 ? MODULE_TYPE_DARK : MODULE_TYPE_LIGHT;
+        bitmatrix_set(m, 8 + i, 6, i % 2 == 0);
+
+    add_horizontal_line(f, 6, 8, n - 16, false);
+    add_vertical_line(f, 8, 6, n - 16, false);
 }
 
 /**
  * Place a dark module at position (4V + 9, 8) in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  */
-static void add_dark_module(int n, module_type_t m[][n]) {
-    m[n - 8][8] = MODULE_TYPE_DARK;
+static void add_dark_module(bitmatrix_t *m, bitmatrix_t *f) {
+    bitmatrix_set(m, m->n - 8, 8, true);
+    bitmatrix_set(f, m->n - 8, 8, false);
 }
 
 /**
- * Reserve the format information area in the matrix.
+ * Reserve the format information area in the matrix. The area is left light
+ * until the format information is placed by masking.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  */
-static void reserve_format_info(int n, module_type_t m[][n]) {
-    add_vertical_line(n, m, 0, 8, 8, MODULE_TYPE_RESERVED);
-    add_horizontal_line(n, m, 8, 0, 9, MODULE_TYPE_RESERVED);
-    add_horizontal_line(n, m, 8, n - 8, 8, MODULE_TYPE_RESERVED);
-    add_vertical_line(n, m, n - 7, 8, 7, MODULE_TYPE_RESERVED);
+static void reserve_format_info(bitmatrix_t *m, bitmatrix_t *f) {
+    int n = m->n;
+
+    for (int i = 0; i < 2; i++) {
+        bitmatrix_t *t = i == 0 ? m : f;
+
+        add_vertical_line(t, 0, 8, 8, false);
+        add_horizontal_line(t, 8, 0, 9, false);
+        add_horizontal_line(t, 8, n - 8, 8, false);
+        add_vertical_line(t, n - 7, 8, 7, false);
+    }
 }
 
 /**
  * Place version information in the matrix.
  *
- * @param n matrix length.
  * @param m matrix.
+ * @param f data module flags.
  * @param v version.
  */
-static void add_version_info(int n, module_type_t m[][n], int v) {
+static void add_version_info(bitmatrix_t *m, bitmatrix_t *f, int v) {
+    int n = m->n;
+
     for (int i = 0; i < 6; i++)
         for (int j = 0; j < 3; j++)
-            m[i][n - 11 + j] = version_strings[v - 6] >> (i * 3 + j) & 1;
+            bitmatrix_set(m, i, n - 11 + j,
+                          version_strings[v - 6] >> (i * 3 + j) & 1);
 
     for (int i = 0; i < 3; i++)
         for (int j = 0; j < 6; j++)
-            m[n - 11 + i][j] = version_strings[v - 6] >> (i + j * 3) & 1;
+            bitmatrix_set(m, n - 11 + i, j,
+                          version_strings[v - 6] >> (i + j * 3) & 1);
+
+    add_filled_rectangle(f, 0, n - 11, 6, 3, false);
+    add_filled_rectangle(f, n - 11, 0, 3, 6, false);
 }
 
 /**
- * Place the data bits in the matrix.
+ * Record the positions of the data modules in the order of placement, which is
+ * upwards and downwards alternately in columns 2 modules wide from the right.
  *
- * @param n matrix length.
- * @param m matrix.
- * @param b data bits.
+ * @param t template with the data module flags built.
  */
-static void place_data_bits(int n, module_type_t m[][n], const uint8_t b[]) {
+static void build_data_positions(module_template_t *t) {
+    const bitmatrix_t *f = &t->flags;
+    int n = f->n;
     int y = n - 1;
     int v = -1;
     int k = 0;
@@ -269,12 +300,99 @@ static void place_data_bits(int n, module_type_t m[][n], const uint8_t b[]) {
     for (int x = n - 1; x > 0; x -= 2 + (x == 8)) {
         for (int i = 0; i < n; i++)
             for (int j = 0; j < 2; j++)
-                if (m[y + v * i][x - j] == MODULE_TYPE_NONE)
-                    m[y + v * i][x - j] = nth_bit(b, k++);
+                if (bitmatrix_get(f, y + v * i, x - j))
+                    t->positions[k++] =
+                        (y + v * i) * BITMATRIX_MAX_LENGTH + x - j;
 
         y ^= n - 1;
         v = -v;
     }
+
+    t->num_positions = k;
+}
+
+/**
+ * Place the data bits in the matrix. The data modules of the template are
+ * light, so each bit is ORed into its word without reading the flags.
+ *
+ * @param m matrix copied from the template.
+ * @param t template.
+ * @param b data bits.
+ */
+static void place_data_bits(bitmatrix_t *m, const module_template_t *t,
+                            const uint8_t b[]) {
+    uint64_t *w = &m->r[0][0];
+    const uint16_t *p = t->positions;
+    int l = t->num_positions;
+    int i = 0;
+
+    for (; i + 8 <= l; i += 8, p += 8) {
+        uint8_t c = b[i / 8];
+
+        for (int j = 0; j < 8; j++)
+            w[p[j] / BITMATRIX_WORD_BITS] |=
+                (uint64_t)(c >> (7 - j) & 1)
+                << (BITMATRIX_WORD_BITS - 1 - p[j] % BITMATRIX_WORD_BITS);
+    }
+
+    for (int j = 0; i < l; i++, j++)
+        w[p[j] / BITMATRIX_WORD_BITS] |=
+            (uint64_t)(b[i / 8] >> (7 - i % 8) & 1)
+            << (BITMATRIX_WORD_BITS - 1 - p[j] % BITMATRIX_WORD_BITS);
+}
+
+/**
+ * Build the template of the version, which has all function patterns placed,
+ * no data bits and the positions of the data modules.
+ *
+ * @param t template.
+ * @param v version.
+ */
+static void build_template(module_template_t *t, int v) {
+    bitmatrix_t *m = &t->modules;
+    bitmatrix_t *f = &t->flags;
+    int n = matrix_length(v);
+
+    bitmatrix_fill(m, n, false);
+    bitmatrix_fill(f, n, true);
+
+    add_finder_patterns(m, f);
+    add_separators(f);
+
+    if (v >= 1)
+        add_alignment_patterns(m, f, v);
+
+    reserve_format_info(m, f);
+    add_timing_patterns(m, f);
+    add_dark_module(m, f);
+
+    if (v >= 6)
+        add_version_info(m, f, v);
+
+    build_data_positions(t);
+}
+
+/**
+ * Returns the template of the version, building it if it is the first use.
+ * Safe to call from multiple threads.
+ *
+ * @param v version.
+ * @return template.
+ */
+static const module_template_t *get_template(int v) {
+    if (!atomic_load_explicit(&templates_built[v], memory_order_acquire)) {
+        pthread_mutex_lock(&templates_mutex);
+
+        if (!atomic_load_explicit(&templates_built[v], memory_order_relaxed)) {
+            build_template(&templates[v], v);
+            atomic_store_explicit(&templates_built[v], true,
+                                  memory_order_release);
+        }
+
+        pthread_mutex_unlock(&templates_mutex);
+    }
+
+    return &templates[v];
 }
 
 /**
@@ -290,32 +408,17 @@ int matrix_length(int v) {
 /**
  * Place modules in matrix.
  *
- * @param n matrix length.
  * @param m matrix.
- * @param f true if modules to be applied masking and false otherwise.
+ * @param f data module flags, set for modules to be applied masking and clear
+ * for function patterns.
  * @param b final message.
  * @param v version.
  */
-void place_modules(int n, module_type_t m[][n], bool f[][n], const uint8_t b[],
-                   int v) {
-    add_filled_rectangle(n, m, 0, 0, n, n, MODULE_TYPE_NONE);
-
-    add_finder_patterns(n, m);
-    add_separators(n, m);
-
-    if (v >= 1)
-        add_alignment_patterns(n, m, v);
-
-    reserve_format_info(n, m);
-    add_timing_patterns(n, m);
-    add_dark_module(n, m);
-
-    if (v >= 6)
-        add_version_info(n, m, v);
+void place_modules(bitmatrix_t *m, bitmatrix_t *f, const uint8_t b[], int v) {
+    const module_template_t *t = get_template(v);
 
-    for (int i = 0; i < n; i++)
-        for (int j = 0; j < n; j++)
-            f[i][j] = m[i][j] == MODULE_TYPE_NONE;
+    *m = t->modules;
+    *f = t->flags;
 
-    place_data_bits(n, m, b);
+    place_data_bits(m, t, b);
 }
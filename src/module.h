@@ -27,12 +27,11 @@
 #ifndef MODULE_H
 #define MODULE_H
 
-#include <stdbool.h>
 #include <stdint.h>
-#include "typedefs.h"
+#include "bitmatrix.h"
 
 extern int matrix_length(int v);
-extern void place_modules(int n, module_type_t m[][n], bool f[][n],
-                          const uint8_t b[], int v);
+extern void place_modules(bitmatrix_t *m, bitmatrix_t *f, const uint8_t b[],
+                          int v);
 
 #endif /* MODULE_H */
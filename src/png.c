@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file png.c
+ * @brief png implementation
+ */
+#include <string.h>
+#include "deflate.h"
+#include "image.h"
+#include "png.h"
+#include "crc32_table.h"
+
+#define PNG_BIT_DEPTH 1
+#define PNG_COLOR_TYPE_GRAYSCALE 0
+#define PNG_IHDR_LENGTH 13
+
+static const uint8_t png_signature[] = {0x89, 'P',  'N',  'G',
+                                        '\r', '\n', 0x1A, '\n'};
+
+/**
+ * Update the CRC-32 checksum, a byte at a time through the table generated by
+ * gen_crc32.
+ *
+ * @param c checksum, 0 for no data.
+ * @param d data.
+ * @param n data length.
+ * @return updated checksum.
+ */
+uint32_t png_crc32(uint32_t c, const uint8_t d[], size_t n) {
+    c = ~c;
+
+    for (size_t i = 0; i < n; i++)
+        c = c >> 8 ^ crc32_table[(c ^ d[i]) & 0xFF];
+
+    return ~c;
+}
+
+/**
+ * Write a 32-bit big-endian integer.
+ *
+ * @param d destination.
+ * @param v integer.
+ */
+static void put_uint32_be(uint8_t d[], uint32_t v) {
+    d[0] = v >> 24;
+    d[1] = v >> 16;
+    d[2] = v >> 8;
+    d[3] = v;
+}
+
+/**
+ * Write a chunk.
+ *
+ * @param w stream.
+ * @param t chunk type.
+ * @param d chunk data.
+ * @param n chunk data length.
+ */
+static void write_chunk(image_stream_t *w, const char t[4], const uint8_t d[],
+                        size_t n) {
+    uint8_t h[8];
+    uint8_t c[4];
+
+    put_uint32_be(h, n);
+    memcpy(&h[4], t, 4);
+    put_uint32_be(c, png_crc32(png_crc32(0, &h[4], 4), d, n));
+
+    image_stream_write(w, h, sizeof(h));
+    image_stream_write(w, d, n);
+    image_stream_write(w, c, sizeof(c));
+}
+
+/**
+ * Write compressed image data as an IDAT chunk.
+ *
+ * @param a stream.
+ * @param d compressed image data.
+ * @param n compressed image data length.
+ */
+static void write_idat(void *a, const uint8_t d[], size_t n) {
+    write_chunk(a, "IDAT", d, n);
+}
+
+/**
+ * Render one row of modules as a scanline. Light pixels are 1 and dark pixels
+ * are 0.
+ *
+ * @param r scanline.
+ * @param t scaler.
+ * @param m matrix.
+ * @param y Y coordinate of the module row, or outside of the matrix for the
+ * quiet zone.
+ * @param l scanline length.
+ */
+static void render_scanline(uint8_t r[], const image_scaler_t *t,
+                            const bitmatrix_t *m, int y, int l) {
+    image_scale_row(t, r, m, y);
+
+    for (int i = 0; i < l; i++)
+        r[i] = ~r[i];
+}
+
+/**
+ * Returns the sum of the filtered bytes as signed values, the heuristic used
+ * to select a filter.
+ *
+ * @param f filtered scanline.
+ * @param l scanline length.
+ * @return sum of absolute values.
+ */
+static int filter_cost(const uint8_t f[], int l) {
+    int c = 0;
+
+    for (int i = 0; i < l; i++)
+        c += f[i] < 128 ? f[i] : 256 - f[i];
+
+    return c;
+}
+
+/**
+ * Filter a scanline into a row of the image data.
+ *
+ * @param d row, the filter type followed by the filtered scanline.
+ * @param r scanline.
+ * @param p previous scanline, 0 for the first one.
+ * @param l scanline length.
+ * @param t filter.
+ */
+static void filter_scanline(uint8_t d[], const uint8_t r[], const uint8_t p[],
+                            int l, png_filter_t t) {
+    if (t == PNG_FILTER_AUTO) {
+        png_filter_t b = PNG_FILTER_NONE;
+        int c = filter_cost(r, l);
+
+        for (png_filter_t f = PNG_FILTER_SUB; f <= PNG_FILTER_UP; f++) {
+            filter_scanline(d, r, p, l, f);
+
+            int k = filter_cost(&d[1], l);
+
+            if (k < c) {
+                b = f;
+                c = k;
+            }
+        }
+
+        t = b;
+    }
+
+    d[0] = t;
+
+    for (int i = 0; i < l; i++) {
+        switch (t) {
+        case PNG_FILTER_SUB:
+            d[i + 1] = r[i] - (i > 0 ? r[i - 1] : 0);
+            break;
+
+        case PNG_FILTER_UP:
+            d[i + 1] = r[i] - p[i];
+            break;
+
+        default:
+            d[i + 1] = r[i];
+            break;
+        }
+    }
+}
+
+/**
+ * Write the matrix as a 1-bit grayscale PNG image.
+ *
+ * @param w stream.
+ * @param m matrix.
+ * @param o options.
+ */
+static void write_image(image_stream_t *w, const bitmatrix_t *m,
+                        const png_options_t *o) {
+    int width = (m->n + o->quiet_zone * 2) * o->scale;
+    int stride = (width + 7) / 8;
+    uint8_t h[PNG_IHDR_LENGTH];
+    uint8_t scanlines[2][IMAGE_MAX_ROW_BYTES] = {{0}};
+    uint8_t row[IMAGE_MAX_ROW_BYTES + 1];
+    image_scaler_t t;
+    deflate_t z;
+
+    image_stream_write(w, png_signature, sizeof(png_signature));
+
+    put_uint32_be(&h[0], width);
+    put_uint32_be(&h[4], width);
+    h[8] = PNG_BIT_DEPTH;
+    h[9] = PNG_COLOR_TYPE_GRAYSCALE;
+    h[10] = 0;
+    h[11] = 0;
+    h[12] = 0;
+
+    write_chunk(w, "IHDR", h, sizeof(h));
+
+    image_scaler_init(&t, o->scale, o->quiet_zone);
+    deflate_init(&z, write_idat, w);
+
+    for (int y = -o->quiet_zone; y < m->n + o->quiet_zone; y++) {
+        uint8_t *r = scanlines[(y + o->quiet_zone) % 2];
+        const uint8_t *p = scanlines[(y + o->quiet_zone + 1) % 2];
+
+        render_scanline(r, &t, m, y, stride);
+
+        // each pixel row of the module row is the same
+        for (int i = 0; i < o->scale; i++) {
+            filter_scanline(row, r, p, stride, o->filter);
+            deflate_row(&z, row, stride + 1);
+            p = r;
+        }
+    }
+
+    deflate_finish(&z);
+
+    write_chunk(w, "IEND", NULL, 0);
+    image_stream_flush(w);
+}
+
+/**
+ * Stream the matrix as a 1-bit grayscale PNG image. The scanlines are
+ * compressed as they are rendered, so only a few of them are in memory at a
+ * time.
+ *
+ * @param m matrix.
+ * @param o options.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_png(const bitmatrix_t *m, const png_options_t *o, image_sink_t k,
+                void *a) {
+    image_stream_t w;
+
+    image_stream_init(&w, k, a);
+    write_image(&w, m, o);
+}
+
+/**
+ * Encode the matrix as a 1-bit grayscale PNG image into a buffer, like
+ * snprintf(). The image is only complete if its length is at most \a n.
+ *
+ * @param d buffer.
+ * @param n buffer length.
+ * @param m matrix.
+ * @param o options.
+ * @return image length.
+ */
+size_t encode_png(uint8_t d[], size_t n, const bitmatrix_t *m,
+                  const png_options_t *o) {
+    image_buffer_t b = {d, n, 0};
+
+    stream_png(m, o, image_buffer_sink, &b);
+
+    return b.length;
+}
+
+/**
+ * Write the matrix as a 1-bit grayscale PNG image.
+ *
+ * @param m matrix.
+ * @param o options.
+ * @param f output stream.
+ */
+void write_png(const bitmatrix_t *m, const png_options_t *o, FILE *f) {
+    stream_png(m, o, image_file_sink, f);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file png.h
+ * @brief png header
+ */
+#ifndef PNG_H
+#define PNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bitmatrix.h"
+#include "image.h"
+
+typedef enum {
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AUTO
+} png_filter_t;
+
+typedef struct png_options {
+    int scale;
+    int quiet_zone;
+    png_filter_t filter;
+} png_options_t;
+
+extern uint32_t png_crc32(uint32_t c, const uint8_t d[], size_t n);
+extern void stream_png(const bitmatrix_t *m, const png_options_t *o,
+                       image_sink_t k, void *a);
+extern size_t encode_png(uint8_t d[], size_t n, const bitmatrix_t *m,
+                         const png_options_t *o);
+extern void write_png(const bitmatrix_t *m, const png_options_t *o, FILE *f);
+
+#endif /* PNG_H */
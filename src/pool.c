@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file pool.c
+ * @brief pool implementation
+ *
+ * A fixed set of workers runs the tasks of one job at a time. The tasks of a
+ * job are split into contiguous ranges, one per worker deque. A worker takes
+ * tasks from the front of its own deque and, once it is empty, steals the back
+ * half of the deque of another worker.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "pool.h"
+
+#define POOL_STACK_SIZE (8 * 1024 * 1024)
+
+typedef struct deque {
+    pthread_mutex_t mutex;
+    int front;
+    int back;
+} deque_t;
+
+typedef struct worker {
+    pool_t *pool;
+    int index;
+    pthread_t thread;
+} worker_t;
+
+struct pool {
+    int num_workers;
+    deque_t *deques;
+    worker_t *workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t job_started;
+    pthread_cond_t job_finished;
+    unsigned generation;
+    int num_finished;
+    bool shutdown;
+
+    pool_task_t task;
+    void *arg;
+};
+
+/**
+ * Take the task at the front of the deque.
+ *
+ * @param d deque.
+ * @return task index, or -1 if the deque is empty.
+ */
+static int take_task(deque_t *d) {
+    int i = -1;
+
+    pthread_mutex_lock(&d->mutex);
+
+    if (d->front < d->back)
+        i = d->front++;
+
+    pthread_mutex_unlock(&d->mutex);
+
+    return i;
+}
+
+/**
+ * Move the back half of the deque of another worker to the deque of the
+ * worker.
+ *
+ * @param p pool.
+ * @param w worker index.
+ * @return true if any task was stolen and false if all deques are empty.
+ */
+static bool steal_tasks(pool_t *p, int w) {
+    for (int i = 1; i < p->num_workers; i++) {
+        deque_t *v = &p->deques[(w + i) % p->num_workers];
+        int front;
+        int back;
+
+        pthread_mutex_lock(&v->mutex);
+
+        back = v->back;
+        front = v->front + (v->back - v->front) / 2;
+        v->back = front;
+
+        pthread_mutex_unlock(&v->mutex);
+
+        if (front < back) {
+            deque_t *d = &p->deques[w];
+
+            pthread_mutex_lock(&d->mutex);
+            d->front = front;
+            d->back = back;
+            pthread_mutex_unlock(&d->mutex);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Run tasks of the current job until no task is left.
+ *
+ * @param p pool.
+ * @param w worker index.
+ */
+static void run_tasks(pool_t *p, int w) {
+    do {
+        int i;
+
+        while ((i = take_task(&p->deques[w])) >= 0)
+            p->task(p->arg, i, w);
+
+    } while (steal_tasks(p, w));
+}
+
+/**
+ * Worker thread main loop.
+ *
+ * @param a worker.
+ * @return NULL.
+ */
+static void *work(void *a) {
+    worker_t *w = a;
+    pool_t *p = w->pool;
+    unsigned generation = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&p->mutex);
+
+        while (!p->shutdown && p->generation == generation)
+            pthread_cond_wait(&p->job_started, &p->mutex);
+
+        if (p->shutdown) {
+            pthread_mutex_unlock(&p->mutex);
+            return NULL;
+        }
+
+        generation = p->generation;
+        pthread_mutex_unlock(&p->mutex);
+
+        run_tasks(p, w->index);
+
+        pthread_mutex_lock(&p->mutex);
+
+        if (++p->num_finished == p->num_workers - 1)
+            pthread_cond_signal(&p->job_finished);
+
+        pthread_mutex_unlock(&p->mutex);
+    }
+}
+
+/**
+ * Create a pool. The calling thread of pool_run() acts as one of the workers,
+ * so n - 1 threads are started.
+ *
+ * @param n number of workers.
+ * @return pool, or NULL on failure.
+ */
+pool_t *pool_create(int n) {
+    pool_t *p = calloc(1, sizeof(pool_t));
+
+    if (p == NULL)
+        return NULL;
+
+    p->num_workers = n < 1 ? 1 : n;
+    p->deques = calloc(p->num_workers, sizeof(deque_t));
+    p->workers = calloc(p->num_workers, sizeof(worker_t));
+
+    if (p->deques == NULL || p->workers == NULL) {
+        free(p->deques);
+        free(p->workers);
+        free(p);
+        return NULL;
+    }
+
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->job_started, NULL);
+    pthread_cond_init(&p->job_finished, NULL);
+
+    for (int i = 0; i < p->num_workers; i++) {
+        pthread_mutex_init(&p->deques[i].mutex, NULL);
+        p->workers[i].pool = p;
+        p->workers[i].index = i;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, POOL_STACK_SIZE);
+
+    for (int i = 1; i < p->num_workers; i++) {
+        if (pthread_create(&p->workers[i].thread, &attr, work,
+                           &p->workers[i]) != 0) {
+            p->num_workers = i;
+            break;
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return p;
+}
+
+/**
+ * Stop the workers and free the pool.
+ *
+ * @param p pool.
+ */
+void pool_destroy(pool_t *p) {
+    if (p == NULL)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    p->shutdown = true;
+    pthread_cond_broadcast(&p->job_started);
+    pthread_mutex_unlock(&p->mutex);
+
+    for (int i = 1; i < p->num_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    for (int i = 0; i < p->num_workers; i++)
+        pthread_mutex_destroy(&p->deques[i].mutex);
+
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->job_started);
+    pthread_cond_destroy(&p->job_finished);
+
+    free(p->deques);
+    free(p->workers);
+    free(p);
+}
+
+/**
+ * Returns the number of workers.
+ *
+ * @param p pool.
+ * @return number of workers.
+ */
+int pool_size(const pool_t *p) {
+    return p == NULL ? 1 : p->num_workers;
+}
+
+/**
+ * Run tasks 0 to n - 1 on the workers and wait for all of them to finish.
+ *
+ * @param p pool, or NULL to run the tasks on the calling thread.
+ * @param n number of tasks.
+ * @param t task.
+ * @param a task argument.
+ */
+void pool_run(pool_t *p, int n, pool_task_t t, void *a) {
+    if (p == NULL || p->num_workers == 1) {
+        for (int i = 0; i < n; i++)
+            t(a, i, 0);
+
+        return;
+    }
+
+    for (int i = 0; i < p->num_workers; i++) {
+        p->deques[i].front = (long)n * i / p->num_workers;
+        p->deques[i].back = (long)n * (i + 1) / p->num_workers;
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    p->task = t;
+    p->arg = a;
+    p->num_finished = 0;
+    p->generation++;
+    pthread_cond_broadcast(&p->job_started);
+    pthread_mutex_unlock(&p->mutex);
+
+    run_tasks(p, 0);
+
+    pthread_mutex_lock(&p->mutex);
+
+    while (p->num_finished < p->num_workers - 1)
+        pthread_cond_wait(&p->job_finished, &p->mutex);
+
+    pthread_mutex_unlock(&p->mutex);
+}
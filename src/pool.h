@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file pool.h
+ * @brief pool header
+ */
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct pool pool_t;
+
+/**
+ * Task run by the pool.
+ *
+ * @param a task argument.
+ * @param i task index.
+ * @param w index of the worker running the task.
+ */
+typedef void (*pool_task_t)(void *a, int i, int w);
+
+extern pool_t *pool_create(int n);
+extern void pool_destroy(pool_t *p);
+extern int pool_size(const pool_t *p);
+extern void pool_run(pool_t *p, int n, pool_task_t t, void *a);
+
+#endif /* POOL_H */
@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file qrcg.c
+ * @brief qrcg library implementation
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "encode.h"
+#include "gf256.h"
+#include "mask.h"
+#include "message.h"
+#include "module.h"
+#include "qrcg.h"
+
+#define MAX_DATA_CODEWORDS_PER_BLOCK 123
+#define MAX_EC_CODEWORDS_PER_BLOCK 30
+#define MAX_INCREMENTAL_FRACTION 4
+#define MIN_PARALLEL_BLOCKS 8
+#define MAX_VERSION 39
+
+typedef struct ec_job {
+    qrcg_ctx_t *ctx;
+    rs_block_info_t blocks;
+    bool incremental;
+} ec_job_t;
+
+struct qrcg_ctx {
+    segment_t segments[QRCG_MAX_DATA_LENGTH];
+    segment_buffers_t segment_buffers;
+    uint8_t data_codewords[QRCG_MAX_CODEWORDS];
+    uint8_t ec_codewords[QRCG_MAX_CODEWORDS];
+    uint8_t final_message[QRCG_MAX_CODEWORDS + 1];
+
+    int genpoly_length;
+    const uint8_t *genpoly;
+
+    int remainders_length;
+    uint8_t position_remainders[MAX_DATA_CODEWORDS_PER_BLOCK *
+                                MAX_EC_CODEWORDS_PER_BLOCK];
+
+    int previous_version;
+    error_correction_level_t previous_ec_level;
+    uint8_t previous_data_codewords[QRCG_MAX_CODEWORDS];
+
+    bitmatrix_t matrix;
+    bitmatrix_t mask_flags;
+    mask_state_t masks;
+
+    pool_t *pool;
+};
+
+/**
+ * Create a context. All buffers needed to generate a QR code of any version are
+ * allocated here, so that qrcg_encode() neither allocates memory nor uses a
+ * large amount of stack.
+ *
+ * @return context, or NULL if out of memory.
+ */
+qrcg_ctx_t *qrcg_ctx_new(void) {
+    qrcg_ctx_t *c = malloc(sizeof(qrcg_ctx_t));
+
+    if (c != NULL) {
+        c->genpoly_length = 0;
+        c->remainders_length = 0;
+        c->previous_version = -1;
+        c->pool = NULL;
+        mask_state_reset(&c->masks);
+    }
+
+    return c;
+}
+
+/**
+ * Set the pool on which the mask patterns and the error correction blocks of
+ * large symbols are evaluated concurrently. The pool must not be the one
+ * running the calling task of qrcg_encode().
+ *
+ * @param c context.
+ * @param p pool, or NULL to evaluate everything on the calling thread.
+ */
+void qrcg_ctx_set_pool(qrcg_ctx_t *c, pool_t *p) {
+    c->pool = p;
+}
+
+/**
+ * Free the context.
+ *
+ * @param c context.
+ */
+void qrcg_ctx_free(qrcg_ctx_t *c) {
+    free(c);
+}
+
+/**
+ * Update the error correction codewords of a block, which hold those of the
+ * previous symbol, touching only the data codewords that changed. Falls back to
+ * the full division when so many changed that it would be faster.
+ *
+ * @param c context.
+ * @param r error correction codewords of the block.
+ * @param l number of data codewords in the block.
+ * @param m data codewords of the block.
+ * @param p data codewords of the block in the previous symbol.
+ */
+static void update_ec_codewords(qrcg_ctx_t *c, uint8_t r[], int l,
+                                const uint8_t m[], const uint8_t p[]) {
+    int changes = 0;
+
+    for (int i = 0; i < l; i++)
+        changes += m[i] != p[i];
+
+    if (changes == 0)
+        return;
+
+    if (changes > l / MAX_INCREMENTAL_FRACTION) {
+        gf256_divpoly(r, l, m, c->genpoly_length, c->genpoly);
+        return;
+    }
+
+    for (int i = 0; i < l; i++) {
+        if (m[i] != p[i]) {
+            const uint8_t *t =
+                &c->position_remainders[(l - 1 - i) * c->genpoly_length];
+
+            gf256_update_remainder(r, c->genpoly_length, t, m[i] ^ p[i]);
+        }
+    }
+}
+
+/**
+ * Calculate the error correction codewords of one block.
+ *
+ * @param a error correction job.
+ * @param i block index.
+ * @param w unused.
+ */
+static void encode_block(void *a, int i, int w) {
+    ec_job_t *j = a;
+    qrcg_ctx_t *c = j->ctx;
+    rs_block_info_t b = j->blocks;
+
+    (void)w;
+
+    int l = i < b.num_blocks1 ? b.num_data_codewords1 : b.num_data_codewords2;
+    int d_index = i < b.num_blocks1
+                      ? i * l
+                      : b.num_blocks1 * b.num_data_codewords1 +
+                            (i - b.num_blocks1) * l;
+    int e_index = i * b.num_ec_codewords;
+
+    if (j->incremental)
+        update_ec_codewords(c, &c->ec_codewords[e_index], l,
+                            &c->data_codewords[d_index],
+                            &c->previous_data_codewords[d_index]);
+    else
+        gf256_divpoly(&c->ec_codewords[e_index], l, &c->data_codewords[d_index],
+                      c->genpoly_length, c->genpoly);
+}
+
+/**
+ * Calculate the error correction codewords of all blocks. If the previous
+ * symbol generated with the context has the same version and error correction
+ * level, only the blocks whose data codewords changed are updated. The blocks
+ * are encoded concurrently on the pool of the context when there are at least
+ * MIN_PARALLEL_BLOCKS of them.
+ *
+ * @param c context.
+ * @param v version.
+ * @param e error correction level.
+ * @param b reed-solomon block information.
+ */
+static void encode_ec_codewords(qrcg_ctx_t *c, int v,
+                                error_correction_level_t e,
+                                rs_block_info_t b) {
+    if (c->genpoly_length != b.num_ec_codewords) {
+        c->genpoly_length = b.num_ec_codewords;
+        c->genpoly = gf256_genpoly_for(c->genpoly_length);
+        c->remainders_length = 0;
+    }
+
+    int n = b.num_blocks1 + b.num_blocks2;
+    ec_job_t j = {c, b, c->previous_version == v && c->previous_ec_level == e};
+
+    // shared by the blocks, so built before they are encoded
+    if (j.incremental && c->remainders_length != c->genpoly_length) {
+        c->remainders_length = c->genpoly_length;
+        gf256_position_remainders(MAX_DATA_CODEWORDS_PER_BLOCK,
+                                  c->genpoly_length, c->genpoly,
+                                  c->position_remainders);
+    }
+
+    pool_run(n >= MIN_PARALLEL_BLOCKS ? c->pool : NULL, n, encode_block, &j);
+
+    int d_length = b.num_blocks1 * b.num_data_codewords1 +
+                   b.num_blocks2 * b.num_data_codewords2;
+
+    memcpy(c->previous_data_codewords, c->data_codewords, d_length);
+    c->previous_version = v;
+    c->previous_ec_level = e;
+}
+
+/**
+ * Generate a QR code. The modules of the symbol are stored in the context and
+ * remain valid until the next call with the same context.
+ *
+ * @param c context.
+ * @param s input string.
+ * @param l input string length.
+ * @param e error correction level.
+ * @param o symbol.
+ * @return 0 on success and QRCG_ERROR_TOO_LONG if the data is too long.
+ */
+int qrcg_encode(qrcg_ctx_t *c, const uint8_t s[], int l,
+                error_correction_level_t e, qrcg_symbol_t *o) {
+    return qrcg_encode_part(c, s, l, e, NULL, o);
+}
+
+/**
+ * Split the input string into the longest parts that fit in symbols of the
+ * version after the structured append header. A part never ends inside a
+ * kanji character.
+ *
+ * @param c context.
+ * @param x class map of the input string.
+ * @param l input string length.
+ * @param e error correction level.
+ * @param v version.
+ * @param p parts, room for QRCG_MAX_SYMBOLS parts.
+ * @return number of parts, or QRCG_MAX_SYMBOLS + 1 if more are needed.
+ */
+static int split_parts(qrcg_ctx_t *c, const uint8_t x[], int l,
+                       error_correction_level_t e, int v, qrcg_part_t p[]) {
+    int b = num_data_codewords(v, e) * 8 - STRUCTURED_APPEND_HEADER_LEN;
+    int n = 0;
+
+    for (int i = 0; i < l; n++) {
+        int k = l - i < QRCG_MAX_DATA_LENGTH ? l - i : QRCG_MAX_DATA_LENGTH;
+
+        if (n == QRCG_MAX_SYMBOLS)
+            return QRCG_MAX_SYMBOLS + 1;
+
+        k = max_segmented_length(k, &x[i], v, b, &c->segment_buffers);
+
+        if (k == 0)
+            return QRCG_MAX_SYMBOLS + 1;
+
+        p[n] = (qrcg_part_t){i, k};
+        i += k;
+    }
+
+    return n;
+}
+
+/**
+ * Split an input string that is too long for one symbol into the parts of a
+ * structured append of up to QRCG_MAX_SYMBOLS symbols, so that the largest
+ * symbol has the smallest version. The versions are tried from the smallest,
+ * and each part but the last is the longest that fits in a symbol of the
+ * first version that takes few enough parts. An input string that fits in one
+ * symbol is one part, which is encoded without a structured append header.
+ *
+ * @param c context, whose buffers are used.
+ * @param s input string.
+ * @param l input string length.
+ * @param e error correction level.
+ * @param p parts, room for QRCG_MAX_SYMBOLS parts.
+ * @return number of parts, or QRCG_ERROR_TOO_LONG if the data is too long.
+ */
+int qrcg_split(qrcg_ctx_t *c, const uint8_t s[], int l,
+               error_correction_level_t e, qrcg_part_t p[]) {
+    uint8_t *x = c->segment_buffers.classes;
+    int k;
+
+    if (l > QRCG_MAX_DATA_LENGTH * QRCG_MAX_SYMBOLS)
+        return QRCG_ERROR_TOO_LONG;
+
+    classify_data(l, s, x);
+
+    if (l <= QRCG_MAX_DATA_LENGTH &&
+        min_segmented_version(l, x, e, &k, c->segments,
+                              &c->segment_buffers) >= 0) {
+        p[0] = (qrcg_part_t){0, l};
+        return 1;
+    }
+
+    // fewer parts are not always needed in a larger version, whose character
+    // count indicators may be longer
+    for (int v = 0; v <= MAX_VERSION; v++)
+        if ((k = split_parts(c, x, l, e, v, p)) <= QRCG_MAX_SYMBOLS)
+            return k;
+
+    return QRCG_ERROR_TOO_LONG;
+}
+
+/**
+ * Returns the parity data of a structured append, the exclusive or of every
+ * byte of the whole input string.
+ *
+ * @param s input string.
+ * @param l input string length.
+ * @return parity data.
+ */
+uint8_t qrcg_parity(const uint8_t s[], int l) {
+    uint8_t p = 0;
+
+    for (int i = 0; i < l; i++)
+        p ^= s[i];
+
+    return p;
+}
+
+/**
+ * Generate one symbol of a structured append, like qrcg_encode(), with the
+ * header holding its position and the parity data before the segments.
+ *
+ * @param c context.
+ * @param s part of the input string.
+ * @param l part length.
+ * @param e error correction level.
+ * @param a structured append, or NULL for a symbol on its own.
+ * @param o symbol.
+ * @return 0 on success and QRCG_ERROR_TOO_LONG if the data is too long.
+ */
+int qrcg_encode_part(qrcg_ctx_t *c, const uint8_t s[], int l,
+                     error_correction_level_t e, const structured_append_t *a,
+                     qrcg_symbol_t *o) {
+    if (l > QRCG_MAX_DATA_LENGTH)
+        return QRCG_ERROR_TOO_LONG;
+
+    int k;
+
+    classify_data(l, s, c->segment_buffers.classes);
+
+    int v = min_appended_version(l, c->segment_buffers.classes, e, a, &k,
+                                 c->segments, &c->segment_buffers);
+
+    if (v < 0)
+        return QRCG_ERROR_TOO_LONG;
+
+    int n = num_data_codewords(v, e);
+
+    encode_appended_segments(n, c->data_codewords, a, s, k, c->segments, v);
+
+    rs_block_info_t b = rs_block_information(v, e);
+
+    encode_ec_codewords(c, v, e, b);
+    build_final_message(c->final_message, c->data_codewords, c->ec_codewords, v,
+                        e);
+
+    place_modules(&c->matrix, &c->mask_flags, c->final_message, v);
+
+    o->version = v;
+    o->ec_level = e;
+    o->length = c->matrix.n;
+    o->mask = mask_modules_update(&c->masks, &c->matrix, &c->mask_flags, e,
+                                  c->pool);
+    o->modules = &c->masks.candidates[o->mask];
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file qrcg.h
+ * @brief qrcg library header
+ */
+#ifndef QRCG_H
+#define QRCG_H
+
+#include <stdint.h>
+#include "bitmatrix.h"
+#include "pool.h"
+#include "typedefs.h"
+
+#define QRCG_MAX_DATA_LENGTH 7089
+#define QRCG_MAX_CODEWORDS 3706
+#define QRCG_MAX_MATRIX_LENGTH 177
+#define QRCG_MAX_SYMBOLS 16
+
+#define QRCG_ERROR_TOO_LONG (-1)
+
+// changed whenever the symbols or the images generated for the same input and
+// options change, so that cached images of an earlier build are not used
+#define QRCG_OUTPUT_VERSION 1
+
+typedef struct qrcg_ctx qrcg_ctx_t;
+
+typedef struct qrcg_part {
+    int offset;
+    int length;
+} qrcg_part_t;
+
+typedef struct qrcg_symbol {
+    int version;
+    error_correction_level_t ec_level;
+    int length;
+    int mask;
+    const bitmatrix_t *modules;
+} qrcg_symbol_t;
+
+extern qrcg_ctx_t *qrcg_ctx_new(void);
+extern void qrcg_ctx_free(qrcg_ctx_t *c);
+extern void qrcg_ctx_set_pool(qrcg_ctx_t *c, pool_t *p);
+extern int qrcg_encode(qrcg_ctx_t *c, const uint8_t s[], int l,
+                       error_correction_level_t e, qrcg_symbol_t *o);
+extern int qrcg_split(qrcg_ctx_t *c, const uint8_t s[], int l,
+                      error_correction_level_t e, qrcg_part_t p[]);
+extern uint8_t qrcg_parity(const uint8_t s[], int l);
+extern int qrcg_encode_part(qrcg_ctx_t *c, const uint8_t s[], int l,
+                            error_correction_level_t e,
+                            const structured_append_t *a, qrcg_symbol_t *o);
+
+#endif /* QRCG_H */
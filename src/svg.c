@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file svg.c
+ * @brief svg implementation
+ */
+#include "svg.h"
+
+#define SVG_MAX_VERTICES (BITMATRIX_MAX_LENGTH + 1)
+
+typedef enum {
+    DIRECTION_RIGHT,
+    DIRECTION_DOWN,
+    DIRECTION_LEFT,
+    DIRECTION_UP
+} direction_t;
+
+static const int direction_dx[] = {1, 0, -1, 0};
+static const int direction_dy[] = {0, 1, 0, -1};
+
+typedef struct svg_writer {
+    image_stream_t stream;
+    char last;
+} svg_writer_t;
+
+/**
+ * Write characters to the stream.
+ *
+ * @param w writer.
+ * @param s characters.
+ * @param n number of characters.
+ */
+static void emit(svg_writer_t *w, const char s[], size_t n) {
+    if (n == 0)
+        return;
+
+    image_stream_write(&w->stream, (const uint8_t *)s, n);
+    w->last = s[n - 1];
+}
+
+/**
+ * Write a path command with one number. A separator is only written between
+ * two numbers that would otherwise run together.
+ *
+ * @param w writer.
+ * @param c command, or 0 to continue the previous command.
+ * @param v number.
+ */
+static void emit_command(svg_writer_t *w, char c, int v) {
+    char t[16];
+    int l = sizeof(t);
+    unsigned u = v < 0 ? -(unsigned)v : (unsigned)v;
+
+    do {
+        t[--l] = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+
+    if (v < 0)
+        t[--l] = '-';
+
+    if (c != 0)
+        t[--l] = c;
+    else if (v >= 0 && w->last >= '0' && w->last <= '9')
+        t[--l] = ' ';
+
+    emit(w, &t[l], sizeof(t) - l);
+}
+
+/**
+ * Write a move to a point relative to the start of the previous subpath,
+ * which is the current point after a closepath.
+ *
+ * @param w writer.
+ * @param x x coordinate.
+ * @param y y coordinate.
+ * @param p start of the previous subpath, updated to (\a x, \a y).
+ */
+static void emit_move(svg_writer_t *w, int x, int y, int p[2]) {
+    emit_command(w, 'm', x - p[0]);
+    emit_command(w, 0, y - p[1]);
+
+    p[0] = x;
+    p[1] = y;
+}
+
+/**
+ * Write every horizontal run of dark modules as a rectangle subpath.
+ *
+ * @param w writer.
+ * @param m matrix.
+ * @param ox x coordinate of the top left module.
+ * @param oy y coordinate of the top left module.
+ * @param p start of the previous subpath.
+ */
+static void write_runs(svg_writer_t *w, const bitmatrix_t *m, int ox, int oy,
+                       int p[2]) {
+    for (int y = 0; y < m->n; y++)
+        for (int x = 0; x < m->n; x++) {
+            if (!bitmatrix_get(m, y, x))
+                continue;
+
+            int l = 1;
+
+            while (x + l < m->n && bitmatrix_get(m, y, x + l))
+                l++;
+
+            emit_move(w, ox + x, oy + y, p);
+            emit_command(w, 'h', l);
+            emit_command(w, 'v', 1);
+            emit_command(w, 'h', -l);
+            emit(w, "z", 1);
+
+            x += l;
+        }
+}
+
+/**
+ * Write a straight line of the outline.
+ *
+ * @param w writer.
+ * @param d direction.
+ * @param l length.
+ */
+static void emit_line(svg_writer_t *w, direction_t d, int l) {
+    emit_command(w, d == DIRECTION_RIGHT || d == DIRECTION_LEFT ? 'h' : 'v',
+                 d == DIRECTION_RIGHT || d == DIRECTION_DOWN ? l : -l);
+}
+
+/**
+ * Write one closed outline starting at a vertex and remove its edges. The
+ * last line is left to the closepath.
+ *
+ * @param w writer.
+ * @param e outgoing edge directions of each vertex, as bit flags.
+ * @param x x coordinate of the vertex.
+ * @param y y coordinate of the vertex.
+ */
+static void trace_outline(svg_writer_t *w, uint8_t e[][SVG_MAX_VERTICES],
+                          int x, int y) {
+    int sx = x;
+    int sy = y;
+    int d = -1;
+    int l = 0;
+
+    do {
+        int t = d;
+
+        // keep going straight, and otherwise take any edge
+        if (t < 0 || !(e[y][x] >> t & 1))
+            for (t = 0; !(e[y][x] >> t & 1); t++)
+                ;
+
+        e[y][x] &= ~(1 << t);
+
+        if (t != d) {
+            if (d >= 0)
+                emit_line(w, d, l);
+
+            d = t;
+            l = 0;
+        }
+
+        x += direction_dx[t];
+        y += direction_dy[t];
+        l++;
+    } while (x != sx || y != sy);
+
+    emit(w, "z", 1);
+}
+
+/**
+ * Write the outlines of the connected dark regions, including their holes.
+ * Each outline goes clockwise around the dark modules, so the holes wind the
+ * other way and the nonzero fill rule leaves them light.
+ *
+ * @param w writer.
+ * @param m matrix.
+ * @param ox x coordinate of the top left module.
+ * @param oy y coordinate of the top left module.
+ * @param p start of the previous subpath.
+ */
+static void write_outlines(svg_writer_t *w, const bitmatrix_t *m, int ox,
+                           int oy, int p[2]) {
+    uint8_t e[SVG_MAX_VERTICES][SVG_MAX_VERTICES] = {{0}};
+    int n = m->n;
+
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++) {
+            if (!bitmatrix_get(m, y, x))
+                continue;
+
+            if (y == 0 || !bitmatrix_get(m, y - 1, x))
+                e[y][x] |= 1 << DIRECTION_RIGHT;
+
+            if (x == n - 1 || !bitmatrix_get(m, y, x + 1))
+                e[y][x + 1] |= 1 << DIRECTION_DOWN;
+
+            if (y == n - 1 || !bitmatrix_get(m, y + 1, x))
+                e[y + 1][x + 1] |= 1 << DIRECTION_LEFT;
+
+            if (x == 0 || !bitmatrix_get(m, y, x - 1))
+                e[y + 1][x] |= 1 << DIRECTION_UP;
+        }
+
+    for (int y = 0; y <= n; y++)
+        for (int x = 0; x <= n; x++)
+            while (e[y][x] != 0) {
+                emit_move(w, ox + x, oy + y, p);
+                trace_outline(w, e, x, y);
+            }
+}
+
+/**
+ * Write the image of symbols tiled in rows, each in a cell of the largest
+ * symbol and its quiet zone. The view box is in modules with the origin at the
+ * top left module of the first symbol, and the dark modules are a single path.
+ *
+ * @param w writer.
+ * @param m matrices.
+ * @param k number of matrices.
+ * @param c number of columns.
+ * @param o options.
+ */
+static void write_image(svg_writer_t *w, const bitmatrix_t *const m[], int k,
+                        int c, const svg_options_t *o) {
+    int q = o->quiet_zone;
+    int l = 0;
+    int p[2] = {0, 0};
+    char h[256];
+
+    for (int i = 0; i < k; i++)
+        if (m[i]->n > l)
+            l = m[i]->n;
+
+    l += q * 2;
+
+    int x = l * c;
+    int y = l * ((k + c - 1) / c);
+
+    emit(w, h,
+         snprintf(h, sizeof(h),
+                  "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                  "viewBox=\"%d %d %d %d\" width=\"%d\" height=\"%d\" "
+                  "shape-rendering=\"crispEdges\">"
+                  "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
+                  "fill=\"#fff\"/><path d=\"",
+                  -q, -q, x, y, x * o->scale, y * o->scale, -q, -q, x, y));
+
+    for (int i = 0; i < k; i++) {
+        if (o->path == SVG_PATH_OUTLINES)
+            write_outlines(w, m[i], i % c * l, i / c * l, p);
+        else
+            write_runs(w, m[i], i % c * l, i / c * l, p);
+    }
+
+    emit(w, "\"/></svg>\n", 10);
+    image_stream_flush(&w->stream);
+}
+
+/**
+ * Stream the matrix as an SVG image.
+ *
+ * @param m matrix.
+ * @param o options.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_svg(const bitmatrix_t *m, const svg_options_t *o, image_sink_t k,
+                void *a) {
+    svg_writer_t w;
+
+    image_stream_init(&w.stream, k, a);
+    w.last = 0;
+
+    write_image(&w, &m, 1, 1, o);
+}
+
+/**
+ * Stream symbols tiled in rows as one SVG image, such as those of a structured
+ * append.
+ *
+ * @param m matrices.
+ * @param n number of matrices.
+ * @param c number of columns.
+ * @param o options.
+ * @param k sink.
+ * @param a sink argument.
+ */
+void stream_svg_sheet(const bitmatrix_t *const m[], int n, int c,
+                      const svg_options_t *o, image_sink_t k, void *a) {
+    svg_writer_t w;
+
+    image_stream_init(&w.stream, k, a);
+    w.last = 0;
+
+    write_image(&w, m, n, c, o);
+}
+
+/**
+ * Encode the matrix as an SVG image into a buffer, like snprintf(). The image
+ * is only complete if its length is at most \a n. No terminating null
+ * character is written.
+ *
+ * @param d buffer.
+ * @param n buffer length.
+ * @param m matrix.
+ * @param o options.
+ * @return image length.
+ */
+size_t encode_svg(char d[], size_t n, const bitmatrix_t *m,
+                  const svg_options_t *o) {
+    image_buffer_t b = {(uint8_t *)d, n, 0};
+
+    stream_svg(m, o, image_buffer_sink, &b);
+
+    return b.length;
+}
+
+/**
+ * Write the matrix as an SVG image.
+ *
+ * @param m matrix.
+ * @param o options.
+ * @param f output stream.
+ */
+void write_svg(const bitmatrix_t *m, const svg_options_t *o, FILE *f) {
+    stream_svg(m, o, image_file_sink, f);
+}
+
+/**
+ * Write symbols tiled in rows as one SVG image.
+ *
+ * @param m matrices.
+ * @param n number of matrices.
+ * @param c number of columns.
+ * @param o options.
+ * @param f output stream.
+ */
+void write_svg_sheet(const bitmatrix_t *const m[], int n, int c,
+                     const svg_options_t *o, FILE *f) {
+    stream_svg_sheet(m, n, c, o, image_file_sink, f);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file svg.h
+ * @brief svg header
+ */
+#ifndef SVG_H
+#define SVG_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "bitmatrix.h"
+#include "image.h"
+
+typedef enum { SVG_PATH_RUNS, SVG_PATH_OUTLINES } svg_path_t;
+
+typedef struct svg_options {
+    int scale;
+    int quiet_zone;
+    svg_path_t path;
+} svg_options_t;
+
+extern void stream_svg(const bitmatrix_t *m, const svg_options_t *o,
+                       image_sink_t k, void *a);
+extern void stream_svg_sheet(const bitmatrix_t *const m[], int n, int c,
+                             const svg_options_t *o, image_sink_t k, void *a);
+extern size_t encode_svg(char d[], size_t n, const bitmatrix_t *m,
+                         const svg_options_t *o);
+extern void write_svg(const bitmatrix_t *m, const svg_options_t *o, FILE *f);
+extern void write_svg_sheet(const bitmatrix_t *const m[], int n, int c,
+                            const svg_options_t *o, FILE *f);
+
+#endif /* SVG_H */
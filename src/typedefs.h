@@ -27,6 +27,8 @@
 #ifndef TYPEDEFS_H
 #define TYPEDEFS_H
 
+#include <stdint.h>
+
 typedef enum {
     ERROR_CORRECTION_LEVEL_L,
     ERROR_CORRECTION_LEVEL_M,
@@ -41,11 +43,12 @@ typedef enum {
     ENCODING_MODE_KANJI
 } encoding_mode_t;
 
-typedef enum {
-    MODULE_TYPE_NONE = -1,
-    MODULE_TYPE_LIGHT = 0,
-    MODULE_TYPE_DARK = 1,
-    MODULE_TYPE_RESERVED = 2
-} module_type_t;
+// position of a symbol in a structured append, and the parity of the whole
+// input string
+typedef struct structured_append {
+    int index;
+    int total;
+    uint8_t parity;
+} structured_append_t;
 
 #endif /* TYPEDEFS_H */
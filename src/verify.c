@@ -0,0 +1,661 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file verify.c
+ * @brief verify implementation
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include "gf256.h"
+#include "message.h"
+#include "verify.h"
+
+#define NUM_VERSIONS 40
+#define NUM_ALIGNMENT_POSITIONS 7
+#define MAX_CODEWORDS 3706
+#define MAX_EC_CODEWORDS 30
+#define MODE_INDICATOR_LEN 4
+#define STRUCTURED_APPEND_MODE_INDICATOR 3
+#define STRUCTURED_APPEND_HEADER_LEN 20
+
+#define FORMAT_INFO_MASK 0x5412
+#define FORMAT_INFO_GENERATOR 0x537
+#define VERSION_INFO_GENERATOR 0x1F25
+
+#define KANJI_SPLIT_VALUE (0x1F * 0xC0)
+
+typedef struct bit_reader {
+    const uint8_t *d;
+    int n;
+    int i;
+} bit_reader_t;
+
+// error correction level of each value of the 2 bits in the format information
+static const error_correction_level_t format_ec_levels[] = {
+    ERROR_CORRECTION_LEVEL_M, ERROR_CORRECTION_LEVEL_L,
+    ERROR_CORRECTION_LEVEL_H, ERROR_CORRECTION_LEVEL_Q};
+
+static const int8_t chrcnt_indicator_lens[][4] = {
+    {10, 9, 8, 8}, {12, 11, 16, 10}, {14, 13, 16, 12}};
+
+// row and column coordinates of the centers of the alignment patterns of each
+// version, as listed in annex E of the standard, up to the first 0
+static const uint8_t
+    alignment_positions[NUM_VERSIONS][NUM_ALIGNMENT_POSITIONS] = {
+        {0},
+        {6, 18},
+        {6, 22},
+        {6, 26},
+        {6, 30},
+        {6, 34},
+        {6, 22, 38},
+        {6, 24, 42},
+        {6, 26, 46},
+        {6, 28, 50},
+        {6, 30, 54},
+        {6, 32, 58},
+        {6, 34, 62},
+        {6, 26, 46, 66},
+        {6, 26, 48, 70},
+        {6, 26, 50, 74},
+        {6, 30, 54, 78},
+        {6, 30, 56, 82},
+        {6, 30, 58, 86},
+        {6, 34, 62, 90},
+        {6, 28, 50, 72, 94},
+        {6, 26, 50, 74, 98},
+        {6, 30, 54, 78, 102},
+        {6, 28, 54, 80, 106},
+        {6, 32, 58, 84, 110},
+        {6, 30, 58, 86, 114},
+        {6, 34, 62, 90, 118},
+        {6, 26, 50, 74, 98, 122},
+        {6, 30, 54, 78, 102, 126},
+        {6, 26, 52, 78, 104, 130},
+        {6, 30, 56, 82, 108, 134},
+        {6, 34, 60, 86, 112, 138},
+        {6, 30, 58, 86, 114, 142},
+        {6, 34, 62, 90, 118, 146},
+        {6, 30, 54, 78, 102, 126, 150},
+        {6, 24, 50, 76, 102, 128, 154},
+        {6, 28, 54, 80, 106, 132, 158},
+        {6, 32, 58, 84, 110, 136, 162},
+        {6, 26, 54, 82, 110, 138, 166},
+        {6, 30, 58, 86, 114, 142, 170}};
+
+static const char alphanumeric_chars[] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+/**
+ * Returns the BCH error correction bits of a value.
+ *
+ * @param v value.
+ * @param k value length.
+ * @param g generator polynomial.
+ * @param n error correction bits length, the degree of \a g.
+ * @return error correction bits.
+ */
+static uint32_t bch_remainder(uint32_t v, int k, uint32_t g, int n) {
+    uint32_t r = v << n;
+
+    for (int i = k + n - 1; i >= n; i--)
+        if (r >> i & 1)
+            r ^= g << (i - n);
+
+    return r;
+}
+
+/**
+ * Read one copy of the format information, in the order of the standard.
+ *
+ * @param m matrix.
+ * @param c 0 for the copy around the upper left finder pattern and 1 for the
+ * one split between the other two.
+ * @return 15 bits of format information.
+ */
+static uint16_t read_format_info(const bitmatrix_t *m, int c) {
+    int n = m->n;
+    uint16_t f = 0;
+
+    if (c == 0) {
+        for (int i = 0; i < 8; i++)
+            f |= bitmatrix_get(m, i + (i >= 6), 8) << i;
+
+        for (int i = 0; i < 7; i++)
+            f |= bitmatrix_get(m, 8, i + (i >= 6)) << (14 - i);
+
+    } else {
+        for (int i = 8; i < 15; i++)
+            f |= bitmatrix_get(m, n + i - 15, 8) << i;
+
+        for (int i = 7; i < 15; i++)
+            f |= bitmatrix_get(m, 8, n + i - 15) << (14 - i);
+    }
+
+    return f;
+}
+
+/**
+ * Decode the format information.
+ *
+ * @param f 15 bits of format information.
+ * @param e error correction level.
+ * @param p mask pattern.
+ * @return true if the error correction bits are valid and false otherwise.
+ */
+static bool decode_format_info(uint16_t f, error_correction_level_t *e,
+                               int *p) {
+    uint32_t d;
+
+    f ^= FORMAT_INFO_MASK;
+    d = f >> 10;
+
+    if ((d << 10 | bch_remainder(d, 5, FORMAT_INFO_GENERATOR, 10)) != f)
+        return false;
+
+    *e = format_ec_levels[d >> 3];
+    *p = d & 7;
+
+    return true;
+}
+
+/**
+ * Read one copy of the version information, in the order of the standard.
+ *
+ * @param m matrix.
+ * @param c 0 for the copy above the lower left finder pattern and 1 for the
+ * one left of the upper right finder pattern.
+ * @return 18 bits of version information.
+ */
+static uint32_t read_version_info(const bitmatrix_t *m, int c) {
+    int n = m->n;
+    uint32_t f = 0;
+
+    for (int i = 0; i < 6; i++)
+        for (int j = 0; j < 3; j++)
+            f |= (uint32_t)(c == 0 ? bitmatrix_get(m, n - 11 + j, i)
+                                   : bitmatrix_get(m, i, n - 11 + j))
+                 << (i * 3 + j);
+
+    return f;
+}
+
+/**
+ * Returns true if the version information is that of the version.
+ *
+ * @param f 18 bits of version information.
+ * @param v version.
+ * @return true if the version information is valid and matches \a v.
+ */
+static bool check_version_info(uint32_t f, int v) {
+    uint32_t d = f >> 12;
+
+    return d == (uint32_t)v + 1 &&
+           (d << 12 | bch_remainder(d, 6, VERSION_INFO_GENERATOR, 12)) == f;
+}
+
+/**
+ * Returns the distance between two modules along the farther axis, which is
+ * the ring of a square pattern the module is on.
+ *
+ * @param y Y offset.
+ * @param x X offset.
+ * @return distance.
+ */
+static int ring_distance(int y, int x) {
+    return abs(y) > abs(x) ? abs(y) : abs(x);
+}
+
+/**
+ * Mark a rectangle of the matrix as function modules.
+ *
+ * @param f function module flags.
+ * @param y upper left Y coordinate.
+ * @param x upper left X coordinate.
+ * @param h rectangle height.
+ * @param w rectangle width.
+ */
+static void reserve_modules(bitmatrix_t *f, int y, int x, int h, int w) {
+    for (int i = y; i < y + h; i++)
+        for (int j = x; j < x + w; j++)
+            bitmatrix_set(f, i, j, true);
+}
+
+/**
+ * Build the function patterns of a version from the standard: the finder
+ * patterns and their separators, the alignment patterns, the timing patterns
+ * and the dark module. The format and version information are not included,
+ * they are checked against their own error correction bits.
+ *
+ * @param f function module flags, set for the modules of the patterns.
+ * @param t function patterns.
+ * @param v version.
+ */
+static void build_function_patterns(bitmatrix_t *f, bitmatrix_t *t, int v) {
+    int n = v * 4 + 21;
+    const uint8_t *a = alignment_positions[v];
+
+    bitmatrix_fill(f, n, false);
+    bitmatrix_fill(t, n, false);
+
+    // the finder patterns are dark but for the ring at a distance of 2 from
+    // the center, and the separators around them are light
+    for (int k = 0; k < 3; k++) {
+        int y = k == 2 ? n - 8 : 0;
+        int x = k == 1 ? n - 8 : 0;
+
+        reserve_modules(f, y, x, 8, 8);
+
+        for (int i = 0; i < 7; i++)
+            for (int j = 0; j < 7; j++)
+                bitmatrix_set(t, y + (y > 0) + i, x + (x > 0) + j,
+                              ring_distance(i - 3, j - 3) != 2);
+    }
+
+    // the alignment patterns are dark but for the ring at a distance of 1,
+    // and are left out where they would overlap the finder patterns
+    for (int i = 0; i < NUM_ALIGNMENT_POSITIONS && a[i] != 0; i++)
+        for (int j = 0; j < NUM_ALIGNMENT_POSITIONS && a[j] != 0; j++) {
+            if (bitmatrix_get(f, a[i], a[j]))
+                continue;
+
+            for (int y = -2; y <= 2; y++)
+                for (int x = -2; x <= 2; x++) {
+                    bitmatrix_set(f, a[i] + y, a[j] + x, true);
+                    bitmatrix_set(t, a[i] + y, a[j] + x,
+                                  ring_distance(y, x) != 1);
+                }
+        }
+
+    for (int i = 8; i < n - 8; i++) {
+        bitmatrix_set(f, 6, i, true);
+        bitmatrix_set(t, 6, i, i % 2 == 0);
+        bitmatrix_set(f, i, 6, true);
+        bitmatrix_set(t, i, 6, i % 2 == 0);
+    }
+
+    bitmatrix_set(f, n - 8, 8, true);
+    bitmatrix_set(t, n - 8, 8, true);
+}
+
+/**
+ * Mark the format information and, from version 7, the version information as
+ * function modules.
+ *
+ * @param f function module flags.
+ * @param v version.
+ */
+static void reserve_information(bitmatrix_t *f, int v) {
+    int n = f->n;
+
+    reserve_modules(f, 8, 0, 1, 9);
+    reserve_modules(f, 0, 8, 9, 1);
+    reserve_modules(f, 8, n - 8, 1, 8);
+    reserve_modules(f, n - 8, 8, 8, 1);
+
+    if (v >= 6) {
+        reserve_modules(f, 0, n - 11, 6, 3);
+        reserve_modules(f, n - 11, 0, 3, 6);
+    }
+}
+
+/**
+ * Returns true if the modules of the function patterns are those expected.
+ *
+ * @param m matrix.
+ * @param f function module flags.
+ * @param t function patterns.
+ * @return true if the function patterns are valid and false otherwise.
+ */
+static bool check_function_patterns(const bitmatrix_t *m, const bitmatrix_t *f,
+                                    const bitmatrix_t *t) {
+    uint64_t d = 0;
+
+    for (int i = 0; i < m->n; i++)
+        for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+            d |= (m->r[i][j] ^ t->r[i][j]) & f->r[i][j];
+
+    return d == 0;
+}
+
+/**
+ * Returns the mask pattern condition of the standard for a module.
+ *
+ * @param p mask pattern.
+ * @param i row.
+ * @param j column.
+ * @return true if the module is inverted by the mask pattern.
+ */
+static bool mask_condition(int p, int i, int j) {
+    switch (p) {
+    case 0:
+        return (i + j) % 2 == 0;
+    case 1:
+        return i % 2 == 0;
+    case 2:
+        return j % 3 == 0;
+    case 3:
+        return (i + j) % 3 == 0;
+    case 4:
+        return (i / 2 + j / 3) % 2 == 0;
+    case 5:
+        return i * j % 2 + i * j % 3 == 0;
+    case 6:
+        return (i * j % 2 + i * j % 3) % 2 == 0;
+    default:
+        return ((i + j) % 2 + i * j % 3) % 2 == 0;
+    }
+}
+
+/**
+ * Read and unmask the codewords from the data modules in the order of the
+ * standard: upwards and downwards in turn in columns 2 modules wide from the
+ * right, passing over the vertical timing pattern. The remainder bits after
+ * the last codeword are not read.
+ *
+ * @param b final message.
+ * @param l number of codewords.
+ * @param m matrix.
+ * @param f function module flags.
+ * @param p mask pattern.
+ */
+static void read_codewords(uint8_t b[], int l, const bitmatrix_t *m,
+                           const bitmatrix_t *f, int p) {
+    int n = m->n;
+    int k = 0;
+    int c = 0;
+
+    for (int x = n - 1, u = 1; x > 0 && k < l * 8; x -= 2, u = !u) {
+        if (x == 6)
+            x--;
+
+        for (int i = 0; i < n; i++) {
+            int y = u ? n - 1 - i : i;
+
+            for (int j = x; j > x - 2 && k < l * 8; j--) {
+                if (bitmatrix_get(f, y, j))
+                    continue;
+
+                c = c << 1 | (bitmatrix_get(m, y, j) ^ mask_condition(p, y, j));
+
+                if (++k % 8 == 0)
+                    b[k / 8 - 1] = c;
+            }
+        }
+    }
+}
+
+/**
+ * Read bits from the bit stream. The caller checks that there are enough.
+ *
+ * @param r bit reader.
+ * @param k number of bits, at most 16.
+ * @return bits.
+ */
+static int read_bits(bit_reader_t *r, int k) {
+    int v = 0;
+
+    for (int j = 0; j < k; j++, r->i++)
+        v = v << 1 | (r->d[r->i / 8] >> (7 - r->i % 8) & 1);
+
+    return v;
+}
+
+/**
+ * Decode the characters of a segment.
+ *
+ * @param t bit reader.
+ * @param m encoding mode.
+ * @param c number of characters.
+ * @param r result, appended to.
+ * @return true if the segment is valid and false otherwise.
+ */
+static bool decode_segment(bit_reader_t *t, encoding_mode_t m, int c,
+                           verify_result_t *r) {
+    static const int8_t numeric_bits[] = {0, 4, 7, 10};
+    static const int16_t numeric_limits[] = {1, 10, 100, 1000};
+    int l = m == ENCODING_MODE_KANJI ? c * 2 : c;
+
+    if (r->length + l > VERIFY_MAX_DATA_LENGTH)
+        return false;
+
+    uint8_t *d = &r->data[r->length];
+
+    r->length += l;
+
+    switch (m) {
+    case ENCODING_MODE_NUMERIC:
+        for (int i = 0; i < c; i += 3) {
+            int k = c - i < 3 ? c - i : 3;
+
+            if (t->n - t->i < numeric_bits[k])
+                return false;
+
+            int v = read_bits(t, numeric_bits[k]);
+
+            if (v >= numeric_limits[k])
+                return false;
+
+            for (int j = k - 1; j >= 0; j--, v /= 10)
+                d[i + j] = '0' + v % 10;
+        }
+
+        return true;
+
+    case ENCODING_MODE_ALPHANUMERIC:
+        for (int i = 0; i < c; i += 2) {
+            int k = c - i < 2 ? 6 : 11;
+
+            if (t->n - t->i < k)
+                return false;
+
+            int v = read_bits(t, k);
+
+            if (v >= (k == 11 ? 45 * 45 : 45))
+                return false;
+
+            if (k == 11) {
+                d[i] = alphanumeric_chars[v / 45];
+                d[i + 1] = alphanumeric_chars[v % 45];
+            } else {
+                d[i] = alphanumeric_chars[v];
+            }
+        }
+
+        return true;
+
+    case ENCODING_MODE_BYTE:
+        if (t->n - t->i < c * 8)
+            return false;
+
+        for (int i = 0; i < c; i++)
+            d[i] = read_bits(t, 8);
+
+        return true;
+
+    case ENCODING_MODE_KANJI:
+        if (t->n - t->i < c * 13)
+            return false;
+
+        for (int i = 0; i < c; i++) {
+            int v = read_bits(t, 13);
+            int w = (v / 0xC0 << 8 | v % 0xC0) +
+                    (v < KANJI_SPLIT_VALUE ? 0x8140 : 0xC140);
+
+            d[i * 2] = w >> 8;
+            d[i * 2 + 1] = w;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Decode the data codewords back to the input string. The terminator, the
+ * padding bits and the pad codewords are checked as well. A structured append
+ * header is only read at the start.
+ *
+ * @param d data codewords.
+ * @param n number of data codewords.
+ * @param r result, with the version set and the total of the structured
+ * append 0 if there is none.
+ * @return true if the bit stream is valid and false otherwise.
+ */
+static bool decode_data_codewords(const uint8_t d[], int n,
+                                  verify_result_t *r) {
+    bit_reader_t t = {d, n * 8, 0};
+    int v = r->version;
+
+    r->append = (structured_append_t){0, 0, 0};
+    r->length = 0;
+
+    if (t.n >= STRUCTURED_APPEND_HEADER_LEN &&
+        d[0] >> 4 == STRUCTURED_APPEND_MODE_INDICATOR) {
+        t.i = MODE_INDICATOR_LEN;
+        r->append.index = read_bits(&t, 4);
+        r->append.total = read_bits(&t, 4) + 1;
+        r->append.parity = read_bits(&t, 8);
+
+        if (r->append.index >= r->append.total)
+            return false;
+    }
+
+    while (t.n - t.i >= MODE_INDICATOR_LEN) {
+        int i = read_bits(&t, MODE_INDICATOR_LEN);
+        encoding_mode_t m;
+
+        if (i == 0)
+            break;
+
+        // mode indicators are 1 << mode
+        for (m = ENCODING_MODE_NUMERIC; m < ENCODING_MODE_KANJI; m++)
+            if (i == 1 << m)
+                break;
+
+        if (i != 1 << m)
+            return false;
+
+        int k = chrcnt_indicator_lens[(v >= 9) + (v >= 26)][m];
+
+        if (t.n - t.i < k || !decode_segment(&t, m, read_bits(&t, k), r))
+            return false;
+    }
+
+    // the terminator may be cut short at the end of the symbol, and the
+    // padding bits up to the codeword boundary are 0
+    while (t.i % 8 != 0 && t.i < t.n)
+        if (read_bits(&t, 1) != 0)
+            return false;
+
+    for (int i = t.i / 8, p = 0xEC; i < n; i++, p ^= 0xFD)
+        if (d[i] != p)
+            return false;
+
+    return true;
+}
+
+/**
+ * Decode a symbol as a reader would and check every part of it: the format
+ * and version information, the function patterns, the syndromes of every
+ * error correction block and the bit stream. The symbol must have no errors
+ * at all to be valid.
+ *
+ * @param m matrix.
+ * @param r result, the version, error correction level, mask pattern,
+ * structured append and input string, or part of it, of the symbol.
+ * @return status.
+ */
+verify_status_t verify_symbol(const bitmatrix_t *m, verify_result_t *r) {
+    bitmatrix_t a;
+    bitmatrix_t t;
+    uint8_t b[MAX_CODEWORDS];
+    uint8_t c[MAX_CODEWORDS];
+    uint8_t d[MAX_CODEWORDS];
+    uint8_t s[MAX_EC_CODEWORDS];
+    int v = (m->n - 21) / 4;
+
+    if (m->n < 21 || (m->n - 21) % 4 != 0 || v >= NUM_VERSIONS)
+        return VERIFY_ERROR_SIZE;
+
+    r->version = v;
+
+    uint16_t f = read_format_info(m, 0);
+
+    if (f != read_format_info(m, 1) ||
+        !decode_format_info(f, &r->ec_level, &r->mask))
+        return VERIFY_ERROR_FORMAT_INFO;
+
+    if (v >= 6 && (!check_version_info(read_version_info(m, 0), v) ||
+                   !check_version_info(read_version_info(m, 1), v)))
+        return VERIFY_ERROR_VERSION_INFO;
+
+    build_function_patterns(&a, &t, v);
+
+    if (!check_function_patterns(m, &a, &t))
+        return VERIFY_ERROR_FUNCTION_PATTERNS;
+
+    rs_block_info_t k = rs_block_information(v, r->ec_level);
+    int nb = k.num_blocks1 + k.num_blocks2;
+    int ne = k.num_ec_codewords;
+    int nd = k.num_data_codewords1 * k.num_blocks1 +
+             k.num_data_codewords2 * k.num_blocks2;
+
+    reserve_information(&a, v);
+    read_codewords(b, nb * ne + nd, m, &a, r->mask);
+
+    // de-interleave into the blocks, one after another
+    int o[nb + 1];
+    int x = 0;
+
+    o[0] = 0;
+
+    for (int j = 0; j < nb; j++)
+        o[j + 1] = o[j] + ne + (j < k.num_blocks1 ? k.num_data_codewords1
+                                                 : k.num_data_codewords2);
+
+    for (int i = 0; i < k.num_data_codewords1 + (k.num_blocks2 > 0); i++)
+        for (int j = 0; j < nb; j++)
+            if (i < o[j + 1] - o[j] - ne)
+                c[o[j] + i] = b[x++];
+
+    for (int i = 0; i < ne; i++)
+        for (int j = 0; j < nb; j++)
+            c[o[j + 1] - ne + i] = b[x++];
+
+    x = 0;
+
+    for (int j = 0; j < nb; j++) {
+        if (!gf256_syndromes(s, o[j + 1] - o[j], &c[o[j]], ne))
+            return VERIFY_ERROR_SYNDROMES;
+
+        for (int i = o[j]; i < o[j + 1] - ne; i++)
+            d[x++] = c[i];
+    }
+
+    if (!decode_data_codewords(d, nd, r))
+        return VERIFY_ERROR_BITSTREAM;
+
+    return VERIFY_OK;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file verify.h
+ * @brief verify header
+ */
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include "bitmatrix.h"
+#include "typedefs.h"
+
+#define VERIFY_MAX_DATA_LENGTH 7089
+
+typedef enum {
+    VERIFY_OK,
+    VERIFY_ERROR_SIZE,
+    VERIFY_ERROR_FORMAT_INFO,
+    VERIFY_ERROR_VERSION_INFO,
+    VERIFY_ERROR_FUNCTION_PATTERNS,
+    VERIFY_ERROR_SYNDROMES,
+    VERIFY_ERROR_BITSTREAM
+} verify_status_t;
+
+typedef struct verify_result {
+    int version;
+    error_correction_level_t ec_level;
+    int mask;
+    structured_append_t append;
+    int length;
+    uint8_t data[VERIFY_MAX_DATA_LENGTH];
+} verify_result_t;
+
+extern verify_status_t verify_symbol(const bitmatrix_t *m, verify_result_t *r);
+
+#endif /* VERIFY_H */
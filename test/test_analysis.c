@@ -1,6 +1,11 @@
 #include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include "encode.h"
 
+static segment_buffers_t buffers;
+
 static void test_min_encoding_mode(void) {
     assert(min_encoding_mode(0, (uint8_t *)"") == ENCODING_MODE_NUMERIC);
     assert(min_encoding_mode(1, (uint8_t *)"0") == ENCODING_MODE_NUMERIC);
@@ -35,8 +40,220 @@ static void test_min_encoding_mode(void) {
     assert(min_encoding_mode(2, (uint8_t[]){0xEB, 0xC0}) == ENCODING_MODE_BYTE);
 }
 
+static uint8_t classify_reference(const uint8_t s[], int l, int i) {
+    uint8_t c = CHAR_CLASS(ENCODING_MODE_BYTE);
+    int k = i + 1 < l ? s[i] << 8 | s[i + 1] : 0;
+
+    if (s[i] >= '0' && s[i] <= '9')
+        c |= CHAR_CLASS(ENCODING_MODE_NUMERIC);
+
+    if (s[i] != '\0' &&
+        strchr("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:", s[i]) != NULL)
+        c |= CHAR_CLASS(ENCODING_MODE_ALPHANUMERIC);
+
+    if (((k >= 0x8140 && k <= 0x9FFC) || (k >= 0xE040 && k <= 0xEBBF)) &&
+        (k & 0xFF) >= 0x40 && (k & 0xFF) != 0x7F && (k & 0xFF) <= 0xFC)
+        c |= CHAR_CLASS(ENCODING_MODE_KANJI);
+
+    return c;
+}
+
+static void test_classify_data(void) {
+    const uint8_t chars[] = {0x00, ' ',  '$',  '%',  '*',  '+',  ',',  '-',
+                             '/',  '0',  '9',  ':',  ';',  '@',  'A',  'Z',
+                             '[',  'a',  0x3F, 0x40, 0x7E, 0x7F, 0x80, 0x81,
+                             0x9F, 0xA0, 0xBF, 0xC0, 0xDF, 0xE0, 0xEB, 0xEC,
+                             0xFC, 0xFD, 0xFF};
+    uint8_t s[200];
+    uint8_t c[200];
+
+    srand(2);
+
+    for (int r = 0; r < 2000; r++) {
+        int l = rand() % 200;
+
+        for (int i = 0; i < l; i++)
+            s[i] = rand() % 2 ? chars[rand() % sizeof(chars)] : rand() % 256;
+
+        classify_data(l, s, c);
+
+        for (int i = 0; i < l; i++)
+            assert(c[i] == classify_reference(s, l, i));
+    }
+}
+
+static void test_min_encoding_mode_long(void) {
+    static uint8_t s[7089];
+
+    memset(s, '1', sizeof(s));
+    assert(min_encoding_mode(7089, s) == ENCODING_MODE_NUMERIC);
+
+    s[5000] = 'A';
+    assert(min_encoding_mode(7089, s) == ENCODING_MODE_ALPHANUMERIC);
+
+    s[6000] = 'a';
+    assert(min_encoding_mode(7089, s) == ENCODING_MODE_BYTE);
+
+    for (int i = 0; i < 7088; i += 2) {
+        s[i] = 0x93;
+        s[i + 1] = 0xFA;
+    }
+
+    assert(min_encoding_mode(7088, s) == ENCODING_MODE_KANJI);
+    assert(min_encoding_mode(7087, s) == ENCODING_MODE_BYTE);
+
+    s[3001] = 0x7F;
+    assert(min_encoding_mode(7088, s) == ENCODING_MODE_BYTE);
+}
+
+static bool is_encodable_reference(const uint8_t s[], int l, int m) {
+    for (int i = 0; i < l; i++) {
+        if (m == ENCODING_MODE_NUMERIC && !(s[i] >= '0' && s[i] <= '9'))
+            return false;
+
+        if (m == ENCODING_MODE_ALPHANUMERIC &&
+            strchr("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:", s[i]) ==
+                NULL)
+            return false;
+    }
+
+    if (m == ENCODING_MODE_KANJI) {
+        if (l % 2 != 0)
+            return false;
+
+        for (int i = 0; i < l; i += 2)
+            if (min_encoding_mode(2, &s[i]) != ENCODING_MODE_KANJI)
+                return false;
+    }
+
+    return true;
+}
+
+// fewest bits of all segmentations of the string at version 0, by exhaustive
+// search
+static int min_bits_reference(const uint8_t s[], int l, int p) {
+    const int counts[] = {10, 9, 8, 8};
+    int b = l == 0 ? 0 : 1 << 30;
+
+    for (int m = 0; m < 4; m++) {
+        if (m == p)
+            continue;
+
+        for (int k = 1; k <= l; k++) {
+            if (!is_encodable_reference(s, k, m))
+                continue;
+
+            int n = 4 + counts[m];
+
+            if (m == ENCODING_MODE_NUMERIC)
+                n += k / 3 * 10 + (k % 3 == 2 ? 7 : k % 3 == 1 ? 4 : 0);
+            else if (m == ENCODING_MODE_ALPHANUMERIC)
+                n += k / 2 * 11 + k % 2 * 6;
+            else if (m == ENCODING_MODE_BYTE)
+                n += k * 8;
+            else
+                n += k / 2 * 13;
+
+            n += min_bits_reference(&s[k], l - k, m);
+
+            if (n < b)
+                b = n;
+        }
+    }
+
+    return b;
+}
+
+static int segment(int l, const uint8_t s[], int v, segment_t g[]) {
+    classify_data(l, s, buffers.classes);
+    return segment_data(l, buffers.classes, v, g, &buffers);
+}
+
+static void test_segment_data(void) {
+    const uint8_t url[] = "https://EXAMPLE.COM/ITEM/0123456789012345";
+    segment_t g[sizeof(url)];
+    int k = segment(sizeof(url) - 1, url, 0, g);
+
+    assert(k == 3);
+    assert(g[0].mode == ENCODING_MODE_BYTE);
+    assert(g[0].offset == 0 && g[0].length == 5);
+    assert(g[1].mode == ENCODING_MODE_ALPHANUMERIC);
+    assert(g[1].offset == 5 && g[1].length == 20);
+    assert(g[2].mode == ENCODING_MODE_NUMERIC);
+    assert(g[2].offset == 25 && g[2].length == 16);
+    assert(segments_bit_length(k, g, 0) == 243);
+
+    // version 2 instead of version 3 in byte mode
+    assert(min_segmented_version(sizeof(url) - 1, buffers.classes,
+                                 ERROR_CORRECTION_LEVEL_L, &k, g,
+                                 &buffers) == 1);
+
+    k = segment(10, (uint8_t *)"0123456789", 0, g);
+    assert(k == 1 && g[0].mode == ENCODING_MODE_NUMERIC);
+
+    k = segment(4, (uint8_t[]){0x93, 0xFA, 0x96, 0x7B}, 0, g);
+    assert(k == 1 && g[0].mode == ENCODING_MODE_KANJI && g[0].length == 4);
+
+    // a part of the class map ending in the middle of a kanji character
+    k = segment_data(3, buffers.classes, 0, g, &buffers);
+    assert(k == 1 && g[0].mode == ENCODING_MODE_BYTE && g[0].length == 3);
+
+    k = segment(0, (uint8_t *)"", 0, g);
+    assert(k == 1 && g[0].mode == ENCODING_MODE_NUMERIC && g[0].length == 0);
+}
+
+static void test_segment_data_long(void) {
+    static uint8_t s[3000];
+    static segment_t g[3000];
+
+    memset(s, '7', sizeof(s));
+
+    // the character count indicator holds up to 1023 digits below version 10
+    int k = segment(3000, s, 0, g);
+
+    assert(k == 3);
+    assert(g[0].length == 1023 && g[1].length == 1023 && g[2].length == 954);
+    assert(g[1].offset == 1023 && g[2].offset == 2046);
+
+    k = segment(3000, s, 26, g);
+    assert(k == 1);
+}
+
+static void test_segment_data_random(void) {
+    const uint8_t chars[] = {'0', '5', 'A', '/', 'a', 0x82, 0xA0, 0x81};
+    uint8_t s[9];
+    segment_t g[9];
+
+    srand(1);
+
+    for (int r = 0; r < 2000; r++) {
+        int l = rand() % 10;
+
+        for (int i = 0; i < l; i++)
+            s[i] = chars[rand() % sizeof(chars)];
+
+        int k = segment(l, s, 0, g);
+        int n = 0;
+
+        for (int i = 0; i < k; i++) {
+            assert(g[i].offset == n);
+            assert(is_encodable_reference(&s[n], g[i].length, g[i].mode));
+            n += g[i].length;
+        }
+
+        assert(n == l);
+        assert(segments_bit_length(k, g, 0) == min_bits_reference(s, l, -1) +
+                                                   (l == 0 ? 14 : 0));
+    }
+}
+
 int main(int argc, char const *argv[]) {
     test_min_encoding_mode();
+    test_min_encoding_mode_long();
+    test_classify_data();
+    test_segment_data();
+    test_segment_data_long();
+    test_segment_data_random();
 
     return 0;
 }
@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.h"
+
+static void test_cache_memory(void) {
+    const uint8_t a[] = "https://example.com/a";
+    const uint8_t b[] = "https://example.com/b";
+    uint8_t d[1000];
+    size_t n = 0;
+    cache_stats_t s;
+
+    for (int i = 0; i < 1000; i++)
+        d[i] = i;
+
+    // room for two entries
+    cache_t *c = cache_open(NULL, 0, 2500, 1);
+    assert(c != NULL);
+
+    assert(cache_get(c, 0, a, sizeof(a), &n) == NULL);
+
+    cache_put(c, 0, a, sizeof(a), d, 1000);
+    cache_put(c, 1, a, sizeof(a), d, 500);
+
+    uint8_t *r = cache_get(c, 0, a, sizeof(a), &n);
+    assert(r != NULL && n == 1000 && memcmp(r, d, n) == 0);
+    free(r);
+
+    r = cache_get(c, 1, a, sizeof(a), &n);
+    assert(r != NULL && n == 500 && memcmp(r, d, n) == 0);
+    free(r);
+
+    // (0, a) is the least recently used and is evicted
+    cache_put(c, 0, b, sizeof(b), d, 1000);
+
+    assert(cache_get(c, 0, a, sizeof(a), &n) == NULL);
+    assert((r = cache_get(c, 1, a, sizeof(a), &n)) != NULL);
+    free(r);
+    assert((r = cache_get(c, 0, b, sizeof(b), &n)) != NULL);
+    free(r);
+
+    // larger than the cache
+    cache_put(c, 0, a, sizeof(a), d, 3000 - sizeof(a));
+    assert(cache_get(c, 0, a, sizeof(a), &n) == NULL);
+
+    cache_stats(c, &s);
+    assert(s.memory_hits == 4);
+    assert(s.memory_misses == 3);
+    assert(s.disk_hits == 0 && s.disk_misses == 0);
+
+    cache_close(c);
+}
+
+static void test_cache_disk(void) {
+    char path[] = "/tmp/test_cache_XXXXXX";
+    int fd = mkstemp(path);
+    const uint8_t a[] = "SKU-0001";
+    uint8_t d[8000] = {0};
+    size_t n = 0;
+    cache_stats_t s;
+
+    assert(fd >= 0);
+    close(fd);
+
+    for (int i = 0; i < 8000; i++)
+        d[i] = i * 7;
+
+    cache_t *c1 = cache_open(path, 1 << 20, 0, 1);
+    cache_t *c2 = cache_open(path, 0, 0, 1);
+    assert(c1 != NULL && c2 != NULL);
+
+    cache_put(c1, 2, a, sizeof(a), d, 100);
+
+    uint8_t *r = cache_get(c2, 2, a, sizeof(a), &n);
+    assert(r != NULL && n == 100 && memcmp(r, d, n) == 0);
+    free(r);
+
+    assert(cache_get(c2, 3, a, sizeof(a), &n) == NULL);
+    assert(cache_get(c2, 2, a, sizeof(a) - 1, &n) == NULL);
+
+    // larger than a slot
+    cache_put(c1, 4, a, sizeof(a), d, 8000);
+    assert(cache_get(c2, 4, a, sizeof(a), &n) == NULL);
+
+    cache_close(c1);
+
+    // the counters are shared by the users of the file
+    cache_stats(c2, &s);
+    assert(s.disk_hits == 1);
+    assert(s.disk_misses == 3);
+
+    cache_close(c2);
+
+    // the file is kept after it is closed
+    c1 = cache_open(path, 1 << 20, 0, 1);
+    assert(c1 != NULL);
+    r = cache_get(c1, 2, a, sizeof(a), &n);
+    assert(r != NULL && n == 100 && memcmp(r, d, n) == 0);
+    free(r);
+    cache_close(c1);
+
+    // images of another version are dropped, and the file keeps its size
+    struct stat t;
+    off_t z;
+
+    assert(stat(path, &t) == 0);
+    z = t.st_size;
+
+    c1 = cache_open(path, 4 << 20, 0, 2);
+    assert(c1 != NULL);
+    assert(cache_get(c1, 2, a, sizeof(a), &n) == NULL);
+    assert(stat(path, &t) == 0 && t.st_size == z);
+
+    cache_put(c1, 2, a, sizeof(a), d, 50);
+    cache_close(c1);
+
+    c1 = cache_open(path, 1 << 20, 0, 2);
+    assert(c1 != NULL);
+    r = cache_get(c1, 2, a, sizeof(a), &n);
+    assert(r != NULL && n == 50);
+    free(r);
+
+    // a user of the old version neither reads nor writes the emptied file
+    c2 = cache_open(path, 1 << 20, 0, 3);
+    assert(c2 != NULL);
+    assert(cache_get(c1, 2, a, sizeof(a), &n) == NULL);
+    cache_put(c1, 5, a, sizeof(a), d, 50);
+    assert(cache_get(c2, 5, a, sizeof(a), &n) == NULL);
+
+    cache_put(c2, 6, a, sizeof(a), d, 60);
+    assert(cache_get(c1, 6, a, sizeof(a), &n) == NULL);
+    r = cache_get(c2, 6, a, sizeof(a), &n);
+    assert(r != NULL && n == 60);
+    free(r);
+
+    cache_close(c1);
+    cache_close(c2);
+
+    // a file in another format of the cache is left alone
+    uint32_t k = 1;
+
+    fd = open(path, O_WRONLY);
+    assert(fd >= 0 && pwrite(fd, &k, sizeof(k), 8) == sizeof(k));
+    close(fd);
+
+    assert(cache_open(path, 1 << 20, 0, 3) == NULL);
+    assert(stat(path, &t) == 0 && t.st_size == z);
+
+    // a file which is not a cache is not overwritten
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fputs("not a cache", f);
+    fclose(f);
+
+    assert(cache_open(path, 1 << 20, 0, 1) == NULL);
+
+    remove(path);
+}
+
+int main(int argc, char const *argv[]) {
+    test_cache_memory();
+    test_cache_disk();
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdlib.h>
 #include "gf256.h"
 
 static void test_gf256_genpoly(void) {
@@ -37,6 +38,29 @@ static void test_gf256_genpoly(void) {
         assert(g68[i] == expected_g68[i]);
 }
 
+static void test_gf256_genpoly_for(void) {
+    const int used[] = {7, 10, 13, 15, 16, 17, 18, 20, 22, 24, 26, 28, 30};
+    uint8_t g[68];
+
+    for (int n = -1; n <= 68; n++) {
+        const uint8_t *t = gf256_genpoly_for(n);
+        bool u = false;
+
+        for (int i = 0; i < (int)(sizeof(used) / sizeof(used[0])); i++)
+            u |= used[i] == n;
+
+        assert((t != NULL) == u);
+
+        if (t == NULL)
+            continue;
+
+        gf256_genpoly(n, g);
+
+        for (int i = 0; i < n; i++)
+            assert(t[i] == g[i]);
+    }
+}
+
 static void test_gf256_divpoly_40L(void) {
     const uint8_t expected[] = {
         189, 137, 252, 139, 254, 105, 3,  191, 148, 6,  155, 201, 191, 108, 82,
@@ -119,13 +143,157 @@ static void test_gf256_divpoly_divide0(void) {
         assert(r_g1b2[i] == expected[i]);
 }
 
+static uint8_t gf256_mul_reference(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+
+    for (int i = 0; i < 8; i++) {
+        if (b & 1)
+            p ^= a;
+
+        a = (a << 1) ^ (a & 0x80 ? 0x1D : 0);
+        b >>= 1;
+    }
+
+    return p;
+}
+
+static void gf256_divpoly_reference(uint8_t r[], int l, const uint8_t m[],
+                                    int n, const uint8_t g[]) {
+    uint8_t t[l + n];
+    uint8_t c[n];
+
+    for (int j = 0; j < n; j++) {
+        c[j] = 1;
+
+        for (int k = 0; k < g[n - 1 - j]; k++)
+            c[j] = gf256_mul_reference(c[j], 2);
+    }
+
+    for (int i = 0; i < l + n; i++)
+        t[i] = i < l ? m[i] : 0;
+
+    for (int i = 0; i < l; i++)
+        for (int j = 0; j < n; j++)
+            t[i + j + 1] ^= gf256_mul_reference(t[i], c[j]);
+
+    for (int i = 0; i < n; i++)
+        r[i] = t[l + i];
+}
+
+static void test_gf256_divpoly_kernels(void) {
+    const gf256_kernel_t kernels[] = {GF256_KERNEL_TABLE, GF256_KERNEL_SSSE3,
+                                      GF256_KERNEL_AVX2};
+    uint8_t m[150];
+    uint8_t g[68];
+    uint8_t expected[68];
+    uint8_t r[68];
+
+    srand(1);
+
+    for (int n = 1; n <= 68; n++) {
+        gf256_genpoly(n, g);
+
+        for (int l = 1; l <= 150; l += 7) {
+            for (int i = 0; i < l; i++)
+                m[i] = rand() & 0xFF;
+
+            gf256_divpoly_reference(expected, l, m, n, g);
+
+            gf256_divpoly(r, l, m, n, g);
+
+            for (int i = 0; i < n; i++)
+                assert(r[i] == expected[i]);
+
+            for (int k = 0; k < 3; k++) {
+                if (!gf256_kernel_supported(kernels[k], n))
+                    continue;
+
+                gf256_divpoly_kernel(kernels[k], r, l, m, n, g);
+
+                for (int i = 0; i < n; i++)
+                    assert(r[i] == expected[i]);
+            }
+        }
+    }
+}
+
+static void test_gf256_update_remainder(void) {
+    uint8_t m[123];
+    uint8_t g[30];
+    uint8_t t[123 * 30];
+    uint8_t expected[30];
+    uint8_t r[30];
+
+    srand(2);
+
+    for (int n = 7; n <= 30; n++) {
+        gf256_genpoly(n, g);
+        gf256_position_remainders(123, n, g, t);
+
+        for (int l = 1; l <= 123; l += 11) {
+            for (int i = 0; i < l; i++)
+                m[i] = rand() & 0xFF;
+
+            gf256_divpoly(r, l, m, n, g);
+
+            for (int k = 0; k < 4; k++) {
+                int p = rand() % l;
+                uint8_t c = rand() & 0xFF;
+
+                gf256_update_remainder(r, n, &t[(l - 1 - p) * n], m[p] ^ c);
+                m[p] = c;
+            }
+
+            gf256_divpoly_reference(expected, l, m, n, g);
+
+            for (int i = 0; i < n; i++)
+                assert(r[i] == expected[i]);
+        }
+    }
+}
+
+static void test_gf256_syndromes(void) {
+    uint8_t c[153];
+    uint8_t g[30];
+    uint8_t s[30];
+
+    srand(3);
+
+    for (int n = 7; n <= 30; n++) {
+        gf256_genpoly(n, g);
+
+        for (int l = 1; l <= 123; l += 11) {
+            for (int i = 0; i < l; i++)
+                c[i] = rand() & 0xFF;
+
+            gf256_divpoly(&c[l], l, c, n, g);
+
+            assert(gf256_syndromes(s, l + n, c, n));
+
+            for (int i = 0; i < n; i++)
+                assert(s[i] == 0);
+
+            // any single error is detected
+            int p = rand() % (l + n);
+
+            c[p] ^= 1 + rand() % 255;
+
+            assert(!gf256_syndromes(s, l + n, c, n));
+        }
+    }
+}
+
 int main(int argc, char const *argv[]) {
     test_gf256_genpoly();
+    test_gf256_genpoly_for();
 
     test_gf256_divpoly_40L();
     test_gf256_divpoly_discard0_first();
     test_gf256_divpoly_discard0_last();
     test_gf256_divpoly_divide0();
+    test_gf256_divpoly_kernels();
+    test_gf256_update_remainder();
+    test_gf256_syndromes();
 
     return 0;
 }
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "encode.h"
 
 static const int chr_capacities[][4][4] = {
@@ -219,7 +221,7 @@ static void test_encode_byte_mode(void) {
 }
 
 static void test_encode_kanji_mode(void) {
-    const uint8_t expected[] = {128, 77, 85,  26, 92,  0,  236, 17, 236, 17,
+    const uint8_t expected[] = {128, 45, 85,  26, 92,  0,  236, 17, 236, 17,
                                 236, 17, 236, 17, 236, 17, 236, 17, 236};
 
     uint8_t s[] = {0xE4, 0xAA, 0x89, 0xD7, '\0'};
@@ -280,6 +282,120 @@ static void test_terminator_4(void) {
         assert(d[i] == expected[i]);
 }
 
+static void test_encode_segments(void) {
+    const uint8_t expected[] = {16, 16,  12, 50, 1,   28, 212, 2,   97, 98,
+                                0,  236, 17, 236, 17, 236, 17, 236, 17};
+
+    // numeric "0123", alphanumeric "AB" and byte "ab"
+    uint8_t s[] = "0123ABab";
+    const segment_t g[] = {{ENCODING_MODE_NUMERIC, 0, 4},
+                           {ENCODING_MODE_ALPHANUMERIC, 4, 2},
+                           {ENCODING_MODE_BYTE, 6, 2}};
+    int v = 0;
+    int n = 19;
+
+    uint8_t d[n];
+    encode_segments(n, d, s, 3, g, v);
+
+    for (int i = 0; i < n; i++)
+        assert(d[i] == expected[i]);
+}
+
+static void put_bits(uint8_t d[], int *k, int n, int v) {
+    for (int i = n - 1; i >= 0; i--, (*k)++)
+        d[*k / 8] |= (v >> i & 1) << (7 - *k % 8);
+}
+
+static int alphanumeric_value(uint8_t c) {
+    return strchr("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:", c) -
+           "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+}
+
+static void test_encode_long_segments(void) {
+    const char *alphanumerics = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+    uint8_t s[400];
+    uint8_t d[500];
+    uint8_t expected[500];
+    int v = 9;
+    int n = 500;
+
+    srand(3);
+
+    for (int r = 0; r < 200; r++) {
+        int l[4] = {rand() % 120, rand() % 120, rand() % 40, rand() % 30 * 2};
+        segment_t g[4];
+        int o = 0;
+        int k = 0;
+
+        memset(expected, 0, sizeof(expected));
+
+        for (int m = 0; m < 4; m++) {
+            g[m] = (segment_t){m, o, l[m]};
+
+            for (int i = 0; i < l[m]; i++)
+                s[o + i] = m == ENCODING_MODE_NUMERIC ? '0' + rand() % 10
+                           : m == ENCODING_MODE_ALPHANUMERIC
+                               ? alphanumerics[rand() % 45]
+                           : m == ENCODING_MODE_BYTE ? rand() % 256
+                           : i % 2 == 0 ? 0x88 + rand() % 0x10
+                                        : 0x40 + rand() % 0x3F;
+
+            put_bits(expected, &k, 4, 1 << m);
+            put_bits(expected, &k, (int[]){12, 11, 16, 10}[m],
+                     m == ENCODING_MODE_KANJI ? l[m] / 2 : l[m]);
+
+            for (int i = 0; i < l[m];) {
+                const uint8_t *p = &s[o + i];
+
+                if (m == ENCODING_MODE_NUMERIC) {
+                    int c = l[m] - i < 3 ? l[m] - i : 3;
+                    int x = 0;
+
+                    for (int j = 0; j < c; j++)
+                        x = x * 10 + p[j] - '0';
+
+                    put_bits(expected, &k, c * 3 + 1, x);
+                    i += c;
+
+                } else if (m == ENCODING_MODE_ALPHANUMERIC) {
+                    if (l[m] - i == 1) {
+                        put_bits(expected, &k, 6, alphanumeric_value(p[0]));
+                        i++;
+                    } else {
+                        put_bits(expected, &k, 11,
+                                 alphanumeric_value(p[0]) * 45 +
+                                     alphanumeric_value(p[1]));
+                        i += 2;
+                    }
+
+                } else if (m == ENCODING_MODE_BYTE) {
+                    put_bits(expected, &k, 8, p[0]);
+                    i++;
+
+                } else {
+                    int x = (p[0] << 8 | p[1]) - 0x8140;
+
+                    put_bits(expected, &k, 13, (x >> 8) * 0xC0 + (x & 0xFF));
+                    i += 2;
+                }
+            }
+
+            o += l[m];
+        }
+
+        k += 4;
+        k = (k + 7) / 8;
+
+        for (int i = 0; k < n; i++)
+            expected[k++] = i % 2 == 0 ? 236 : 17;
+
+        encode_segments(n, d, s, 4, g, v);
+
+        for (int i = 0; i < n; i++)
+            assert(d[i] == expected[i]);
+    }
+}
+
 int main(int argc, char const *argv[]) {
     test_min_version();
 
@@ -287,6 +403,8 @@ int main(int argc, char const *argv[]) {
     test_encode_alphanumeric_mode();
     test_encode_byte_mode();
     test_encode_kanji_mode();
+    test_encode_segments();
+    test_encode_long_segments();
 
     test_terminator_0();
     test_terminator_1();
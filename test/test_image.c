@@ -0,0 +1,251 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+
+static bitmatrix_t matrix;
+
+static void fill_random(int n) {
+    // bits outside of the matrix must not be written
+    memset(matrix.r, 0xFF, sizeof(matrix.r));
+    matrix.n = n;
+
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            bitmatrix_set(&matrix, i, j, rand() % 2);
+}
+
+static bool is_dark(int y, int x, int q) {
+    int n = matrix.n;
+
+    return y >= q && y < n + q && x >= q && x < n + q &&
+           bitmatrix_get(&matrix, y - q, x - q);
+}
+
+static void test_image_scale_row(void) {
+    static image_scaler_t t;
+    uint8_t d[IMAGE_MAX_ROW_BYTES];
+
+    for (int s = 1; s <= IMAGE_MAX_SCALE; s++) {
+        int q = s % (IMAGE_MAX_QUIET_ZONE + 1);
+
+        image_scaler_init(&t, s, q);
+        fill_random(177);
+
+        for (int y = -q; y < matrix.n + q; y++) {
+            int w = (matrix.n + q * 2) * s;
+            int l = image_scale_row(&t, d, &matrix, y);
+
+            assert(l == (w + 7) / 8);
+
+            for (int x = 0; x < l * 8; x++)
+                assert((d[x / 8] >> (7 - x % 8) & 1) ==
+                       (x < w && is_dark(y + q, x / s, q)));
+        }
+    }
+}
+
+static void test_write_bmp(void) {
+    for (int n = 21; n <= 177; n += 52)
+        for (int s = 1; s <= 3; s++) {
+            int q = 4 - s;
+            int w = (n + q * 2) * s;
+            int k = ((w + 31) & ~31) >> 3;
+            uint8_t *d;
+            size_t l;
+            FILE *f = open_memstream((char **)&d, &l);
+
+            fill_random(n);
+            write_bmp(&matrix, s, q, f);
+            fclose(f);
+
+            assert(l == 62 + (size_t)w * k);
+            assert(d[0] == 'B' && d[1] == 'M');
+            assert((d[18] | d[19] << 8) == w && (d[22] | d[23] << 8) == w);
+
+            // the rows are bottom-up
+            for (int y = 0; y < w; y++)
+                for (int x = 0; x < k * 8; x++)
+                    assert((d[62 + (w - 1 - y) * k + x / 8] >> (7 - x % 8) &
+                            1) == (x < w && is_dark(y / s, x / s, q)));
+
+            free(d);
+        }
+}
+
+static void test_write_pbm(void) {
+    const int quiet_zones[] = {0, 1, 4, 7, IMAGE_MAX_QUIET_ZONE};
+
+    for (int n = 21; n <= 177; n += 4)
+        for (int k = 0; k < 5; k++) {
+            int q = quiet_zones[k];
+            int s = k + 1;
+            int w = (n + q * 2) * s;
+            char h[32];
+            char *d;
+            size_t l;
+            FILE *f = open_memstream(&d, &l);
+
+            fill_random(n);
+            write_pbm(&matrix, s, q, f);
+            fclose(f);
+
+            int p = snprintf(h, sizeof(h), "P4\n%d %d\n", w, w);
+
+            assert(l == p + (size_t)w * ((w + 7) / 8));
+            assert(memcmp(d, h, p) == 0);
+
+            for (int y = 0; y < w; y++)
+                for (int x = 0; x < (w + 7) / 8 * 8; x++)
+                    assert((d[p + y * ((w + 7) / 8) + x / 8] >> (7 - x % 8) &
+                            1) == (x < w && is_dark(y / s, x / s, q)));
+
+            free(d);
+        }
+}
+
+static void test_write_pgm(void) {
+    const int scales[] = {1, 2, 5, IMAGE_MAX_SCALE};
+
+    for (int n = 21; n <= 177; n += 52)
+        for (int k = 0; k < 4; k++) {
+            int s = scales[k];
+            int q = k;
+            int w = (n + q * 2) * s;
+            char h[32];
+            char *d;
+            size_t l;
+            FILE *f = open_memstream(&d, &l);
+
+            fill_random(n);
+            write_pgm(&matrix, s, q, f);
+            fclose(f);
+
+            int p = snprintf(h, sizeof(h), "P5\n%d %d\n255\n", w, w);
+
+            assert(l == p + (size_t)w * w);
+            assert(memcmp(d, h, p) == 0);
+
+            for (int y = 0; y < w; y++)
+                for (int x = 0; x < w; x++)
+                    assert((uint8_t)d[p + (size_t)y * w + x] ==
+                           (is_dark(y / s, x / s, q) ? 0 : 255));
+
+            free(d);
+        }
+}
+
+static void test_write_raw(void) {
+    for (int n = 21; n <= 177; n += 4) {
+        qrcg_symbol_t s = {(n - 17) / 4 - 1, ERROR_CORRECTION_LEVEL_H, n, 5,
+                           &matrix};
+        char *d;
+        size_t l;
+        FILE *f = open_memstream(&d, &l);
+
+        fill_random(n);
+        write_raw(&s, f);
+        fclose(f);
+
+        assert(l == 8 + (size_t)n * ((n + 7) / 8));
+        assert(memcmp(d, "QRBM", 4) == 0);
+        assert(d[4] == (n - 17) / 4 && d[5] == 3 && d[6] == 5 &&
+               (uint8_t)d[7] == n);
+
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < (n + 7) / 8 * 8; x++)
+                assert((d[8 + y * ((n + 7) / 8) + x / 8] >> (7 - x % 8) & 1) ==
+                       (x < n && bitmatrix_get(&matrix, y, x)));
+
+        free(d);
+    }
+}
+
+typedef struct chunks {
+    uint8_t *data;
+    size_t length;
+    int count;
+} chunks_t;
+
+static void collect(void *a, const uint8_t d[], size_t n) {
+    chunks_t *c = a;
+
+    // only writes larger than the buffer are passed without buffering
+    assert(n > 0 && n <= IMAGE_STREAM_BUFFER_LENGTH);
+
+    c->data = realloc(c->data, c->length + n);
+    assert(c->data != NULL);
+
+    memcpy(&c->data[c->length], d, n);
+    c->length += n;
+    c->count++;
+}
+
+static void test_stream_bmp(void) {
+    const int s = IMAGE_MAX_SCALE;
+    const int q = IMAGE_MAX_QUIET_ZONE;
+    chunks_t c = {NULL, 0, 0};
+    char *d;
+    size_t l;
+    FILE *f = open_memstream(&d, &l);
+
+    fill_random(177);
+    write_bmp(&matrix, s, q, f);
+    fclose(f);
+
+    stream_bmp(&matrix, s, q, collect, &c);
+
+    // the same image, in chunks that are never larger than the buffer
+    assert(c.length == l);
+    assert(memcmp(c.data, d, l) == 0);
+    assert(c.count >= (int)(l / IMAGE_STREAM_BUFFER_LENGTH));
+
+    free(c.data);
+    free(d);
+}
+
+static void test_image_stream_write(void) {
+    static image_stream_t w;
+    static uint8_t d[IMAGE_STREAM_BUFFER_LENGTH * 2 + 1];
+    uint8_t b[sizeof(d) * 2];
+    image_buffer_t t = {b, sizeof(b), 0};
+
+    for (size_t i = 0; i < sizeof(d); i++)
+        d[i] = i * 7;
+
+    image_stream_init(&w, image_buffer_sink, &t);
+
+    // small writes are buffered and large ones are passed through
+    image_stream_write(&w, d, 10);
+    assert(t.length == 0);
+
+    image_stream_write(&w, &d[10], sizeof(d) - 10);
+    assert(t.length == sizeof(d));
+
+    image_stream_write(&w, d, 10);
+    image_stream_flush(&w);
+    image_stream_flush(&w);
+
+    assert(t.length == sizeof(d) + 10);
+    assert(memcmp(b, d, sizeof(d)) == 0);
+    assert(memcmp(&b[sizeof(d)], d, 10) == 0);
+
+    // a buffer that is too short is counted like snprintf()
+    t = (image_buffer_t){b, 5, 0};
+    image_buffer_sink(&t, d, 10);
+    image_buffer_sink(&t, d, 10);
+    assert(t.length == 20);
+}
+
+int main(int argc, char const *argv[]) {
+    test_image_scale_row();
+    test_write_bmp();
+    test_write_pbm();
+    test_write_pgm();
+    test_write_raw();
+    test_stream_bmp();
+    test_image_stream_write();
+
+    return 0;
+}
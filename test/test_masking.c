@@ -1,10 +1,19 @@
 #include <assert.h>
+#include <stdlib.h>
 #include "mask.h"
 
+static void load_matrix(int n, bitmatrix_t *m, const uint8_t s[][n]) {
+    bitmatrix_fill(m, n, false);
+
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            bitmatrix_set(m, i, j, s[i][j] == 1);
+}
+
 static void test_eval_penalty_1to3(void) {
 
     // "HELLO WORLD" encoded in version 1-Q
-    const module_type_t matrix[][21] = {
+    const uint8_t matrix[][21] = {
         {1, 1, 1, 1, 1, 1, 1, 0, 2, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1},
         {1, 0, 0, 0, 0, 0, 1, 0, 2, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1},
         {1, 0, 1, 1, 1, 0, 1, 0, 2, 0, 1, 1, 0, 0, 1, 0, 1, 1, 1, 0, 1},
@@ -28,7 +37,7 @@ static void test_eval_penalty_1to3(void) {
         {1, 1, 1, 1, 1, 1, 1, 0, 2, 0, 1, 1, 1, 1, 0, 1, 1, 0, 1, 0, 0}};
 
     // modules that mask is applied
-    const bool flags[][21] = {
+    const uint8_t flags[][21] = {
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
@@ -51,75 +60,286 @@ static void test_eval_penalty_1to3(void) {
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}};
 
-    module_type_t masked[21][21];
+    bitmatrix_t m;
+    bitmatrix_t f;
+    bitmatrix_t masked;
+
+    load_matrix(21, &m, matrix);
+    load_matrix(21, &f, flags);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 0);
-    assert(eval_penalty(21, masked) == 347);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 0);
+    assert(eval_penalty(&masked) == 347);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 1);
-    assert(eval_penalty(21, masked) == 470);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 1);
+    assert(eval_penalty(&masked) == 470);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 2);
-    assert(eval_penalty(21, masked) == 506);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 2);
+    assert(eval_penalty(&masked) == 506);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 3);
-    assert(eval_penalty(21, masked) == 441);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 3);
+    assert(eval_penalty(&masked) == 441);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 4);
-    assert(eval_penalty(21, masked) == 539);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 4);
+    assert(eval_penalty(&masked) == 539);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 5);
-    assert(eval_penalty(21, masked) == 516);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 5);
+    assert(eval_penalty(&masked) == 516);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 6);
-    assert(eval_penalty(21, masked) == 314);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 6);
+    assert(eval_penalty(&masked) == 314);
 
-    mask_modules(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q, 7);
-    assert(eval_penalty(21, masked) == 558);
+    mask_modules(&masked, &m, &f, ERROR_CORRECTION_LEVEL_Q, 7);
+    assert(eval_penalty(&masked) == 558);
 
-    mask_modules_auto(21, masked, matrix, flags, ERROR_CORRECTION_LEVEL_Q);
-    assert(eval_penalty(21, masked) == 314);
+    bitmatrix_t candidates[MASK_PATTERNS];
+
+    assert(mask_modules_auto(candidates, &m, &f, ERROR_CORRECTION_LEVEL_Q,
+                             NULL) == 6);
+    assert(eval_penalty(&candidates[6]) == 314);
 }
 
 static void test_eval_penalty_4(void) {
 
     // the percentage of dark modules is 25%
-    const module_type_t matrix_25[][4] = {
+    const uint8_t matrix_25[][4] = {
         {0, 0, 0, 0},
         {0, 1, 0, 1},
         {0, 0, 0, 0},
         {0, 1, 0, 1}};
 
     // the percentage of dark modules is 50%
-    const module_type_t matrix_50[][4] = {
+    const uint8_t matrix_50[][4] = {
         {1, 0, 1, 0},
         {0, 1, 0, 1},
         {1, 0, 1, 0},
         {0, 1, 0, 1}};
 
     // the percentage of dark modules is 62.5%
-    const module_type_t matrix_62[][4] = {
+    const uint8_t matrix_62[][4] = {
         {1, 1, 1, 0},
         {0, 1, 0, 1},
         {1, 0, 1, 0},
         {0, 1, 1, 1}};
 
     // the percentage of dark modules is 100% + (penalty2 * 9)
-    const module_type_t matrix_100[][4] = {
+    const uint8_t matrix_100[][4] = {
         {1, 1, 1, 1},
         {1, 1, 1, 1},
         {1, 1, 1, 1},
         {1, 1, 1, 1}};
 
-    assert(eval_penalty(4, matrix_25) == 50);
-    assert(eval_penalty(4, matrix_50) == 0);
-    assert(eval_penalty(4, matrix_62) == 20);
-    assert(eval_penalty(4, matrix_100) == 127);
+    bitmatrix_t m;
+
+    load_matrix(4, &m, matrix_25);
+    assert(eval_penalty(&m) == 50);
+
+    load_matrix(4, &m, matrix_50);
+    assert(eval_penalty(&m) == 0);
+
+    load_matrix(4, &m, matrix_62);
+    assert(eval_penalty(&m) == 20);
+
+    load_matrix(4, &m, matrix_100);
+    assert(eval_penalty(&m) == 127);
+}
+
+// scores the matrix module by module as the QR code specification describes
+static int eval_penalty_reference(const bitmatrix_t *m) {
+    int n = m->n;
+    int s = 0;
+    int d = 0;
+
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < n; i++) {
+            int u = -1;
+            int l = 0;
+            int p = 0;
+
+            for (int j = 0; j < n; j++) {
+                int t = bitmatrix_get(m, k ? j : i, k ? i : j);
+
+                if (t == u) {
+                    l++;
+
+                } else {
+                    if (l >= 5)
+                        s += 3 + (l - 5);
+
+                    l = 1;
+                    u = t;
+                }
+
+                p = (p << 1 | t) & 0x7FF;
+
+                if (j >= 10 && (p == 0x5D0 || p == 0x5D))
+                    s += 40;
+            }
+
+            if (l >= 5)
+                s += 3 + (l - 5);
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            int t = bitmatrix_get(m, i, j);
+
+            d += t;
+
+            if (i < n - 1 && j < n - 1 && t == bitmatrix_get(m, i, j + 1) &&
+                t == bitmatrix_get(m, i + 1, j) &&
+                t == bitmatrix_get(m, i + 1, j + 1))
+                s += 3;
+        }
+
+    return s + abs(d * 2 - (n * n)) * 10 / (n * n) * 10;
+}
+
+static void test_eval_penalty_random(void) {
+    const int lengths[] = {4, 11, 21, 25, 63, 64, 65, 101, 128, 129, 177, 185};
+    bitmatrix_t m;
+
+    srand(1);
+
+    for (int k = 0; k < (int)(sizeof(lengths) / sizeof(lengths[0])); k++) {
+        int n = lengths[k];
+
+        for (int r = 0; r < 20; r++) {
+            bitmatrix_fill(&m, n, false);
+
+            // runs of random lengths make every evaluation condition apply
+            for (int i = 0; i < n; i++) {
+                bool b = rand() % 2;
+
+                for (int j = 0; j < n; j++) {
+                    if (rand() % (r % 4 + 2) == 0)
+                        b = !b;
+
+                    bitmatrix_set(&m, i, j, b);
+                }
+            }
+
+            assert(eval_penalty(&m) == eval_penalty_reference(&m));
+        }
+    }
+}
+
+static void test_mask_modules_auto_pool(void) {
+    static bitmatrix_t candidates[MASK_PATTERNS];
+    static bitmatrix_t expected;
+    static bitmatrix_t m;
+    static bitmatrix_t f;
+    pool_t *pool = pool_create(4);
+
+    assert(pool != NULL);
+
+    srand(2);
+
+    for (int r = 0; r < 10; r++) {
+        int n = 21 + r * 16;
+
+        bitmatrix_fill(&m, n, false);
+        bitmatrix_fill(&f, n, true);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                bitmatrix_set(&m, i, j, rand() % 2);
+
+        int p = 0;
+        int l = -1;
+
+        for (int i = 0; i < MASK_PATTERNS; i++) {
+            mask_modules(&expected, &m, &f, ERROR_CORRECTION_LEVEL_M, i);
+
+            int z = eval_penalty(&expected);
+
+            if (l < 0 || z < l) {
+                l = z;
+                p = i;
+            }
+        }
+
+        mask_modules(&expected, &m, &f, ERROR_CORRECTION_LEVEL_M, p);
+
+        assert(mask_modules_auto(candidates, &m, &f, ERROR_CORRECTION_LEVEL_M,
+                                 pool) == p);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+                assert(candidates[p].r[i][j] == expected.r[i][j]);
+    }
+
+    pool_destroy(pool);
+}
+
+static void test_mask_modules_update(void) {
+    static mask_state_t t;
+    static bitmatrix_t expected;
+    static bitmatrix_t m;
+    static bitmatrix_t f;
+    const error_correction_level_t levels[] = {ERROR_CORRECTION_LEVEL_L,
+                                               ERROR_CORRECTION_LEVEL_H};
+
+    srand(3);
+    mask_state_reset(&t);
+
+    for (int r = 0; r < 6; r++) {
+        int n = 21 + r * 31;
+
+        bitmatrix_fill(&m, n, false);
+        bitmatrix_fill(&f, n, false);
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                bitmatrix_set(&m, i, j, rand() % 2);
+                bitmatrix_set(&f, i, j, i > 8 && j > 8);
+            }
+        }
+
+        // a few changed modules are updated, many are evaluated from scratch
+        for (int k = 0; k < 24; k++) {
+            error_correction_level_t e = levels[k / 12];
+            int c = k % 6 == 5 ? n * n / 2 : k % 6;
+
+            for (int i = 0; i < c; i++) {
+                int y = 9 + rand() % (n - 9);
+                int x = 9 + rand() % (n - 9);
+
+                bitmatrix_set(&m, y, x, !bitmatrix_get(&m, y, x));
+            }
+
+            int p = mask_modules_update(&t, &m, &f, e, NULL);
+            int l = -1;
+
+            for (int i = 0; i < MASK_PATTERNS; i++) {
+                mask_modules(&expected, &m, &f, e, i);
+
+                int z = eval_penalty(&expected);
+
+                assert(t.penalties[i] == z);
+
+                if (l < 0 || z < l)
+                    l = z;
+
+                for (int y = 0; y < n; y++)
+                    for (int j = 0; j < BITMATRIX_ROW_WORDS; j++)
+                        assert(t.candidates[i].r[y][j] == expected.r[y][j]);
+            }
+
+            assert(t.penalties[p] == l);
+
+            for (int i = 0; i < p; i++)
+                assert(t.penalties[i] > l);
+        }
+    }
 }
 
 int main(int argc, char const *argv[]) {
     test_eval_penalty_1to3();
     test_eval_penalty_4();
+    test_eval_penalty_random();
+    test_mask_modules_auto_pool();
+    test_mask_modules_update();
 
     return 0;
 }
@@ -33,12 +33,16 @@ static void test_build_final_message(void) {
 
     uint8_t f[135];
 
-    build_final_message(f, d, e, (rs_block_info_t){18, 2, 15, 2, 16});
+    build_final_message(f, d, e, 4, ERROR_CORRECTION_LEVEL_Q);
 
     for (int i = 0; i < 134; i++)
         assert(f[i] == expected[i]);
 
     assert(f[134] == 0);
+
+    // the codewords of the blocks are not changed
+    assert(d[0] == 67 && d[1] == 85 && d[61] == 236);
+    assert(e[0] == 213 && e[1] == 199 && e[71] == 74);
 }
 
 int main(int argc, char const *argv[]) {
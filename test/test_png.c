@@ -0,0 +1,370 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+#include "image.h"
+#include "png.h"
+
+typedef struct bit_reader {
+    const uint8_t *d;
+    size_t n;
+    size_t i;
+    int b;
+} bit_reader_t;
+
+typedef struct huffman {
+    int counts[16];
+    int symbols[288];
+} huffman_t;
+
+static const int length_bases[] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                   15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                   67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const int length_extra_bits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                        1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int distance_bases[] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,
+    97,  129, 193, 257, 385, 513,  769,  1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577};
+static const int distance_extra_bits[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                          4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                          9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const int codelen_order[] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+static int get_bits(bit_reader_t *r, int n) {
+    int v = 0;
+
+    for (int k = 0; k < n; k++) {
+        assert(r->i < r->n);
+
+        v |= (r->d[r->i] >> r->b & 1) << k;
+
+        if (++r->b == 8) {
+            r->b = 0;
+            r->i++;
+        }
+    }
+
+    return v;
+}
+
+static void build_huffman(huffman_t *h, const uint8_t l[], int n) {
+    int offsets[16];
+
+    memset(h->counts, 0, sizeof(h->counts));
+
+    for (int i = 0; i < n; i++)
+        h->counts[l[i]]++;
+
+    h->counts[0] = 0;
+    offsets[1] = 0;
+
+    for (int b = 1; b < 15; b++)
+        offsets[b + 1] = offsets[b] + h->counts[b];
+
+    for (int i = 0; i < n; i++)
+        if (l[i] != 0)
+            h->symbols[offsets[l[i]]++] = i;
+}
+
+static int decode_symbol(bit_reader_t *r, const huffman_t *h) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int b = 1; b < 16; b++) {
+        code |= get_bits(r, 1);
+
+        if (code - h->counts[b] < first)
+            return h->symbols[index + code - first];
+
+        index += h->counts[b];
+        first = (first + h->counts[b]) << 1;
+        code <<= 1;
+    }
+
+    assert(false);
+    return -1;
+}
+
+// a minimal zlib decoder for the fixed and dynamic Huffman blocks
+static size_t inflate_zlib(const uint8_t d[], size_t n, uint8_t o[],
+                           size_t m) {
+    bit_reader_t r = {d, n, 2, 0};
+    size_t k = 0;
+    int last;
+
+    assert((d[0] & 0x0F) == 8 && (d[0] << 8 | d[1]) % 31 == 0);
+
+    do {
+        uint8_t lengths[320];
+        huffman_t lh;
+        huffman_t dh;
+
+        last = get_bits(&r, 1);
+
+        int type = get_bits(&r, 2);
+
+        if (type == 1) {
+            for (int i = 0; i < 288; i++)
+                lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+
+            for (int i = 0; i < 30; i++)
+                lengths[288 + i] = 5;
+
+            build_huffman(&lh, lengths, 288);
+            build_huffman(&dh, &lengths[288], 30);
+
+        } else {
+            assert(type == 2);
+
+            int hlit = get_bits(&r, 5) + 257;
+            int hdist = get_bits(&r, 5) + 1;
+            int hclen = get_bits(&r, 4) + 4;
+            uint8_t cl[19] = {0};
+            huffman_t ch;
+
+            for (int i = 0; i < hclen; i++)
+                cl[codelen_order[i]] = get_bits(&r, 3);
+
+            build_huffman(&ch, cl, 19);
+
+            for (int i = 0; i < hlit + hdist;) {
+                int s = decode_symbol(&r, &ch);
+                int c = 1;
+                int v = s;
+
+                if (s == 16) {
+                    assert(i > 0);
+                    c = 3 + get_bits(&r, 2);
+                    v = lengths[i - 1];
+
+                } else if (s == 17) {
+                    c = 3 + get_bits(&r, 3);
+                    v = 0;
+
+                } else if (s == 18) {
+                    c = 11 + get_bits(&r, 7);
+                    v = 0;
+                }
+
+                assert(i + c <= hlit + hdist);
+
+                while (c-- > 0)
+                    lengths[i++] = v;
+            }
+
+            build_huffman(&lh, lengths, hlit);
+            build_huffman(&dh, &lengths[hlit], hdist);
+        }
+
+        for (;;) {
+            int s = decode_symbol(&r, &lh);
+
+            if (s < 256) {
+                assert(k < m);
+                o[k++] = s;
+                continue;
+            }
+
+            if (s == 256)
+                break;
+
+            s -= 257;
+
+            int l = length_bases[s] + get_bits(&r, length_extra_bits[s]);
+            int t = decode_symbol(&r, &dh);
+            size_t e = distance_bases[t] + get_bits(&r, distance_extra_bits[t]);
+
+            assert(e <= k && k + l <= m);
+
+            for (int i = 0; i < l; i++, k++)
+                o[k] = o[k - e];
+        }
+    } while (!last);
+
+    if (r.b != 0)
+        r.i++;
+
+    assert(r.i + 4 == n);
+
+    uint32_t a = deflate_adler32(1, o, k);
+
+    assert(d[n - 4] == (uint8_t)(a >> 24) && d[n - 3] == (uint8_t)(a >> 16) &&
+           d[n - 2] == (uint8_t)(a >> 8) && d[n - 1] == (uint8_t)a);
+
+    return k;
+}
+
+static uint32_t get_uint32_be(const uint8_t d[]) {
+    return (uint32_t)d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+}
+
+typedef struct buffer {
+    uint8_t *d;
+    size_t n;
+} buffer_t;
+
+static void append(void *a, const uint8_t d[], size_t n) {
+    buffer_t *b = a;
+
+    b->d = realloc(b->d, b->n + n);
+    assert(b->d != NULL);
+
+    memcpy(&b->d[b->n], d, n);
+    b->n += n;
+}
+
+static void test_checksums(void) {
+    assert(png_crc32(0, (const uint8_t *)"123456789", 9) == 0xCBF43926);
+    assert(png_crc32(png_crc32(0, (const uint8_t *)"1234", 4),
+                     (const uint8_t *)"56789", 5) == 0xCBF43926);
+    assert(deflate_adler32(1, (const uint8_t *)"Wikipedia", 9) == 0x11E60398);
+}
+
+static void test_deflate_rows(void) {
+    static deflate_t z;
+    static uint8_t raw[600000];
+    static uint8_t out[600000];
+    const int lengths[] = {1, 5, 100, 837, 1024};
+
+    srand(1);
+
+    for (int t = 0; t < 5; t++) {
+        int l = lengths[t];
+        int rows = sizeof(raw) / l < 500 ? sizeof(raw) / l : 500;
+        buffer_t b = {NULL, 0};
+        size_t n = 0;
+
+        deflate_init(&z, append, &b);
+
+        // runs, repeated rows and noise
+        for (int i = 0; i < rows; i++) {
+            uint8_t *r = &raw[n];
+
+            for (int j = 0; j < l; j++)
+                r[j] = i > 0 && rand() % 3 == 0 ? r[j - l]
+                       : j > 0 && rand() % 4 != 0 ? r[j - 1]
+                                                  : rand() & 0xFF;
+
+            deflate_row(&z, r, l);
+            n += l;
+        }
+
+        deflate_finish(&z);
+
+        assert(inflate_zlib(b.d, b.n, out, sizeof(out)) == n);
+        assert(memcmp(raw, out, n) == 0);
+
+        free(b.d);
+    }
+}
+
+static void check_png(const uint8_t d[], size_t n, const bitmatrix_t *m,
+                      const png_options_t *o) {
+    static uint8_t idat[1 << 20];
+    static uint8_t raw[1 << 23];
+    size_t k = 0;
+    size_t i = 8;
+    int width = (m->n + o->quiet_zone * 2) * o->scale;
+    int stride = (width + 7) / 8;
+
+    assert(memcmp(d, "\x89PNG\r\n\x1A\n", 8) == 0);
+
+    for (;;) {
+        uint32_t l = get_uint32_be(&d[i]);
+
+        assert(i + 12 + l <= n);
+        assert(png_crc32(0, &d[i + 4], l + 4) == get_uint32_be(&d[i + 8 + l]));
+
+        if (memcmp(&d[i + 4], "IHDR", 4) == 0) {
+            assert(l == 13);
+            assert(get_uint32_be(&d[i + 8]) == (uint32_t)width);
+            assert(get_uint32_be(&d[i + 12]) == (uint32_t)width);
+            assert(d[i + 16] == 1 && d[i + 17] == 0);
+
+        } else if (memcmp(&d[i + 4], "IDAT", 4) == 0) {
+            memcpy(&idat[k], &d[i + 8], l);
+            k += l;
+        }
+
+        i += 12 + l;
+
+        if (memcmp(&d[i - 8 - l], "IEND", 4) == 0)
+            break;
+    }
+
+    assert(i == n);
+    assert(inflate_zlib(idat, k, raw, sizeof(raw)) ==
+           (size_t)width * (stride + 1));
+
+    for (int y = 0; y < width; y++) {
+        uint8_t *r = &raw[y * (stride + 1)];
+        const uint8_t *p = y > 0 ? r - stride : NULL;
+
+        assert(r[0] <= 2);
+
+        // unfilter in place
+        for (int x = 1; x <= stride; x++) {
+            if (r[0] == 1)
+                r[x] += x > 1 ? r[x - 1] : 0;
+            else if (r[0] == 2)
+                r[x] += p != NULL ? p[x - 1] : 0;
+        }
+
+        for (int x = 0; x < width; x++) {
+            int my = y / o->scale - o->quiet_zone;
+            int mx = x / o->scale - o->quiet_zone;
+            bool dark = my >= 0 && my < m->n && mx >= 0 && mx < m->n &&
+                        bitmatrix_get(m, my, mx);
+
+            assert((r[1 + x / 8] >> (7 - x % 8) & 1) == !dark);
+        }
+    }
+}
+
+static void test_encode_png(void) {
+    static uint8_t d[1 << 20];
+    static bitmatrix_t m;
+    const png_options_t options[] = {{1, 4, PNG_FILTER_NONE},
+                                     {3, 0, PNG_FILTER_SUB},
+                                     {8, 2, PNG_FILTER_UP},
+                                     {5, 1, PNG_FILTER_AUTO},
+                                     {IMAGE_MAX_SCALE, IMAGE_MAX_QUIET_ZONE,
+                                      PNG_FILTER_NONE}};
+
+    srand(2);
+
+    for (int n = 21; n <= 177; n += 78) {
+        bitmatrix_fill(&m, n, false);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                bitmatrix_set(&m, i, j, rand() % 2);
+
+        for (int k = 0; k < 5; k++) {
+            size_t l = encode_png(d, sizeof(d), &m, &options[k]);
+
+            assert(l < sizeof(d));
+            check_png(d, l, &m, &options[k]);
+
+            // a short buffer gets the beginning of the same image
+            uint8_t s[64];
+
+            assert(encode_png(s, sizeof(s), &m, &options[k]) == l);
+            assert(memcmp(s, d, sizeof(s)) == 0);
+            assert(encode_png(NULL, 0, &m, &options[k]) == l);
+        }
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    test_checksums();
+    test_deflate_rows();
+    test_encode_png();
+
+    return 0;
+}
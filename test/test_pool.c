@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "pool.h"
+
+#define NUM_TASKS 10000
+
+static atomic_int counts[NUM_TASKS];
+
+static void count_task(void *a, int i, int w) {
+    assert(w >= 0 && w < pool_size(a));
+    atomic_fetch_add(&counts[i], 1);
+}
+
+static void test_pool_run(void) {
+    for (int n = 1; n <= 8; n *= 2) {
+        pool_t *p = pool_create(n);
+        assert(p != NULL);
+        assert(pool_size(p) == n);
+
+        for (int k = 0; k < 3; k++) {
+            for (int i = 0; i < NUM_TASKS; i++)
+                counts[i] = 0;
+
+            pool_run(p, NUM_TASKS - k, count_task, p);
+
+            for (int i = 0; i < NUM_TASKS - k; i++)
+                assert(counts[i] == 1);
+
+            assert(counts[NUM_TASKS - 1] == (k == 0));
+        }
+
+        pool_run(p, 0, count_task, p);
+        pool_destroy(p);
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    test_pool_run();
+
+    return 0;
+}
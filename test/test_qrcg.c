@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qrcg.h"
+
+static void test_qrcg_encode(void) {
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    qrcg_symbol_t q;
+
+    assert(c != NULL);
+
+    // "HELLO WORLD" in version 1-Q is masked with mask pattern 6
+    assert(qrcg_encode(c, (uint8_t *)"HELLO WORLD", 11,
+                       ERROR_CORRECTION_LEVEL_Q, &q) == 0);
+    assert(q.version == 0);
+    assert(q.ec_level == ERROR_CORRECTION_LEVEL_Q);
+    assert(q.length == 21);
+    assert(q.mask == 6);
+
+    bitmatrix_t first = *q.modules;
+
+    // the context is reused for a larger symbol and then for the first one
+    uint8_t s[QRCG_MAX_DATA_LENGTH + 1];
+    memset(s, '0', sizeof(s));
+
+    assert(qrcg_encode(c, s, QRCG_MAX_DATA_LENGTH, ERROR_CORRECTION_LEVEL_L,
+                       &q) == 0);
+    assert(q.version == 39);
+    assert(q.length == 177);
+
+    assert(qrcg_encode(c, (uint8_t *)"HELLO WORLD", 11,
+                       ERROR_CORRECTION_LEVEL_Q, &q) == 0);
+    assert(memcmp(&first, q.modules, sizeof(first)) == 0);
+
+    assert(qrcg_encode(c, s, QRCG_MAX_DATA_LENGTH + 1,
+                       ERROR_CORRECTION_LEVEL_L, &q) == QRCG_ERROR_TOO_LONG);
+    assert(qrcg_encode(c, s, QRCG_MAX_DATA_LENGTH, ERROR_CORRECTION_LEVEL_M,
+                       &q) == QRCG_ERROR_TOO_LONG);
+
+    qrcg_ctx_free(c);
+}
+
+static void test_qrcg_encode_incremental(void) {
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    qrcg_ctx_t *d = qrcg_ctx_new();
+    qrcg_symbol_t p;
+    qrcg_symbol_t q;
+    uint8_t s[3000];
+
+    assert(c != NULL && d != NULL);
+
+    memset(s, '0', sizeof(s));
+
+    // consecutive symbols of the same version reuse the previous blocks of c,
+    // while the blocks of d are encoded from scratch every time
+    for (int i = 0; i < 64; i++) {
+        s[sizeof(s) - 1] = '0' + i % 10;
+        s[sizeof(s) - 2] = '0' + i / 10;
+        s[i * 41 % sizeof(s)] = 'A' + i % 26;
+
+        int l = i % 16 == 15 ? 20 : sizeof(s);
+
+        assert(qrcg_encode(c, s, l, ERROR_CORRECTION_LEVEL_M, &p) == 0);
+        assert(qrcg_encode(d, s, l, ERROR_CORRECTION_LEVEL_M, &q) == 0);
+        assert(qrcg_encode(d, (uint8_t *)"0", 1, ERROR_CORRECTION_LEVEL_H,
+                           &q) == 0);
+        assert(qrcg_encode(d, s, l, ERROR_CORRECTION_LEVEL_M, &q) == 0);
+
+        assert(p.version == q.version);
+        assert(p.mask == q.mask);
+        assert(memcmp(p.modules, q.modules, sizeof(bitmatrix_t)) == 0);
+    }
+
+    qrcg_ctx_free(c);
+    qrcg_ctx_free(d);
+}
+
+static void test_qrcg_encode_pool(void) {
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    qrcg_ctx_t *d = qrcg_ctx_new();
+    pool_t *pool = pool_create(4);
+    qrcg_symbol_t p;
+    qrcg_symbol_t q;
+    uint8_t s[3000];
+
+    assert(c != NULL && d != NULL && pool != NULL);
+
+    qrcg_ctx_set_pool(c, pool);
+
+    for (int i = 0; i < (int)sizeof(s); i++)
+        s[i] = 'A' + i * 7 % 26;
+
+    // 40-H has 81 blocks, and the lengths go down to a single block
+    for (int l = 1852; l > 10; l = l * 2 / 3) {
+        for (int k = 0; k < 2; k++) {
+            s[l / 2] = 'A' + k;
+
+            assert(qrcg_encode(c, s, l, ERROR_CORRECTION_LEVEL_H, &p) == 0);
+            assert(qrcg_encode(d, s, l, ERROR_CORRECTION_LEVEL_H, &q) == 0);
+
+            assert(p.version == q.version);
+            assert(p.mask == q.mask);
+            assert(memcmp(p.modules, q.modules, sizeof(bitmatrix_t)) == 0);
+        }
+    }
+
+    qrcg_ctx_free(c);
+    qrcg_ctx_free(d);
+    pool_destroy(pool);
+}
+
+static void test_qrcg_split(void) {
+    static uint8_t s[QRCG_MAX_DATA_LENGTH * QRCG_MAX_SYMBOLS + 1];
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    qrcg_part_t p[QRCG_MAX_SYMBOLS];
+    qrcg_symbol_t q;
+
+    assert(c != NULL);
+
+    // a string that fits in one symbol is not split
+    assert(qrcg_split(c, (uint8_t *)"HELLO WORLD", 11, ERROR_CORRECTION_LEVEL_Q,
+                      p) == 1);
+    assert(p[0].offset == 0 && p[0].length == 11);
+
+    memset(s, '0', sizeof(s));
+
+    // 3 symbols of version 40 would do, but 15 of version 16 are smaller, and
+    // the 16 symbols of version 15 would not be enough
+    int n = qrcg_split(c, s, 20000, ERROR_CORRECTION_LEVEL_L, p);
+    structured_append_t a = {0, n, qrcg_parity(s, 20000)};
+
+    assert(n == 15);
+
+    for (int i = 0; i < n; i++) {
+        assert(p[i].offset == (i == 0 ? 0 : p[i - 1].offset + p[i - 1].length));
+
+        a.index = i;
+        assert(qrcg_encode_part(c, &s[p[i].offset], p[i].length,
+                                ERROR_CORRECTION_LEVEL_L, &a, &q) == 0);
+        assert(i == n - 1 ? q.version <= 15 : q.version == 15);
+    }
+
+    // any split into 16 parts has one of at least 1250 digits
+    assert(qrcg_encode_part(c, s, 20000 / 16, ERROR_CORRECTION_LEVEL_L, &a,
+                            &q) == 0);
+    assert(q.version == 15);
+
+    assert(p[n - 1].offset + p[n - 1].length == 20000);
+
+    // the header takes room from the data
+    assert(qrcg_encode(c, s, QRCG_MAX_DATA_LENGTH, ERROR_CORRECTION_LEVEL_L,
+                       &q) == 0);
+    assert(qrcg_encode_part(c, s, QRCG_MAX_DATA_LENGTH,
+                            ERROR_CORRECTION_LEVEL_L, &a,
+                            &q) == QRCG_ERROR_TOO_LONG);
+
+    assert(qrcg_split(c, s, sizeof(s), ERROR_CORRECTION_LEVEL_L, p) ==
+           QRCG_ERROR_TOO_LONG);
+
+    qrcg_ctx_free(c);
+}
+
+static bool fits_version(qrcg_ctx_t *c, const uint8_t s[], int l, int v,
+                         const structured_append_t *a) {
+    qrcg_symbol_t q;
+
+    return qrcg_encode_part(c, s, l, ERROR_CORRECTION_LEVEL_M, a, &q) == 0 &&
+           q.version <= v;
+}
+
+static void test_qrcg_split_kanji(void) {
+    static uint8_t s[9000];
+    static bool b[sizeof(s) + 1];
+    qrcg_ctx_t *c = qrcg_ctx_new();
+    qrcg_part_t p[QRCG_MAX_SYMBOLS];
+    int l = 0;
+
+    assert(c != NULL);
+
+    // runs of kanji characters between single digits and letters, with the
+    // character boundaries
+    srand(1);
+
+    while (l < (int)sizeof(s) - 1) {
+        b[l] = true;
+
+        if (rand() % 8 == 0) {
+            s[l++] = rand() % 2 ? '0' + rand() % 10 : 'a' + rand() % 26;
+        } else {
+            s[l++] = 0x88 + rand() % 0x18;
+            s[l++] = 0x40 + rand() % 0x3F;
+        }
+    }
+
+    b[l] = true;
+
+    int n = qrcg_split(c, s, l, ERROR_CORRECTION_LEVEL_M, p);
+    structured_append_t a = {0, n, qrcg_parity(s, l)};
+    int v = 0;
+    qrcg_symbol_t q;
+
+    assert(n > 1 && n <= QRCG_MAX_SYMBOLS);
+
+    for (int i = 0; i < n; i++) {
+        a.index = i;
+        assert(qrcg_encode_part(c, &s[p[i].offset], p[i].length,
+                                ERROR_CORRECTION_LEVEL_M, &a, &q) == 0);
+
+        if (q.version > v)
+            v = q.version;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int e = p[i].offset + p[i].length;
+
+        assert(p[i].offset == (i == 0 ? 0 : p[i - 1].offset + p[i - 1].length));
+        assert(b[e]);
+
+        // no longer part fits, though the bits do not grow with the length
+        for (int j = e + 1; i < n - 1 && j <= e + 16 && j <= l; j++)
+            if (b[j])
+                assert(!fits_version(c, &s[p[i].offset], j - p[i].offset, v,
+                                     &a));
+    }
+
+    assert(p[n - 1].offset + p[n - 1].length == l);
+
+    // the longest parts of the next smaller version are too many
+    int k = 0;
+
+    for (int i = 0; i < l && k <= QRCG_MAX_SYMBOLS; k++) {
+        int e = i;
+
+        // give up 64 bytes after the last part that fits
+        for (int j = i + 1; j <= l && j <= e + 64; j++)
+            if (b[j] && fits_version(c, &s[i], j - i, v - 1, &a))
+                e = j;
+
+        assert(e > i);
+        i = e;
+    }
+
+    assert(k > QRCG_MAX_SYMBOLS);
+
+    qrcg_ctx_free(c);
+}
+
+int main(int argc, char const *argv[]) {
+    test_qrcg_encode();
+    test_qrcg_encode_incremental();
+    test_qrcg_encode_pool();
+    test_qrcg_split();
+    test_qrcg_split_kanji();
+
+    return 0;
+}
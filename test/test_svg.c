@@ -0,0 +1,216 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svg.h"
+
+#define MAX_SEGMENTS 100000
+
+typedef struct segment {
+    int x;
+    int y0;
+    int y1;
+} segment_t;
+
+// the vertical lines of the path, in absolute coordinates
+static segment_t segments[MAX_SEGMENTS];
+static int num_segments;
+
+static int parse_number(const char **s) {
+    char *end;
+    long v = strtol(*s, &end, 10);
+
+    assert(end != *s);
+    *s = end;
+
+    return v;
+}
+
+static void parse_path(const char *s) {
+    int x = 0;
+    int y = 0;
+    int sx = 0;
+    int sy = 0;
+
+    num_segments = 0;
+
+    while (*s != '"') {
+        char c = *s++;
+
+        if (c == 'm') {
+            x = sx += parse_number(&s);
+            y = sy += parse_number(&s);
+
+        } else if (c == 'h') {
+            x += parse_number(&s);
+
+        } else if (c == 'v' || (c == 'z' && x == sx)) {
+            int t = c == 'v' ? y + parse_number(&s) : sy;
+
+            assert(num_segments < MAX_SEGMENTS);
+
+            segments[num_segments++] = (segment_t){x, y, t};
+            y = t;
+
+        } else if (c == 'z') {
+            // the closing line is horizontal
+            assert(y == sy);
+            x = sx;
+
+        } else {
+            assert(false);
+        }
+    }
+}
+
+// nonzero winding number of the center of a module
+static bool is_filled(int x, int y) {
+    int w = 0;
+
+    for (int i = 0; i < num_segments; i++) {
+        segment_t *s = &segments[i];
+
+        if (s->x > x && s->y0 <= y && s->y1 > y)
+            w++;
+        else if (s->x > x && s->y1 <= y && s->y0 > y)
+            w--;
+    }
+
+    return w != 0;
+}
+
+static void check_svg(const char *d, const bitmatrix_t *m,
+                      const svg_options_t *o) {
+    char h[256];
+    int l = m->n + o->quiet_zone * 2;
+
+    snprintf(h, sizeof(h),
+             "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"%d %d %d "
+             "%d\" width=\"%d\" height=\"%d\"",
+             -o->quiet_zone, -o->quiet_zone, l, l, l * o->scale,
+             l * o->scale);
+
+    assert(strncmp(d, h, strlen(h)) == 0);
+
+    const char *p = strstr(d, "<path d=\"");
+
+    assert(p != NULL);
+    parse_path(p + 9);
+
+    for (int y = 0; y < m->n; y++)
+        for (int x = 0; x < m->n; x++)
+            assert(is_filled(x, y) == bitmatrix_get(m, y, x));
+
+    assert(strcmp(&d[strlen(d) - 10], "\"/></svg>\n") == 0);
+}
+
+static void test_encode_svg(void) {
+    static char d[1 << 20];
+    static bitmatrix_t m;
+    const svg_options_t options[] = {{1, 4, SVG_PATH_RUNS},
+                                     {3, 0, SVG_PATH_OUTLINES},
+                                     {8, 2, SVG_PATH_RUNS},
+                                     {5, 1, SVG_PATH_OUTLINES}};
+
+    srand(1);
+
+    for (int n = 21; n <= 177; n += 78) {
+        bitmatrix_fill(&m, n, false);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                bitmatrix_set(&m, i, j, rand() % 2);
+
+        for (int k = 0; k < 4; k++) {
+            size_t l = encode_svg(d, sizeof(d) - 1, &m, &options[k]);
+
+            assert(l < sizeof(d) - 1);
+            d[l] = '\0';
+            check_svg(d, &m, &options[k]);
+
+            // a short buffer gets the beginning of the same image
+            char s[64];
+
+            assert(encode_svg(s, sizeof(s), &m, &options[k]) == l);
+            assert(memcmp(s, d, sizeof(s)) == 0);
+            assert(encode_svg(NULL, 0, &m, &options[k]) == l);
+        }
+    }
+}
+
+static void test_encode_svg_outlines(void) {
+    static char d[1 << 16];
+    static bitmatrix_t m;
+    const svg_options_t o = {1, 0, SVG_PATH_OUTLINES};
+
+    // a ring with a hole and a module touching it at a corner
+    bitmatrix_fill(&m, 5, false);
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            bitmatrix_set(&m, i, j, i != 1 || j != 1);
+
+    bitmatrix_set(&m, 3, 3, true);
+
+    size_t l = encode_svg(d, sizeof(d) - 1, &m, &o);
+
+    d[l] = '\0';
+    check_svg(d, &m, &o);
+
+    assert(strstr(d, "<path d=\"m0 0h3v3h1v1h-1v-1h-3zm1 1v1h1v-1z\"") !=
+           NULL);
+}
+
+static void test_write_svg_sheet(void) {
+    static bitmatrix_t m[3];
+    const bitmatrix_t *p[3] = {&m[0], &m[1], &m[2]};
+    const int lengths[] = {21, 25, 21};
+    char *d;
+    size_t l;
+
+    srand(2);
+
+    for (int k = 0; k < 3; k++) {
+        bitmatrix_fill(&m[k], lengths[k], false);
+
+        for (int i = 0; i < lengths[k]; i++)
+            for (int j = 0; j < lengths[k]; j++)
+                bitmatrix_set(&m[k], i, j, rand() % 2);
+    }
+
+    for (int t = 0; t < 2; t++) {
+        const svg_options_t o = {2, 1, t == 0 ? SVG_PATH_RUNS
+                                              : SVG_PATH_OUTLINES};
+        FILE *f = open_memstream(&d, &l);
+
+        write_svg_sheet(p, 3, 2, &o, f);
+        fclose(f);
+
+        // cells of 25 + 2 modules in 2 columns and 2 rows
+        assert(strstr(d, "viewBox=\"-1 -1 54 54\" width=\"108\" "
+                         "height=\"108\"") != NULL);
+
+        parse_path(strstr(d, "<path d=\"") + 9);
+
+        for (int y = 0; y < 52; y++)
+            for (int x = 0; x < 52; x++) {
+                int k = y / 27 * 2 + x / 27;
+                int i = y % 27;
+                int j = x % 27;
+                bool b = k < 3 && i < m[k].n && j < m[k].n &&
+                         bitmatrix_get(&m[k], i, j);
+
+                assert(is_filled(x, y) == b);
+            }
+
+        free(d);
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    test_encode_svg();
+    test_encode_svg_outlines();
+    test_write_svg_sheet();
+
+    return 0;
+}
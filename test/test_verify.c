@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qrcg.h"
+#include "verify.h"
+
+static qrcg_ctx_t *ctx;
+static verify_result_t result;
+
+static void check_round_trip(const uint8_t s[], int l,
+                             error_correction_level_t e) {
+    qrcg_symbol_t q;
+
+    assert(qrcg_encode(ctx, s, l, e, &q) == 0);
+    assert(verify_symbol(q.modules, &result) == VERIFY_OK);
+
+    assert(result.version == q.version);
+    assert(result.ec_level == e);
+    assert(result.mask == q.mask);
+    assert(result.length == l);
+    assert(memcmp(result.data, s, l) == 0);
+}
+
+static void test_verify_symbol(void) {
+    static const char alphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ "
+                                       "$%*+-./:";
+    static uint8_t s[QRCG_MAX_DATA_LENGTH];
+
+    srand(1);
+
+    // every mode, every error correction level and versions of each character
+    // count indicator length
+    for (int e = 0; e < 4; e++)
+        for (int l = 1; l < 3000; l = l * 3 / 2 + 1) {
+            for (int i = 0; i < l; i++)
+                s[i] = '0' + rand() % 10;
+
+            check_round_trip(s, l, e);
+
+            for (int i = 0; i < l; i++)
+                s[i] = alphanumeric[rand() % 45];
+
+            check_round_trip(s, l > 1800 ? 1800 : l, e);
+
+            for (int i = 0; i < l; i++)
+                s[i] = rand();
+
+            check_round_trip(s, l > 1200 ? 1200 : l, e);
+
+            // kanji in both ranges of Shift JIS
+            for (int i = 0; i < (l & ~1); i += 2) {
+                s[i] = rand() % 2 ? 0x88 + rand() % 0x18 : 0xE0 + rand() % 0x0B;
+                s[i + 1] = 0x40 + rand() % 0x3F;
+            }
+
+            check_round_trip(s, (l > 1200 ? 1200 : l) & ~1, e);
+        }
+
+    memset(s, '9', sizeof(s));
+    check_round_trip(s, QRCG_MAX_DATA_LENGTH, ERROR_CORRECTION_LEVEL_L);
+}
+
+static void test_verify_symbol_errors(void) {
+    static bitmatrix_t m;
+    qrcg_symbol_t q;
+
+    assert(qrcg_encode(ctx, (uint8_t *)"HELLO WORLD", 11,
+                       ERROR_CORRECTION_LEVEL_Q, &q) == 0);
+
+    // a data module in the lower right corner
+    m = *q.modules;
+    bitmatrix_set(&m, 20, 20, !bitmatrix_get(&m, 20, 20));
+    assert(verify_symbol(&m, &result) == VERIFY_ERROR_SYNDROMES);
+
+    // one copy of the format information
+    m = *q.modules;
+    bitmatrix_set(&m, 8, 0, !bitmatrix_get(&m, 8, 0));
+    assert(verify_symbol(&m, &result) == VERIFY_ERROR_FORMAT_INFO);
+
+    // a module of a finder pattern
+    m = *q.modules;
+    bitmatrix_set(&m, 3, 3, false);
+    assert(verify_symbol(&m, &result) == VERIFY_ERROR_FUNCTION_PATTERNS);
+
+    m = *q.modules;
+    m.n = 23;
+    assert(verify_symbol(&m, &result) == VERIFY_ERROR_SIZE);
+
+    uint8_t s[200];
+
+    memset(s, 'A', sizeof(s));
+    assert(qrcg_encode(ctx, s, sizeof(s), ERROR_CORRECTION_LEVEL_L, &q) == 0);
+    assert(q.version >= 6);
+
+    // a module of the version information above the lower left finder pattern
+    m = *q.modules;
+    bitmatrix_set(&m, m.n - 11, 0, !bitmatrix_get(&m, m.n - 11, 0));
+    assert(verify_symbol(&m, &result) == VERIFY_ERROR_VERSION_INFO);
+}
+
+static void check_every_module(const uint8_t s[], int l,
+                               error_correction_level_t e) {
+    static bitmatrix_t m;
+    qrcg_symbol_t q;
+
+    assert(qrcg_encode(ctx, s, l, e, &q) == 0);
+
+    // versions without remainder bits, so that every module is checked
+    assert(q.version == 0 || (q.version >= 6 && q.version < 13));
+
+    for (int y = 0; y < q.modules->n; y++)
+        for (int x = 0; x < q.modules->n; x++) {
+            m = *q.modules;
+            bitmatrix_set(&m, y, x, !bitmatrix_get(&m, y, x));
+            assert(verify_symbol(&m, &result) != VERIFY_OK);
+        }
+}
+
+static void test_verify_symbol_modules(void) {
+    uint8_t s[200];
+
+    memset(s, 'A', sizeof(s));
+    check_every_module(s, 11, ERROR_CORRECTION_LEVEL_Q);
+    check_every_module(s, sizeof(s), ERROR_CORRECTION_LEVEL_L);
+}
+
+static void test_verify_symbol_append(void) {
+    static uint8_t s[10000];
+    qrcg_part_t p[QRCG_MAX_SYMBOLS];
+    qrcg_symbol_t q;
+
+    for (int i = 0; i < (int)sizeof(s); i++)
+        s[i] = i % 3 == 0 ? 'a' + i % 26 : '0' + i % 10;
+
+    int n = qrcg_split(ctx, s, sizeof(s), ERROR_CORRECTION_LEVEL_M, p);
+    structured_append_t a = {0, n, qrcg_parity(s, sizeof(s))};
+
+    assert(n > 1);
+
+    for (int i = 0; i < n; i++) {
+        a.index = i;
+        assert(qrcg_encode_part(ctx, &s[p[i].offset], p[i].length,
+                                ERROR_CORRECTION_LEVEL_M, &a, &q) == 0);
+        assert(verify_symbol(q.modules, &result) == VERIFY_OK);
+
+        assert(result.append.index == i);
+        assert(result.append.total == n);
+        assert(result.append.parity == a.parity);
+        assert(result.length == p[i].length);
+        assert(memcmp(result.data, &s[p[i].offset], p[i].length) == 0);
+    }
+
+    // a symbol on its own has no header
+    check_round_trip(s, 100, ERROR_CORRECTION_LEVEL_M);
+    assert(result.append.total == 0);
+}
+
+int main(int argc, char const *argv[]) {
+    ctx = qrcg_ctx_new();
+    assert(ctx != NULL);
+
+    test_verify_symbol();
+    test_verify_symbol_errors();
+    test_verify_symbol_modules();
+    test_verify_symbol_append();
+
+    qrcg_ctx_free(ctx);
+
+    return 0;
+}
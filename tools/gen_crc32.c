@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file gen_crc32.c
+ * @brief generator of the crc32 table
+ *
+ * Writes a header with the CRC-32 remainder of every byte value, which png.c
+ * includes to update the checksum a byte at a time.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#define CRC32_POLYNOMIAL 0xEDB88320
+#define VALUES_PER_LINE 6
+
+int main(void) {
+    FILE *f = stdout;
+
+    fprintf(f, "// Generated by gen_crc32. Do not edit.\n\n");
+    fprintf(f, "static const uint32_t crc32_table[256] = {\n");
+
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = i;
+
+        for (int k = 0; k < 8; k++)
+            c = c >> 1 ^ (CRC32_POLYNOMIAL & -(c & 1));
+
+        fprintf(f, "%s0x%08lX,%s", i % VALUES_PER_LINE == 0 ? "    " : "",
+                (unsigned long)c,
+                i % VALUES_PER_LINE == VALUES_PER_LINE - 1 || i == 255 ? "\n"
+                                                                       : " ");
+    }
+
+    fprintf(f, "};\n");
+
+    return 0;
+}
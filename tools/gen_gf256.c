@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2021 y193
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file gen_gf256.c
+ * @brief generator of the gf256 tables
+ *
+ * Writes a header with the antilog, log and split-nibble multiplication tables
+ * of GF(2^8) and the generator polynomial of every number of error correction
+ * codewords per block used by a QR code, which gf256.c includes.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "message.h"
+
+#define PRIMITIVE_POLYNOMIAL 0x11D
+#define NUM_ANTILOGS 512
+#define NUM_VERSIONS 40
+#define NUM_EC_LEVELS 4
+#define MAX_GENPOLY_LENGTH 30
+#define VALUES_PER_LINE 12
+
+static uint8_t antilogs[NUM_ANTILOGS];
+static uint8_t logs[256];
+
+/**
+ * Build the antilog table, twice as long as the period so that the sum of two
+ * logs needs no reduction, and the log table.
+ */
+static void build_logs(void) {
+    int a = 1;
+
+    for (int i = 0; i < NUM_ANTILOGS; i++) {
+        antilogs[i] = a;
+
+        if (i < 255)
+            logs[a] = i;
+
+        a <<= 1;
+
+        if (a & 0x100)
+            a ^= PRIMITIVE_POLYNOMIAL;
+    }
+}
+
+/**
+ * Returns the product of two elements.
+ *
+ * @param a element.
+ * @param b element.
+ * @return product.
+ */
+static uint8_t mul(uint8_t a, uint8_t b) {
+    return a == 0 || b == 0 ? 0 : antilogs[logs[a] + logs[b]];
+}
+
+/**
+ * Create a generator polynomial as the exponents of its coefficients, lowest
+ * degree first and the highest degree term excluded, like gf256_genpoly().
+ *
+ * @param n generation polynomial length.
+ * @param g generation polynomial.
+ */
+static void build_genpoly(int n, uint8_t g[]) {
+    uint8_t c[MAX_GENPOLY_LENGTH + 1] = {1};
+
+    // multiply (x - a^0) ... (x - a^(n - 1)), lowest degree first
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j > 0; j--)
+            c[j] = c[j - 1] ^ mul(c[j], antilogs[i]);
+
+        c[0] = mul(c[0], antilogs[i]);
+    }
+
+    for (int i = 0; i < n; i++)
+        g[i] = logs[c[i]];
+}
+
+/**
+ * Write a table of values.
+ *
+ * @param f output stream.
+ * @param l number of values.
+ * @param v values.
+ * @param d indentation.
+ */
+static void write_values(FILE *f, int l, const uint8_t v[], const char *d) {
+    for (int i = 0; i < l; i++)
+        fprintf(f, "%s%d,%s", i % VALUES_PER_LINE == 0 ? d : "", v[i],
+                i % VALUES_PER_LINE == VALUES_PER_LINE - 1 || i == l - 1 ? "\n"
+                                                                         : " ");
+}
+
+int main(void) {
+    bool used[MAX_GENPOLY_LENGTH + 1] = {false};
+    uint8_t g[MAX_GENPOLY_LENGTH];
+    uint8_t t[32];
+    FILE *f = stdout;
+
+    build_logs();
+
+    for (int v = 0; v < NUM_VERSIONS; v++)
+        for (int e = 0; e < NUM_EC_LEVELS; e++)
+            used[rs_block_information(v, e).num_ec_codewords] = true;
+
+    fprintf(f, "// Generated by gen_gf256. Do not edit.\n\n");
+    fprintf(f, "#define GENPOLY_MAX_LENGTH %d\n\n", MAX_GENPOLY_LENGTH);
+
+    fprintf(f, "static const uint8_t antilogs[%d] = {\n", NUM_ANTILOGS);
+    write_values(f, NUM_ANTILOGS, antilogs, "    ");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const uint8_t logs[256] = {\n");
+    write_values(f, 256, logs, "    ");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "// products of each element and every value of the low nibble "
+               "(first 16 bytes)\n// and of the high nibble (last 16 bytes)\n");
+    fprintf(f, "static const uint8_t mul_nibbles[256][32] = {\n");
+
+    for (int i = 0; i < 256; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[j] = mul(i, j);
+            t[16 + j] = mul(i, j << 4);
+        }
+
+        fprintf(f, "    {\n");
+        write_values(f, 32, t, "        ");
+        fprintf(f, "    },\n");
+    }
+
+    fprintf(f, "};\n\n");
+
+    for (int n = 1; n <= MAX_GENPOLY_LENGTH; n++) {
+        if (!used[n])
+            continue;
+
+        build_genpoly(n, g);
+
+        fprintf(f, "static const uint8_t genpoly%d[%d] = {\n", n, n);
+        write_values(f, n, g, "    ");
+        fprintf(f, "};\n\n");
+    }
+
+    fprintf(f, "static const uint8_t *const genpolys[%d] = {\n",
+            MAX_GENPOLY_LENGTH + 1);
+
+    for (int n = 0; n <= MAX_GENPOLY_LENGTH; n++) {
+        if (used[n])
+            fprintf(f, "    genpoly%d,\n", n);
+        else
+            fprintf(f, "    NULL,\n");
+    }
+
+    fprintf(f, "};\n");
+
+    return ferror(f) ? 1 : 0;
+}